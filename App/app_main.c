@@ -1,5 +1,6 @@
 #include "sim800_mqtt.h"
 #include "sim800_uart.h"
+#include "sim800_batch.h"
 #include "stm32f4xx_hal.h"
 
 uint32_t MQTT_Error_Count;
@@ -19,10 +20,57 @@ uint16_t MSG_Received_Count = 0;
 
 uint8_t Ping_Flag = 0;
 
+/** feed messages published since connect, up to 10 */
+uint8_t Feed_Count = 0;
+
+SIM800_MQTT_Topic_t Feed_Topic;
+SIM800_MQTT_Topic_t Gauge_Topic;
+
+/** samples taken every second, published together every 30s or once 200 chars are batched */
+SIM800_Batch_t Sample_Batch;
+LZ_t Sample_LZ;
+uint32_t Sample_Tick = 0;
+uint32_t Sample_Count = 0;
+
+/** data plan usage, last copy reported by sim800, save it to backup registers or flash from here */
+SIM800_MQTT_Usage_t Usage;
+
+static void Feed_Handler(char *topic,
+						 char *message,
+						 uint32_t mesg_len,
+						 uint8_t dup,
+						 uint8_t qos,
+						 uint16_t message_id)
+{
+	MSG_Received_Count++;
+}
+
 void App_Main(void)
 {
 	SIM800_Init();
 
+	/** subscribed once connected, and again after each reconnect */
+	SIM800_MQTT_Register("xxxxxxxxxxx/feeds/abcd", 1, Feed_Handler);
+
+	/** topic is encoded once, not on each publish */
+	SIM800_MQTT_Topic_Init(&Feed_Topic, "xxxxxxxxxxx/feeds/abcd");
+	SIM800_MQTT_Topic_Init(&Gauge_Topic, "xxxxxxxxxxx/feeds/gauge");
+
+	SIM800_Batch_Init(&Sample_Batch, "xxxxxxxxxxx/feeds/samples", 1, 200, 30000);
+	SIM800_Batch_Set_Compression(&Sample_Batch, &Sample_LZ);
+
+	/** a runaway sensor can not burn the plan, alarms on critical level are not rate limited */
+	SIM800_MQTT_Rate_t rate = {
+		.Byte_Rate = 200,
+		.Byte_Burst = 4096,
+		.Msg_Rate = 120,
+		.Msg_Burst = 20,
+		.Budget = 50 * 1024 * 1024,
+		.Exempt = 1 << SIM800_PRIO_CRITICAL,
+	};
+	SIM800_MQTT_Set_Rate(&rate);
+	SIM800_MQTT_Set_Usage(&Usage);
+
 	for (uint16_t i = 0; i < sizeof(Packet); i++)
 	{
 		Packet[i] = i % 10 + 48;
@@ -50,26 +98,32 @@ void App_Main(void)
 			SIM800_MQTT_Connect("MQTT", 4, flags, 64, "sfsgfsg", "XXXXXXX", "XXXXXXXXXXXXXXXXXXXX");
 		}
 
-		if (SIM800_Is_MQTT_Connected())
+		/** messages published while offline are sent from flash once connected */
+		SIM800_MQTT_Store_Task();
+
+		if (HAL_GetTick() - Sample_Tick >= 1000)
 		{
-			SIM800_MQTT_Subscribe("xxxxxxxxxxx/feeds/abcd", 74, 1);
-			HAL_Delay(1000);
+			Sample_Tick = HAL_GetTick();
+			Sample_Count++;
+			SIM800_Batch_Add(&Sample_Batch, &Sample_Count, sizeof(Sample_Count), 0);
 
-			for (uint32_t i = 1; i < 11; i++)
+			/** only latest count matters, a value still queued is replaced */
+			SIM800_IOV_t gauge = {&Sample_Count, sizeof(Sample_Count)};
+			SIM800_MQTT_Publish_Latest(SIM800_PRIO_NORMAL, &Gauge_Topic, &gauge, 1, 0, 0, NULL, NULL);
+		}
+
+		SIM800_Batch_Task(&Sample_Batch);
+
+		if (SIM800_Is_MQTT_Connected() && Feed_Count < 10)
+		{
+			/** one try per pass, publish fails while in-flight window is full or rate limit or budget refuses,
+			 *  ids are picked by sim800, link is kept alive by sim800 timer */
+			SIM800_IOV_t iov = {Packet, 10};
+
+			if (SIM800_MQTT_Publish_Topic(&Feed_Topic, &iov, 1, 0, 1, 0, 0, NULL, NULL))
 			{
-				if (SIM800_MQTT_Publish("xxxxxxxxxxx/feeds/abcd", Packet, 10, 0, 1, 0, i))
-				{
-					HAL_Delay(1000);
-				}
-
-				if (SIM800_MQTT_Ping())
-				{
-					HAL_Delay(1000);
-				}
+				Feed_Count++;
 			}
-
-			while (1)
-				;
 		}
 	}
 }
@@ -90,8 +144,15 @@ void APP_SIM800_TCP_CONN_CB(uint8_t tcp_ok)
 	TCP_Flag = tcp_ok;
 }
 
+void APP_SIM800_MQTT_Usage_CB(const SIM800_MQTT_Usage_t *usage)
+{
+	Usage = *usage;
+}
+
 void APP_SIM800_TCP_Closed_CB()
 {
+	/** publish again once reconnected */
+	Feed_Count = 0;
 }
 
 void APP_SIM800_MQTT_CONNACK_CB(uint16_t code)
@@ -108,10 +169,15 @@ void APP_SIM800_MQTT_PUBACK_CB(uint16_t message_id)
 	PUB_Message_ID = message_id;
 }
 
-void APP_SIM800_MQTT_SUBACK_CB(uint16_t packet_id, uint8_t qos)
+void APP_SIM800_MQTT_PUB_Failed_CB(uint16_t message_id)
+{
+	MQTT_Error_Count++;
+}
+
+void APP_SIM800_MQTT_SUBACK_CB(uint16_t packet_id, const uint8_t *codes, uint32_t count)
 {
 	SUB_Packet_ID = packet_id;
-	SUB_QOS = qos;
+	SUB_QOS = (count > 0) ? codes[0] : 0x80;
 	SUB_Flag = 1;
 }
 
@@ -120,12 +186,12 @@ void APP_SIM800_MQTT_Ping_CB(void)
 	Ping_Flag++;
 }
 
-void APP_SIM800_MQTT_PUBREC_CB(char *topic,
-							   char *message,
-							   uint32_t mesg_len,
-							   uint8_t dup,
-							   uint8_t qos,
-							   uint16_t message_id)
+void APP_SIM800_MQTT_PUBLISH_CB(char *topic,
+								char *message,
+								uint32_t mesg_len,
+								uint8_t dup,
+								uint8_t qos,
+								uint16_t message_id)
 {
 	MSG_Received_Count++;
 }
@@ -0,0 +1,155 @@
+/** standard includes */
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+/** app includes */
+#include "sim800_at.h"
+
+/**
+ * @brief FNV-1a hash of a response name
+ */
+static uint32_t AT_Hash(const char *name, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief get length of name part of a line, up to first ':' or whole line
+ */
+static uint32_t AT_Name_Len(const char *line)
+{
+    const char *colon = strchr(line, ':');
+
+    return (colon != NULL) ? (uint32_t)(colon - line) : strlen(line);
+}
+
+/**
+ * @brief find slot holding a name, or free slot where it goes
+ * @retval slot index, AT_SLOT_MAX if name is not there and table is full
+ */
+static uint32_t AT_Find(const AT_Table_t *table, const char *name, uint32_t len)
+{
+    uint32_t slot = AT_Hash(name, len) & (AT_SLOT_MAX - 1);
+
+    for (uint32_t i = 0; i < AT_SLOT_MAX; i++)
+    {
+        uint8_t index = table->Slot[slot];
+
+        if (index == 0)
+        {
+            return slot;
+        }
+
+        const char *other = table->Response[index - 1].Name;
+
+        if (strncmp(other, name, len) == 0 && other[len] == '\0')
+        {
+            return slot;
+        }
+
+        slot = (slot + 1) & (AT_SLOT_MAX - 1);
+    }
+
+    return AT_SLOT_MAX;
+}
+
+/**
+ * @brief build hash slots for a response table
+ * @param response table, must stay valid, usually const
+ * @param count responses in table, up to AT_SLOT_MAX / 2 to keep probes short
+ * @retval return 1 if built, 0 if table is too big or a name is given twice
+ */
+uint8_t AT_Table_Init(AT_Table_t *table, const AT_Response_t *response, uint8_t count)
+{
+    memset(table->Slot, 0, sizeof(table->Slot));
+    table->Response = response;
+
+    if (count > AT_SLOT_MAX / 2)
+    {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint32_t slot = AT_Find(table, response[i].Name, strlen(response[i].Name));
+
+        if (slot == AT_SLOT_MAX || table->Slot[slot] != 0)
+        {
+            return 0;
+        }
+
+        table->Slot[slot] = i + 1;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief parse numbers in response arguments
+ * @param text chars after name, leading ':' and spaces are skipped
+ */
+void AT_Args_Parse(AT_Args_t *args, const char *text)
+{
+    while (*text == ':' || *text == ' ')
+    {
+        text++;
+    }
+
+    args->Text = text;
+    args->Count = 0;
+
+    while (*text != '\0' && args->Count < AT_ARG_MAX)
+    {
+        if (*text < '0' || *text > '9')
+        {
+            text++;
+            continue;
+        }
+
+        /** '-' right before a number is its sign, e.g. time zone of +CCLK */
+        int32_t sign = (text > args->Text && text[-1] == '-') ? -1 : 1;
+        uint32_t num = 0;
+
+        while (*text >= '0' && *text <= '9')
+        {
+            /** long digit runs like ICCID or IMEI saturate at INT32_MAX */
+            uint32_t digit = *text - '0';
+            num = (num > (INT32_MAX - digit) / 10) ? INT32_MAX : num * 10 + digit;
+            text++;
+        }
+
+        args->Num[args->Count++] = sign * (int32_t)num;
+    }
+}
+
+/**
+ * @brief call handler of response matching a line
+ * @param line '\0' terminated line without "\r\n"
+ * @retval return 1 if a handler was called, 0 if line is not in table
+ */
+uint8_t AT_Table_Dispatch(const AT_Table_t *table, const char *line)
+{
+    uint32_t len = AT_Name_Len(line);
+    uint32_t slot = AT_Find(table, line, len);
+
+    if (slot == AT_SLOT_MAX || table->Slot[slot] == 0)
+    {
+        return 0;
+    }
+
+    AT_Args_t args;
+    AT_Args_Parse(&args, line + len);
+
+    table->Response[table->Slot[slot] - 1].Handler(&args);
+
+    return 1;
+}
@@ -0,0 +1,49 @@
+#ifndef SIM800_AT_H_
+#define SIM800_AT_H_
+
+/** standard includes */
+#include <stdint.h>
+
+#define AT_SLOT_MAX 32 /** hash slots, power of two, at least twice the responses in a table */
+#define AT_ARG_MAX 8   /** numbers parsed from one response */
+
+/**
+ * arguments of a response line, numbers are split on any char that is not a digit,
+ * so "+CCLK: \"26/10/16,12:30:00+22\"" gives 26 10 16 12 30 0 22,
+ * numbers above INT32_MAX are given as INT32_MAX, use Text for ids like ICCID
+ */
+typedef struct AT_Args_t
+{
+    const char *Text; /** chars after name and ": ", "" if none */
+    int32_t Num[AT_ARG_MAX];
+    uint8_t Count; /** numbers found, extra ones are not parsed */
+} AT_Args_t;
+
+/** called for a line matching a response name */
+typedef void (*AT_Handler_t)(const AT_Args_t *args);
+
+/**
+ * one response or unsolicited code the modem may send
+ * Name is the whole line, or the part before ':' when the line has one, e.g. "+CGATT"
+ */
+typedef struct AT_Response_t
+{
+    const char *Name;
+    AT_Handler_t Handler;
+} AT_Response_t;
+
+/**
+ * response names hashed into open addressed slots, matching a line costs one hash
+ * and usually one compare, not one compare per response
+ */
+typedef struct AT_Table_t
+{
+    const AT_Response_t *Response;
+    uint8_t Slot[AT_SLOT_MAX]; /** index into Response plus 1, 0 if free */
+} AT_Table_t;
+
+uint8_t AT_Table_Init(AT_Table_t *table, const AT_Response_t *response, uint8_t count);
+uint8_t AT_Table_Dispatch(const AT_Table_t *table, const char *line);
+void AT_Args_Parse(AT_Args_t *args, const char *text);
+
+#endif /* SIM800_AT_H_ */
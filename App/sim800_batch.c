@@ -0,0 +1,203 @@
+/** standard includes */
+#include <stdint.h>
+#include <string.h>
+
+/** ST includes */
+#include "main.h"
+
+/** app includes */
+#include "sim800_batch.h"
+
+/** longest record, its length must fit two length bytes */
+#define BATCH_RECORD_MAX 16383
+
+/**
+ * @brief set up a batch for a topic
+ * @param topic topic name, must stay valid
+ * @param qos qos of batched publishes
+ * @param threshold publish once this many chars are batched, up to SIM800_BATCH_SIZE
+ * @param window publish once oldest record is this old, in milliseconds, bounds latency
+ * @retval return 1 if topic and threshold are valid
+ */
+uint8_t SIM800_Batch_Init(SIM800_Batch_t *batch, const char *topic, uint8_t qos, uint32_t threshold, uint32_t window)
+{
+    memset(batch, 0, sizeof(SIM800_Batch_t));
+
+    if (threshold == 0 || threshold > SIM800_BATCH_SIZE || qos > 2)
+    {
+        return 0;
+    }
+
+    batch->QOS = qos;
+    batch->Threshold = threshold;
+    batch->Window = window;
+
+    return SIM800_MQTT_Topic_Init(&batch->Topic, topic);
+}
+
+/**
+ * @brief compress payload of batched publishes
+ *        records are compressed as they are added, each publish is a complete stream, @see LZ_Decompress
+ * @param lz compression state, NULL to send records as they are
+ * @note call before first record is added
+ */
+void SIM800_Batch_Set_Compression(SIM800_Batch_t *batch, LZ_t *lz)
+{
+    batch->LZ = lz;
+
+    if (lz != NULL)
+    {
+        LZ_Init(lz);
+    }
+}
+
+/**
+ * @brief return max chars taken in buffer by adding len chars
+ */
+static uint32_t Batch_Need(const SIM800_Batch_t *batch, uint32_t len)
+{
+    return (batch->LZ != NULL) ? LZ_Bound(batch->LZ, len) : len;
+}
+
+/**
+ * @brief called when buffer of a batched publish can be reused
+ *        called from interrupt, or from @see SIM800_Batch_Flush if message was copied
+ */
+static void Batch_Release(void *ctx)
+{
+    SIM800_Batch_t *batch = ctx;
+
+    batch->Sending = 0;
+}
+
+/**
+ * @brief publish batched records now
+ * @retval return 1 if published or nothing to publish, 0 if previous publish still holds other buffer
+ *         or publish failed, records are kept and sent on a later try
+ */
+uint8_t SIM800_Batch_Flush(SIM800_Batch_t *batch)
+{
+    if (batch->Count == 0)
+    {
+        return 1;
+    }
+
+    if (batch->Sending)
+    {
+        return 0;
+    }
+
+    if (batch->LZ != NULL && !batch->Sealed)
+    {
+        /** stream is ended once, even if publish has to be tried again */
+        batch->Len += LZ_Finish(batch->LZ, &batch->Buffer[batch->Fill][batch->Len]);
+        batch->Sealed = 1;
+    }
+
+    SIM800_IOV_t iov = {batch->Buffer[batch->Fill], batch->Len};
+
+    /** set first, release may be called before publish returns */
+    batch->Sending = 1;
+
+    if (!SIM800_MQTT_Publish_Topic(&batch->Topic, &iov, 1, 0, batch->QOS, 0, 0, Batch_Release, batch))
+    {
+        batch->Sending = 0;
+        return 0;
+    }
+
+    batch->Frames++;
+    batch->Fill ^= 1;
+    batch->Len = 0;
+    batch->Count = 0;
+    batch->Sealed = 0;
+    batch->Urgent = 0;
+
+    return 1;
+}
+
+/**
+ * @brief add a record to batch, batch is published once threshold is reached or record is urgent
+ * @param urgent publish batch now, e.g. for alarms
+ * @retval return 1 if record is added, 0 if it is too long or both buffers are in use
+ * @note call from main context only
+ */
+uint8_t SIM800_Batch_Add(SIM800_Batch_t *batch, const void *data, uint32_t len, uint8_t urgent)
+{
+    uint8_t prefix[2];
+    uint8_t prefix_len = 0;
+    uint32_t value = len;
+
+    if (len > BATCH_RECORD_MAX)
+    {
+        return 0;
+    }
+
+    /** length prefix encoded like mqtt remaining length */
+    do
+    {
+        prefix[prefix_len] = value % 128;
+        value /= 128;
+        if (value > 0)
+        {
+            prefix[prefix_len] |= 128;
+        }
+        prefix_len++;
+    } while (value > 0);
+
+    /** compressed size is not known before, worst case must fit in empty buffer */
+    if (prefix_len + len + ((batch->LZ != NULL) ? (prefix_len + len + 7) / 8 : 0) > SIM800_BATCH_SIZE)
+    {
+        return 0;
+    }
+
+    if ((batch->Sealed || batch->Len + Batch_Need(batch, prefix_len + len) > SIM800_BATCH_SIZE) &&
+        !SIM800_Batch_Flush(batch))
+    {
+        return 0;
+    }
+
+    if (batch->Count == 0)
+    {
+        batch->Start_Tick = HAL_GetTick();
+    }
+
+    uint8_t *buffer = batch->Buffer[batch->Fill];
+
+    if (batch->LZ != NULL)
+    {
+        batch->Len += LZ_Compress(batch->LZ, prefix, prefix_len, &buffer[batch->Len]);
+        batch->Len += LZ_Compress(batch->LZ, data, len, &buffer[batch->Len]);
+    }
+    else
+    {
+        memcpy(&buffer[batch->Len], prefix, prefix_len);
+        memcpy(&buffer[batch->Len + prefix_len], data, len);
+        batch->Len += prefix_len + len;
+    }
+
+    batch->Count++;
+    batch->Records++;
+
+    batch->Urgent |= urgent;
+
+    if (batch->Urgent || batch->Len >= batch->Threshold)
+    {
+        /** on failure it is tried again by @see SIM800_Batch_Task */
+        SIM800_Batch_Flush(batch);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief publish batch if its oldest record is older than window, or if an earlier flush failed
+ * @note call periodically from main loop
+ */
+void SIM800_Batch_Task(SIM800_Batch_t *batch)
+{
+    if (batch->Count != 0 &&
+        (batch->Urgent || batch->Len >= batch->Threshold || HAL_GetTick() - batch->Start_Tick >= batch->Window))
+    {
+        SIM800_Batch_Flush(batch);
+    }
+}
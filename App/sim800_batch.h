@@ -0,0 +1,48 @@
+#ifndef SIM800_BATCH_H_
+#define SIM800_BATCH_H_
+
+/** standard includes */
+#include <stdint.h>
+
+/** app includes */
+#include "sim800_mqtt.h"
+#include "sim800_lz.h"
+
+/** max payload of one batched publish */
+#define SIM800_BATCH_SIZE 256
+
+/**
+ * small records for one topic, sent together as one publish
+ * payload is a sequence of records, each one prefixed by its length encoded like mqtt remaining length
+ * one buffer is filled while the other one is being published
+ * payload can be compressed, @see SIM800_Batch_Set_Compression
+ */
+typedef struct SIM800_Batch_t
+{
+    SIM800_MQTT_Topic_t Topic;
+    uint8_t QOS;
+    uint32_t Threshold; /** publish once this many chars are batched */
+    uint32_t Window;    /** publish once oldest record is this old, in milliseconds */
+
+    uint8_t Buffer[2][SIM800_BATCH_SIZE];
+    uint32_t Len;             /** chars in buffer being filled */
+    uint32_t Count;           /** records in buffer being filled, some may still be held by compressor */
+    uint8_t Fill;             /** buffer being filled */
+    volatile uint8_t Sending; /** other buffer is still used by publish */
+    uint32_t Start_Tick;      /** time first record of buffer being filled was added */
+    uint8_t Urgent;           /** urgent record is waiting to be published */
+
+    LZ_t *LZ;       /** NULL if payload is not compressed */
+    uint8_t Sealed; /** compressed stream of buffer being filled is ended, nothing can be added */
+
+    uint32_t Records; /** records added */
+    uint32_t Frames;  /** publishes sent */
+} SIM800_Batch_t;
+
+uint8_t SIM800_Batch_Init(SIM800_Batch_t *batch, const char *topic, uint8_t qos, uint32_t threshold, uint32_t window);
+void SIM800_Batch_Set_Compression(SIM800_Batch_t *batch, LZ_t *lz);
+uint8_t SIM800_Batch_Add(SIM800_Batch_t *batch, const void *data, uint32_t len, uint8_t urgent);
+uint8_t SIM800_Batch_Flush(SIM800_Batch_t *batch);
+void SIM800_Batch_Task(SIM800_Batch_t *batch);
+
+#endif /* SIM800_BATCH_H_ */
@@ -0,0 +1,290 @@
+/** standard includes */
+#include <stdint.h>
+#include <string.h>
+
+/** app includes */
+#include "sim800_cbor.h"
+
+/** major types */
+#define CBOR_UINT 0
+#define CBOR_NEGINT 1
+#define CBOR_BYTES 2
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_SIMPLE 7
+
+/**
+ * @brief encode into buffer
+ * @param buffer can be NULL to only count chars
+ */
+void CBOR_Init(CBOR_t *cbor, uint8_t *buffer, uint32_t size)
+{
+    cbor->Buffer = buffer;
+    cbor->Write = NULL;
+    cbor->Ctx = NULL;
+    cbor->Size = (buffer != NULL) ? size : 0;
+    cbor->Len = 0;
+}
+
+/**
+ * @brief encode through a writer, e.g. straight into uart tx buffer
+ * @param size chars past this are not written
+ */
+void CBOR_Init_Writer(CBOR_t *cbor, CBOR_Write_CB_t write, void *ctx, uint32_t size)
+{
+    cbor->Buffer = NULL;
+    cbor->Write = write;
+    cbor->Ctx = ctx;
+    cbor->Size = size;
+    cbor->Len = 0;
+}
+
+/**
+ * @brief return 1 if everything encoded was written
+ */
+uint8_t CBOR_Is_Complete(const CBOR_t *cbor)
+{
+    return (cbor->Len <= cbor->Size);
+}
+
+static void CBOR_Write(CBOR_t *cbor, const void *data, uint32_t len)
+{
+    if (cbor->Len < cbor->Size)
+    {
+        uint32_t count = (len < cbor->Size - cbor->Len) ? len : cbor->Size - cbor->Len;
+
+        if (cbor->Buffer != NULL)
+        {
+            memcpy(&cbor->Buffer[cbor->Len], data, count);
+        }
+        else if (cbor->Write != NULL)
+        {
+            cbor->Write(cbor->Ctx, data, count);
+        }
+    }
+
+    cbor->Len += len;
+}
+
+/**
+ * @brief write initial byte and argument in shortest form
+ */
+static void CBOR_Put_Head(CBOR_t *cbor, uint8_t major, uint64_t value)
+{
+    uint8_t head[9];
+    uint8_t len;
+
+    if (value < 24)
+    {
+        head[0] = (major << 5) | value;
+        len = 1;
+    }
+    else if (value <= 0xFF)
+    {
+        head[0] = (major << 5) | 24;
+        len = 2;
+    }
+    else if (value <= 0xFFFF)
+    {
+        head[0] = (major << 5) | 25;
+        len = 3;
+    }
+    else if (value <= 0xFFFFFFFF)
+    {
+        head[0] = (major << 5) | 26;
+        len = 5;
+    }
+    else
+    {
+        head[0] = (major << 5) | 27;
+        len = 9;
+    }
+
+    /** argument is big endian */
+    for (uint8_t i = len - 1; i > 0; i--)
+    {
+        head[i] = value & 0xFF;
+        value >>= 8;
+    }
+
+    CBOR_Write(cbor, head, len);
+}
+
+void CBOR_Put_Uint(CBOR_t *cbor, uint64_t value)
+{
+    CBOR_Put_Head(cbor, CBOR_UINT, value);
+}
+
+void CBOR_Put_Int(CBOR_t *cbor, int64_t value)
+{
+    if (value < 0)
+    {
+        /** -1 - value, without overflow for INT64_MIN */
+        CBOR_Put_Head(cbor, CBOR_NEGINT, ~(uint64_t)value);
+    }
+    else
+    {
+        CBOR_Put_Head(cbor, CBOR_UINT, value);
+    }
+}
+
+/**
+ * @brief encode float, as half precision if that keeps the exact value
+ */
+void CBOR_Put_Float(CBOR_t *cbor, float value)
+{
+    uint32_t bits;
+    uint8_t out[5];
+
+    memcpy(&bits, &value, 4);
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exp = (bits >> 23) & 0xFF;
+    uint32_t mant = bits & 0x7FFFFF;
+
+    if ((mant & 0x1FFF) == 0)
+    {
+        uint16_t half = 0;
+        uint8_t fits = 1;
+
+        if (exp == 0xFF)
+        {
+            /** infinity or nan */
+            half = sign | 0x7C00 | (mant >> 13);
+        }
+        else if (exp == 0 && mant == 0)
+        {
+            half = sign;
+        }
+        else if (exp - 127 + 15 >= 1 && exp - 127 + 15 <= 30)
+        {
+            half = sign | ((exp - 127 + 15) << 10) | (mant >> 13);
+        }
+        else
+        {
+            fits = 0;
+        }
+
+        if (fits)
+        {
+            out[0] = (CBOR_SIMPLE << 5) | 25;
+            out[1] = half >> 8;
+            out[2] = half & 0xFF;
+            CBOR_Write(cbor, out, 3);
+            return;
+        }
+    }
+
+    out[0] = (CBOR_SIMPLE << 5) | 26;
+    out[1] = bits >> 24;
+    out[2] = (bits >> 16) & 0xFF;
+    out[3] = (bits >> 8) & 0xFF;
+    out[4] = bits & 0xFF;
+    CBOR_Write(cbor, out, 5);
+}
+
+/**
+ * @brief encode double, as float or half precision if that keeps the exact value
+ */
+void CBOR_Put_Double(CBOR_t *cbor, double value)
+{
+    if ((double)(float)value == value || value != value)
+    {
+        CBOR_Put_Float(cbor, (float)value);
+        return;
+    }
+
+    uint64_t bits;
+    uint8_t out[9];
+
+    memcpy(&bits, &value, 8);
+
+    out[0] = (CBOR_SIMPLE << 5) | 27;
+    for (uint8_t i = 8; i > 0; i--)
+    {
+        out[i] = bits & 0xFF;
+        bits >>= 8;
+    }
+
+    CBOR_Write(cbor, out, 9);
+}
+
+void CBOR_Put_Bool(CBOR_t *cbor, uint8_t value)
+{
+    uint8_t out = (CBOR_SIMPLE << 5) | (value ? 21 : 20);
+
+    CBOR_Write(cbor, &out, 1);
+}
+
+void CBOR_Put_Null(CBOR_t *cbor)
+{
+    uint8_t out = (CBOR_SIMPLE << 5) | 22;
+
+    CBOR_Write(cbor, &out, 1);
+}
+
+void CBOR_Put_Bytes(CBOR_t *cbor, const void *data, uint32_t len)
+{
+    CBOR_Put_Head(cbor, CBOR_BYTES, len);
+    CBOR_Write(cbor, data, len);
+}
+
+/**
+ * @brief encode utf-8 text of known length
+ */
+void CBOR_Put_String(CBOR_t *cbor, const char *str, uint32_t len)
+{
+    CBOR_Put_Head(cbor, CBOR_TEXT, len);
+    CBOR_Write(cbor, str, len);
+}
+
+/**
+ * @brief encode '\0' terminated utf-8 text
+ */
+void CBOR_Put_Text(CBOR_t *cbor, const char *str)
+{
+    CBOR_Put_String(cbor, str, strlen(str));
+}
+
+/**
+ * @brief start array, followed by count items
+ * @param count CBOR_INDEFINITE if not known, then array is ended by @see CBOR_Put_Break
+ */
+void CBOR_Begin_Array(CBOR_t *cbor, uint32_t count)
+{
+    if (count == CBOR_INDEFINITE)
+    {
+        uint8_t out = (CBOR_ARRAY << 5) | 31;
+        CBOR_Write(cbor, &out, 1);
+        return;
+    }
+
+    CBOR_Put_Head(cbor, CBOR_ARRAY, count);
+}
+
+/**
+ * @brief start map, followed by count key and value pairs
+ * @param count CBOR_INDEFINITE if not known, then map is ended by @see CBOR_Put_Break
+ */
+void CBOR_Begin_Map(CBOR_t *cbor, uint32_t count)
+{
+    if (count == CBOR_INDEFINITE)
+    {
+        uint8_t out = (CBOR_MAP << 5) | 31;
+        CBOR_Write(cbor, &out, 1);
+        return;
+    }
+
+    CBOR_Put_Head(cbor, CBOR_MAP, count);
+}
+
+/**
+ * @brief end indefinite array or map
+ */
+void CBOR_Put_Break(CBOR_t *cbor)
+{
+    uint8_t out = 0xFF;
+
+    CBOR_Write(cbor, &out, 1);
+}
@@ -0,0 +1,43 @@
+#ifndef SIM800_CBOR_H_
+#define SIM800_CBOR_H_
+
+/** standard includes */
+#include <stdint.h>
+
+/** called with each run of encoded chars when encoding through a writer */
+typedef void (*CBOR_Write_CB_t)(void *ctx, const void *data, uint32_t len);
+
+/**
+ * streaming CBOR (RFC 8949) encoder
+ * chars go to a buffer, to a writer callback, or nowhere if only size is wanted
+ * Len keeps counting past Size, so encoding into a too small buffer tells how much is needed
+ */
+typedef struct CBOR_t
+{
+    uint8_t *Buffer;
+    CBOR_Write_CB_t Write;
+    void *Ctx;
+    uint32_t Size; /** max chars written */
+    uint32_t Len;  /** chars encoded */
+} CBOR_t;
+
+#define CBOR_INDEFINITE UINT32_MAX /** count of map or array ended by @see CBOR_Put_Break */
+
+void CBOR_Init(CBOR_t *cbor, uint8_t *buffer, uint32_t size);
+void CBOR_Init_Writer(CBOR_t *cbor, CBOR_Write_CB_t write, void *ctx, uint32_t size);
+uint8_t CBOR_Is_Complete(const CBOR_t *cbor);
+
+void CBOR_Put_Uint(CBOR_t *cbor, uint64_t value);
+void CBOR_Put_Int(CBOR_t *cbor, int64_t value);
+void CBOR_Put_Float(CBOR_t *cbor, float value);
+void CBOR_Put_Double(CBOR_t *cbor, double value);
+void CBOR_Put_Bool(CBOR_t *cbor, uint8_t value);
+void CBOR_Put_Null(CBOR_t *cbor);
+void CBOR_Put_Bytes(CBOR_t *cbor, const void *data, uint32_t len);
+void CBOR_Put_String(CBOR_t *cbor, const char *str, uint32_t len);
+void CBOR_Put_Text(CBOR_t *cbor, const char *str);
+void CBOR_Begin_Array(CBOR_t *cbor, uint32_t count);
+void CBOR_Begin_Map(CBOR_t *cbor, uint32_t count);
+void CBOR_Put_Break(CBOR_t *cbor);
+
+#endif /* SIM800_CBOR_H_ */
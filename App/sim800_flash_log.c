@@ -0,0 +1,424 @@
+/** standard includes */
+#include <stdint.h>
+#include <string.h>
+
+/** ST includes */
+#include "main.h"
+
+/** app includes */
+#include "sim800_flash_log.h"
+
+/**
+ * append only log of records in internal flash
+ * sectors are used in turn, each one starts with a header holding a sequence number, so the oldest is known
+ * a sector is erased only after all its records are consumed, which spreads wear evenly over sectors
+ *
+ * record layout, all fields are 32 bit words:
+ * | FLASH_LOG_REC_MAGIC + length | data padded to word | CRC-32 of data | consumed marker |
+ * consumed marker stays erased (0xFFFFFFFF) until record is consumed, then it is programmed to 0
+ */
+#define FLASH_LOG_SECTOR_MAGIC 0x474F4C53 /** "SLOG" */
+#define FLASH_LOG_SECTOR_HEADER 8         /** magic, sequence number */
+#define FLASH_LOG_REC_MAGIC 0x5A5A0000
+#define FLASH_LOG_REC_OVERHEAD 12
+#define FLASH_LOG_BLANK 0xFFFFFFFF
+
+typedef struct SIM800_Flash_Log_t
+{
+    uint32_t Seq[FLASH_LOG_SECTOR_CNT]; /** 0 if sector is erased */
+    uint32_t Last_Seq;
+    uint8_t Active; /** sector appended to */
+    uint32_t Write_Addr;
+    uint32_t Dropped; /** appends refused because log is full */
+} SIM800_Flash_Log_t;
+
+static SIM800_Flash_Log_t hLog;
+
+/**
+ * @brief read a word of flash, it may have been programmed since last read
+ */
+static uint32_t Flash_Log_Read_Word(uint32_t addr)
+{
+    return *(volatile const uint32_t *)(uintptr_t)addr;
+}
+
+static uint32_t Flash_Log_Sector_Addr(uint8_t sector)
+{
+    return FLASH_LOG_ADDR + sector * FLASH_LOG_SECTOR_SIZE;
+}
+
+static uint32_t Flash_Log_Record_Size(uint32_t len)
+{
+    return FLASH_LOG_REC_OVERHEAD + ((len + 3) & ~3UL);
+}
+
+/**
+ * @brief CRC-32 (IEEE 802.3), 4 bit table keeps it small
+ */
+static uint32_t Flash_Log_CRC(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+    crc = ~crc;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+
+    return ~crc;
+}
+
+/**
+ * @brief check record at addr
+ * @param end end of sector
+ * @param len set to data length if record header is valid
+ * @retval return 0 if there is no record at addr (erased or torn header), rest of sector is unused
+ */
+static uint8_t Flash_Log_Record_At(uint32_t addr, uint32_t end, uint32_t *len)
+{
+    if (addr + FLASH_LOG_REC_OVERHEAD > end)
+    {
+        return 0;
+    }
+
+    uint32_t header = Flash_Log_Read_Word(addr);
+
+    if ((header & 0xFFFF0000) != FLASH_LOG_REC_MAGIC)
+    {
+        return 0;
+    }
+
+    *len = header & 0xFFFF;
+
+    return (addr + Flash_Log_Record_Size(*len) <= end);
+}
+
+/**
+ * @brief return 1 if record is complete and not yet consumed
+ */
+static uint8_t Flash_Log_Record_Live(uint32_t addr, uint32_t len)
+{
+    uint32_t data_size = (len + 3) & ~3UL;
+
+    if (Flash_Log_Read_Word(addr + 4 + data_size + 4) != FLASH_LOG_BLANK)
+    {
+        return 0;
+    }
+
+    /** crc does not match if append was interrupted */
+    return (Flash_Log_CRC(0, (const uint8_t *)(uintptr_t)(addr + 4), len) == Flash_Log_Read_Word(addr + 4 + data_size));
+}
+
+/**
+ * @brief find log state from flash content, called once at start up
+ */
+void SIM800_Flash_Log_Init(void)
+{
+    uint8_t found = 0;
+
+    memset(&hLog, 0, sizeof(hLog));
+
+    /** no sector in use, first append starts sector 0 */
+    hLog.Active = FLASH_LOG_SECTOR_CNT - 1;
+
+    for (uint8_t i = 0; i < FLASH_LOG_SECTOR_CNT; i++)
+    {
+        uint32_t base = Flash_Log_Sector_Addr(i);
+
+        if (Flash_Log_Read_Word(base) == FLASH_LOG_SECTOR_MAGIC)
+        {
+            hLog.Seq[i] = Flash_Log_Read_Word(base + 4);
+
+            if (!found || hLog.Seq[i] > hLog.Last_Seq)
+            {
+                hLog.Last_Seq = hLog.Seq[i];
+                hLog.Active = i;
+                found = 1;
+            }
+        }
+        else if (Flash_Log_Read_Word(base) != FLASH_LOG_BLANK || Flash_Log_Read_Word(base + 4) != FLASH_LOG_BLANK)
+        {
+            /** not written by log, or header is torn, erased once found without live records */
+            hLog.Seq[i] = FLASH_LOG_BLANK;
+        }
+    }
+
+    uint32_t addr = Flash_Log_Sector_Addr(hLog.Active) + FLASH_LOG_SECTOR_HEADER;
+    uint32_t end = Flash_Log_Sector_Addr(hLog.Active) + FLASH_LOG_SECTOR_SIZE;
+    uint32_t len;
+
+    if (!found)
+    {
+        addr = end;
+    }
+
+    while (Flash_Log_Record_At(addr, end, &len))
+    {
+        addr += Flash_Log_Record_Size(len);
+    }
+
+    if (addr < end && Flash_Log_Read_Word(addr) != FLASH_LOG_BLANK)
+    {
+        /** torn header, its length is unknown, continue in next sector */
+        addr = end;
+    }
+
+    hLog.Write_Addr = addr;
+}
+
+/**
+ * @brief start using next sector
+ * @retval return 0 if next sector still holds records not consumed or not yet erased
+ */
+static uint8_t Flash_Log_Rotate(void)
+{
+    uint8_t next = (hLog.Active + 1) % FLASH_LOG_SECTOR_CNT;
+    uint32_t base = Flash_Log_Sector_Addr(next);
+    uint32_t seq = hLog.Last_Seq + 1;
+
+    if (hLog.Seq[next] != 0)
+    {
+        return 0;
+    }
+
+    if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, base + 4, seq) != HAL_OK ||
+        HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, base, FLASH_LOG_SECTOR_MAGIC) != HAL_OK)
+    {
+        return 0;
+    }
+
+    hLog.Seq[next] = seq;
+    hLog.Last_Seq = seq;
+    hLog.Active = next;
+    hLog.Write_Addr = base + FLASH_LOG_SECTOR_HEADER;
+
+    return 1;
+}
+
+/**
+ * @brief append a record made of several fragments
+ *        never erases, time taken depends only on record length (about 16us per word)
+ * @retval return 1 if record is written, 0 if log is full or record is too long
+ * @note call from main context only, not from interrupts
+ */
+uint8_t SIM800_Flash_Log_Append(const SIM800_IOV_t *iov, uint8_t iov_cnt)
+{
+    uint32_t len = 0;
+
+    for (uint8_t i = 0; i < iov_cnt; i++)
+    {
+        len += iov[i].Len;
+    }
+
+    uint32_t size = Flash_Log_Record_Size(len);
+
+    if (len > 0xFFFF)
+    {
+        return 0;
+    }
+
+    HAL_FLASH_Unlock();
+
+    if (hLog.Write_Addr + size > Flash_Log_Sector_Addr(hLog.Active) + FLASH_LOG_SECTOR_SIZE &&
+        !Flash_Log_Rotate())
+    {
+        HAL_FLASH_Lock();
+        hLog.Dropped++;
+        return 0;
+    }
+
+    uint32_t addr = hLog.Write_Addr;
+    uint32_t crc = 0;
+    uint8_t word[4];
+    uint8_t word_len = 0;
+    HAL_StatusTypeDef status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr, FLASH_LOG_REC_MAGIC | len);
+
+    /** space is taken even if programming fails, a torn record is skipped by its crc */
+    hLog.Write_Addr += size;
+    addr += 4;
+
+    for (uint8_t i = 0; i < iov_cnt && status == HAL_OK; i++)
+    {
+        const uint8_t *data = iov[i].Data;
+
+        crc = Flash_Log_CRC(crc, data, iov[i].Len);
+
+        for (uint32_t j = 0; j < iov[i].Len && status == HAL_OK; j++)
+        {
+            word[word_len++] = data[j];
+
+            if (word_len == 4)
+            {
+                uint32_t value;
+                memcpy(&value, word, 4);
+                status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr, value);
+                addr += 4;
+                word_len = 0;
+            }
+        }
+    }
+
+    if (word_len != 0 && status == HAL_OK)
+    {
+        uint32_t value = FLASH_LOG_BLANK;
+        memcpy(&value, word, word_len);
+        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr, value);
+        addr += 4;
+    }
+
+    if (status == HAL_OK)
+    {
+        /** written last, record is only valid once complete */
+        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr, crc);
+    }
+
+    HAL_FLASH_Lock();
+
+    return (status == HAL_OK);
+}
+
+/**
+ * @brief get next record not yet consumed, oldest first
+ * @param rec record to continue after, set Addr to 0 to start from oldest record
+ *        set to found record
+ * @retval return 1 if a record is found
+ */
+uint8_t SIM800_Flash_Log_Next(SIM800_Flash_Log_Record_t *rec)
+{
+    uint32_t addr;
+    uint8_t k; /** position of sector in age order, 1 is oldest */
+
+    if (rec->Addr == 0)
+    {
+        k = 1;
+        addr = 0;
+    }
+    else
+    {
+        uint8_t sector = (rec->Addr - FLASH_LOG_ADDR) / FLASH_LOG_SECTOR_SIZE;
+        k = (sector + FLASH_LOG_SECTOR_CNT - hLog.Active) % FLASH_LOG_SECTOR_CNT;
+        if (k == 0)
+        {
+            k = FLASH_LOG_SECTOR_CNT;
+        }
+        addr = rec->Addr + Flash_Log_Record_Size(rec->Len);
+    }
+
+    for (; k <= FLASH_LOG_SECTOR_CNT; k++)
+    {
+        uint8_t sector = (hLog.Active + k) % FLASH_LOG_SECTOR_CNT;
+        uint32_t end = Flash_Log_Sector_Addr(sector) + FLASH_LOG_SECTOR_SIZE;
+        uint32_t len;
+
+        if (addr == 0)
+        {
+            addr = Flash_Log_Sector_Addr(sector) + FLASH_LOG_SECTOR_HEADER;
+        }
+
+        if (hLog.Seq[sector] == 0)
+        {
+            addr = 0;
+            continue;
+        }
+
+        while (Flash_Log_Record_At(addr, end, &len))
+        {
+            if (Flash_Log_Record_Live(addr, len))
+            {
+                rec->Addr = addr;
+                rec->Data = (const uint8_t *)(uintptr_t)(addr + 4);
+                rec->Len = len;
+                return 1;
+            }
+
+            addr += Flash_Log_Record_Size(len);
+        }
+
+        addr = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief mark record as consumed, it is not returned by @see SIM800_Flash_Log_Next anymore
+ * @note call from main context only, not from interrupts
+ */
+void SIM800_Flash_Log_Consume(const SIM800_Flash_Log_Record_t *rec)
+{
+    uint32_t marker = rec->Addr + Flash_Log_Record_Size(rec->Len) - 4;
+
+    HAL_FLASH_Unlock();
+    HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, marker, 0);
+    HAL_FLASH_Lock();
+}
+
+/**
+ * @brief erase oldest sector if all its records are consumed
+ * @retval return 1 if a sector is erased
+ * @note cpu is stalled while sector is erased (1 to 2 s), call when link is idle
+ */
+uint8_t SIM800_Flash_Log_Erase_Consumed(void)
+{
+    /** oldest first */
+    for (uint8_t k = 1; k <= FLASH_LOG_SECTOR_CNT; k++)
+    {
+        uint8_t sector = (hLog.Active + k) % FLASH_LOG_SECTOR_CNT;
+        uint32_t addr = Flash_Log_Sector_Addr(sector) + FLASH_LOG_SECTOR_HEADER;
+        uint32_t end = Flash_Log_Sector_Addr(sector) + FLASH_LOG_SECTOR_SIZE;
+        uint32_t len;
+
+        if (hLog.Seq[sector] == 0 || (sector == hLog.Active && hLog.Write_Addr < end))
+        {
+            /** erased, or still appended to */
+            continue;
+        }
+
+        while (Flash_Log_Record_At(addr, end, &len))
+        {
+            if (Flash_Log_Record_Live(addr, len))
+            {
+                /** records are consumed oldest first, younger sectors are not done either */
+                return 0;
+            }
+
+            addr += Flash_Log_Record_Size(len);
+        }
+
+        FLASH_EraseInitTypeDef erase = {
+            .TypeErase = FLASH_TYPEERASE_SECTORS,
+            .Sector = FLASH_LOG_SECTOR_FIRST + sector,
+            .NbSectors = 1,
+            .VoltageRange = FLASH_VOLTAGE_RANGE_3,
+        };
+        uint32_t error;
+
+        HAL_FLASH_Unlock();
+        HAL_StatusTypeDef status = HAL_FLASHEx_Erase(&erase, &error);
+        HAL_FLASH_Lock();
+
+        if (status != HAL_OK)
+        {
+            return 0;
+        }
+
+        hLog.Seq[sector] = 0;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief return number of records refused because log was full
+ */
+uint32_t SIM800_Flash_Log_Get_Dropped(void)
+{
+    return hLog.Dropped;
+}
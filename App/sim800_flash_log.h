@@ -0,0 +1,33 @@
+#ifndef SIM800_FLASH_LOG_H_
+#define SIM800_FLASH_LOG_H_
+
+/** standard includes */
+#include <stdint.h>
+
+/** app includes */
+#include "sim800_mqtt.h"
+
+/** log takes internal flash sectors 10 and 11, FLASH region in linker script ends before them */
+#define FLASH_LOG_ADDR 0x080C0000
+#define FLASH_LOG_SECTOR_FIRST 10 /** FLASH_SECTOR_10 */
+#define FLASH_LOG_SECTOR_CNT 2
+#define FLASH_LOG_SECTOR_SIZE (128 * 1024)
+
+/**
+ * record in flash log, Data points into flash and stays valid until record is consumed
+ */
+typedef struct SIM800_Flash_Log_Record_t
+{
+    uint32_t Addr; /** 0 before first record */
+    const uint8_t *Data;
+    uint32_t Len;
+} SIM800_Flash_Log_Record_t;
+
+void SIM800_Flash_Log_Init(void);
+uint8_t SIM800_Flash_Log_Append(const SIM800_IOV_t *iov, uint8_t iov_cnt);
+uint8_t SIM800_Flash_Log_Next(SIM800_Flash_Log_Record_t *rec);
+void SIM800_Flash_Log_Consume(const SIM800_Flash_Log_Record_t *rec);
+uint8_t SIM800_Flash_Log_Erase_Consumed(void);
+uint32_t SIM800_Flash_Log_Get_Dropped(void);
+
+#endif /* SIM800_FLASH_LOG_H_ */
@@ -0,0 +1,253 @@
+/** standard includes */
+#include <stdint.h>
+#include <string.h>
+
+/** app includes */
+#include "sim800_lz.h"
+
+/**
+ * @brief start a new stream
+ */
+void LZ_Init(LZ_t *lz)
+{
+    memset(lz->Head, 0, sizeof(lz->Head));
+
+    lz->Pos = 0;
+    lz->End = 0;
+    lz->Group_Len = 0;
+    lz->Token_Cnt = 0;
+}
+
+/**
+ * @brief return max chars output by compressing len more chars and finishing stream
+ */
+uint32_t LZ_Bound(const LZ_t *lz, uint32_t len)
+{
+    /** every char coded as literal, plus a flag byte per 8 tokens */
+    uint32_t chars = lz->End - lz->Pos + len;
+
+    return lz->Group_Len + chars + (lz->Token_Cnt + chars + 7) / 8;
+}
+
+static uint32_t LZ_Hash(const uint8_t *data)
+{
+    return ((data[0] << 5) ^ (data[1] << 2) ^ data[2] ^ (data[0] >> 3)) & ((1 << LZ_HASH_BITS) - 1);
+}
+
+/**
+ * @brief add token to group, group is output once it holds 8 tokens
+ * @retval chars output
+ */
+static uint32_t LZ_Put_Token(LZ_t *lz, const uint8_t *token, uint8_t len, uint8_t *out)
+{
+    if (lz->Token_Cnt == 0)
+    {
+        lz->Group[0] = 0;
+        lz->Group_Len = 1;
+    }
+
+    if (len == 1)
+    {
+        lz->Group[0] |= 1 << lz->Token_Cnt;
+    }
+
+    memcpy(&lz->Group[lz->Group_Len], token, len);
+    lz->Group_Len += len;
+    lz->Token_Cnt++;
+
+    if (lz->Token_Cnt < 8)
+    {
+        return 0;
+    }
+
+    memcpy(out, lz->Group, lz->Group_Len);
+    lz->Token_Cnt = 0;
+
+    return lz->Group_Len;
+}
+
+/**
+ * @brief code chars of buffer while lookahead is at least min_lookahead
+ * @retval chars output
+ */
+static uint32_t LZ_Code(LZ_t *lz, uint32_t min_lookahead, uint8_t *out)
+{
+    uint32_t out_len = 0;
+
+    while (lz->End - lz->Pos > min_lookahead)
+    {
+        uint32_t avail = lz->End - lz->Pos;
+        uint32_t best = 0;
+        uint32_t dist = 0;
+
+        if (avail >= LZ_MIN_MATCH)
+        {
+            uint32_t h = LZ_Hash(&lz->Buffer[lz->Pos]);
+            uint32_t cand = lz->Head[h];
+
+            lz->Head[h] = lz->Pos + 1;
+
+            /** one candidate per hash, no chains, keeps time per char bounded */
+            if (cand != 0 && lz->Pos - (cand - 1) <= LZ_WINDOW)
+            {
+                const uint8_t *a = &lz->Buffer[cand - 1];
+                const uint8_t *b = &lz->Buffer[lz->Pos];
+                uint32_t max = (avail < LZ_MAX_MATCH) ? avail : LZ_MAX_MATCH;
+
+                while (best < max && a[best] == b[best])
+                {
+                    best++;
+                }
+
+                dist = lz->Pos - (cand - 1);
+            }
+        }
+
+        if (best >= LZ_MIN_MATCH)
+        {
+            uint8_t token[2] = {(dist - 1) >> 2, (((dist - 1) & 0x03) << 6) | (best - LZ_MIN_MATCH)};
+
+            out_len += LZ_Put_Token(lz, token, 2, &out[out_len]);
+
+            /** chars inside match can start later matches */
+            for (uint32_t i = 1; i < best && lz->Pos + i + LZ_MIN_MATCH <= lz->End; i++)
+            {
+                lz->Head[LZ_Hash(&lz->Buffer[lz->Pos + i])] = lz->Pos + i + 1;
+            }
+
+            lz->Pos += best;
+        }
+        else
+        {
+            out_len += LZ_Put_Token(lz, &lz->Buffer[lz->Pos], 1, &out[out_len]);
+            lz->Pos++;
+        }
+    }
+
+    return out_len;
+}
+
+/**
+ * @brief drop chars older than window from buffer, so more input fits
+ */
+static void LZ_Slide(LZ_t *lz)
+{
+    if (lz->Pos <= LZ_WINDOW)
+    {
+        return;
+    }
+
+    uint32_t shift = lz->Pos - LZ_WINDOW;
+
+    memmove(lz->Buffer, &lz->Buffer[shift], lz->End - shift);
+    lz->Pos -= shift;
+    lz->End -= shift;
+
+    for (uint32_t i = 0; i < (1 << LZ_HASH_BITS); i++)
+    {
+        lz->Head[i] = (lz->Head[i] > shift) ? lz->Head[i] - shift : 0;
+    }
+}
+
+/**
+ * @brief compress a chunk of input
+ *        up to LZ_MAX_MATCH chars are kept back, they may be part of a match with next chunk
+ * @param out must have room for @see LZ_Bound chars
+ * @retval chars output
+ */
+uint32_t LZ_Compress(LZ_t *lz, const uint8_t *in, uint32_t len, uint8_t *out)
+{
+    uint32_t out_len = 0;
+
+    while (len > 0)
+    {
+        LZ_Slide(lz);
+
+        uint32_t count = LZ_BUFFER_SIZE - lz->End;
+
+        if (count > len)
+        {
+            count = len;
+        }
+
+        memcpy(&lz->Buffer[lz->End], in, count);
+        lz->End += count;
+        in += count;
+        len -= count;
+
+        out_len += LZ_Code(lz, LZ_MAX_MATCH, &out[out_len]);
+    }
+
+    return out_len;
+}
+
+/**
+ * @brief code chars kept back and output last group, a new stream can be started after
+ * @param out must have room for @see LZ_Bound chars
+ * @retval chars output
+ */
+uint32_t LZ_Finish(LZ_t *lz, uint8_t *out)
+{
+    uint32_t out_len = LZ_Code(lz, 0, out);
+
+    if (lz->Token_Cnt != 0)
+    {
+        memcpy(&out[out_len], lz->Group, lz->Group_Len);
+        out_len += lz->Group_Len;
+    }
+
+    LZ_Init(lz);
+
+    return out_len;
+}
+
+/**
+ * @brief decompress a whole stream
+ * @retval chars output, 0 if stream is invalid or out is too small
+ */
+uint32_t LZ_Decompress(const uint8_t *in, uint32_t len, uint8_t *out, uint32_t out_size)
+{
+    uint32_t pos = 0;
+    uint32_t out_len = 0;
+
+    while (pos < len)
+    {
+        uint8_t flags = in[pos++];
+
+        for (uint8_t i = 0; i < 8 && pos < len; i++)
+        {
+            if (flags & (1 << i))
+            {
+                if (out_len >= out_size)
+                {
+                    return 0;
+                }
+                out[out_len++] = in[pos++];
+            }
+            else
+            {
+                if (pos + 2 > len)
+                {
+                    return 0;
+                }
+
+                uint32_t dist = ((in[pos] << 2) | (in[pos + 1] >> 6)) + 1;
+                uint32_t count = (in[pos + 1] & 0x3F) + LZ_MIN_MATCH;
+                pos += 2;
+
+                if (dist > out_len || out_len + count > out_size)
+                {
+                    return 0;
+                }
+
+                /** chars are copied one by one, match may overlap its own output */
+                for (uint32_t j = 0; j < count; j++, out_len++)
+                {
+                    out[out_len] = out[out_len - dist];
+                }
+            }
+        }
+    }
+
+    return out_len;
+}
@@ -0,0 +1,38 @@
+#ifndef SIM800_LZ_H_
+#define SIM800_LZ_H_
+
+/** standard includes */
+#include <stdint.h>
+
+#define LZ_WINDOW_BITS 10
+#define LZ_WINDOW (1 << LZ_WINDOW_BITS) /** max distance of a match */
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 63) /** length is coded in 6 bits */
+#define LZ_HASH_BITS 8
+#define LZ_BUFFER_SIZE (2 * LZ_WINDOW)
+
+/**
+ * LZSS stream compressor with fixed ram use (about 2.6 KB)
+ * output is groups of a flag byte followed by up to 8 tokens, flag bit n set means token n is a literal byte,
+ * clear means a 2 byte match: 10 bit distance - 1, 6 bit length - LZ_MIN_MATCH
+ * input can be fed in chunks of any size, each stream ends with @see LZ_Finish
+ */
+typedef struct LZ_t
+{
+    uint8_t Buffer[LZ_BUFFER_SIZE];   /** window of coded chars followed by input not yet coded */
+    uint16_t Head[1 << LZ_HASH_BITS]; /** last position of each hash + 1, 0 if none */
+    uint32_t Pos;                     /** next char to code */
+    uint32_t End;                     /** end of input in buffer */
+
+    uint8_t Group[1 + 8 * 2]; /** flag byte and tokens not yet output */
+    uint8_t Group_Len;
+    uint8_t Token_Cnt;
+} LZ_t;
+
+void LZ_Init(LZ_t *lz);
+uint32_t LZ_Bound(const LZ_t *lz, uint32_t len);
+uint32_t LZ_Compress(LZ_t *lz, const uint8_t *in, uint32_t len, uint8_t *out);
+uint32_t LZ_Finish(LZ_t *lz, uint8_t *out);
+uint32_t LZ_Decompress(const uint8_t *in, uint32_t len, uint8_t *out, uint32_t out_size);
+
+#endif /* SIM800_LZ_H_ */
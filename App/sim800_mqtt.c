@@ -12,6 +12,67 @@
 /** app includes */
 #include "sim800_mqtt.h"
 #include "sim800_uart.h"
+#include "sim800_mqtt_parser.h"
+#include "sim800_topic.h"
+#include "sim800_flash_log.h"
+#include "sim800_packet_id.h"
+#include "sim800_at.h"
+
+/** publish fragments up to this size are copied to uart tx buffer instead of sent by reference */
+#define MQTT_IOV_COPY_MAX 32
+
+/** max number of unacknowledged qos 1 publishes, window can be reduced at run time */
+#define MQTT_INFLIGHT_MAX 8
+/** max number of fragments of an in-flight publish */
+#define MQTT_INFLIGHT_IOV_MAX 4
+/** unacknowledged publish is sent again with DUP set after this period in milliseconds */
+#define MQTT_RETRY_TIMEOUT 5000
+/** publish is dropped after this many retransmissions */
+#define MQTT_RETRY_MAX 3
+
+/** holds received packet split across uart rx events */
+#define MQTT_RX_BUFFER_SIZE 1600
+
+/** link is dead if PINGRESP does not come within this period in milliseconds */
+#define MQTT_PINGRESP_TIMEOUT 5000
+/** "+++" escape sequence must be preceded and followed by this period in milliseconds without data */
+#define SIM800_ESCAPE_GUARD 1000
+
+/** max number of inbound qos 2 messages waiting for PUBREL */
+#define MQTT_QOS2_RX_MAX 16
+/** max number of topic filters registered with @see SIM800_MQTT_Register */
+#define MQTT_SUB_MAX 24
+
+/** max number of records from flash log being published at a time */
+#define MQTT_STORE_PENDING_MAX 8 /** must be power of two */
+
+/** acks waiting for room in tx buffer */
+#define MQTT_ACK_QUEUE_MAX 16 /** must be power of two */
+
+/** SUBSCRIBE and UNSUBSCRIBE packets waiting for their ack */
+#define MQTT_REQUEST_MAX 4
+/** registered filters are packed into one SUBSCRIBE up to this count and length */
+#define MQTT_SUBSCRIBE_FILTER_MAX 16
+#define MQTT_SUBSCRIBE_LEN_MAX 1024
+#define MQTT_FILTER_LEN_MAX 128 /** longer filters are refused */
+
+/** queued publishes per priority level, must be power of two */
+#define MQTT_QUEUE_MAX 8
+/** queued publishes are handed to uart only while fewer chars than this wait for tx dma,
+ *  so a critical message waits behind at most one packet and the link does not idle between ticks */
+#define MQTT_QUEUE_AHEAD 128
+
+/** usage is reported to app for saving after this many more bytes sent and received */
+#define MQTT_USAGE_SAVE_STEP 4096
+
+/** byte burst of a set byte rate is raised to at least about one max size packet */
+#define MQTT_RATE_BYTE_BURST_MIN MQTT_RX_BUFFER_SIZE
+
+/** outbound topic aliases kept per connection (mqtt 5), broker may allow fewer */
+#define MQTT_ALIAS_MAX 8
+
+/** cbor payload published while not connected is encoded on stack up to this size before it is journaled */
+#define MQTT_CBOR_STORE_MAX 256
 
 typedef struct SIM800_Response_Flags_t
 {
@@ -27,9 +88,6 @@ typedef struct SIM800_Response_Flags_t
     uint8_t SIM800_RESP_CLOSED;
 
     uint8_t SIM800_RESP_MQTT_CONNACK;
-    uint8_t SIM800_RESP_MQTT_PUBACK;
-    uint8_t SIM800_RESP_MQTT_PUBREC;
-    uint8_t SIM800_RESP_MQTT_SUBACK;
     uint8_t SIM800_RESP_MQTT_PINGACK;
 } SIM800_Response_Flags_t;
 
@@ -52,35 +110,143 @@ typedef struct SIM800_TCP_Data_t
 } SIM800_TCP_Data_t;
 
 /** store info about MSG received from broker */
-typedef struct MQTT_PUBREC_Data_t
+typedef struct MQTT_PUBLISH_Data_t
 {
-    uint8_t PUBACK_Flag;
     uint8_t DUP;
     uint8_t QOS;
     uint16_t MSG_ID;
     uint32_t MSG_Len;
+    uint8_t Skip; /** duplicate, not delivered */
     char Topic[64];
-    char MSG[1500];
-} MQTT_PUBREC_Data_t;
+} MQTT_PUBLISH_Data_t;
 
 /** store info about CONNACK received from broker */
 typedef struct MQTT_CONNACK_Data_t
 {
-    uint16_t Code;
+    uint8_t Code;            /** return code, mqtt 5 reason code, 0 is success for both */
+    uint8_t Session_Present; /** broker kept session state of previous connection */
 } MQTT_CONNACK_Data_t;
 
-/** store info about PUBACK received from broker */
-typedef struct MQTT_PUBACK_Data_t
+typedef enum MQTT_Inflight_State_t
 {
+    MQTT_INFLIGHT_FREE,
+    MQTT_INFLIGHT_WAIT_PUBACK,   /** qos 1 publish sent */
+    MQTT_INFLIGHT_WAIT_PUBREC,   /** qos 2 publish sent */
+    MQTT_INFLIGHT_WAIT_PUBCOMP,  /** qos 2 PUBREL sent, message is no more needed */
+    MQTT_INFLIGHT_RESEND,        /** send publish again as soon as tx buffer has room */
+    MQTT_INFLIGHT_RESEND_PUBREL, /** send PUBREL again as soon as tx buffer has room */
+    MQTT_INFLIGHT_DONE,          /** acked or dropped, waiting for tx dma to be done with caller buffers */
+} MQTT_Inflight_State_t;
+
+/** store info about a published message waiting for acks */
+typedef struct MQTT_Inflight_t
+{
+    MQTT_Inflight_State_t State;
+    uint8_t Header; /** publish fixed header, DUP is set on retransmission */
+    uint8_t Retry;
+    volatile uint8_t TX_Refs; /** queued sends still referencing caller buffers */
     uint16_t MSG_ID;
-} MQTT_PUBACK_Data_t;
+    uint32_t Tick; /** time of last send */
+    uint32_t Copy_Max;
+    SIM800_MQTT_Topic_t Topic; /** copy of handle, topic name must stay valid */
+    SIM800_IOV_t IOV[MQTT_INFLIGHT_IOV_MAX];
+    uint8_t IOV_Cnt;
+    SIM800_MQTT_Release_CB_t Release;
+    void *Ctx;
+} MQTT_Inflight_t;
+
+/** limits announced by broker in CONNACK properties (mqtt 5) */
+typedef struct MQTT_Server_t
+{
+    uint16_t Receive_Max; /** qos 1 and 2 publishes broker takes in flight */
+    uint16_t Alias_Max;   /** topic aliases usable, capped to MQTT_ALIAS_MAX */
+    uint8_t QOS_Max;
+    uint8_t Retain;       /** retained messages are supported */
+} MQTT_Server_t;
+
+/** outbound topic alias bound to a persistent topic name (mqtt 5) */
+typedef struct MQTT_Alias_t
+{
+    const char *Name;
+    uint16_t Len;
+} MQTT_Alias_t;
+
+/** how the topic of one publish is sent */
+typedef struct MQTT_Alias_Use_t
+{
+    uint16_t Alias;    /** alias sent in properties, 0 if none */
+    uint8_t Send_Name; /** topic name is sent, with Alias it binds the alias */
+} MQTT_Alias_Use_t;
+
+/** publish waiting in a priority queue, sent by sim800 timer */
+typedef struct MQTT_Queued_t
+{
+    SIM800_MQTT_Topic_t Topic; /** copy of handle, topic name must stay valid */
+    SIM800_IOV_t IOV[MQTT_INFLIGHT_IOV_MAX];
+    uint8_t IOV_Cnt;
+    uint8_t QOS;
+    uint8_t Retain;
+    uint8_t Conflate; /** replaced by a newer message on same topic while still queued */
+    uint8_t Deferred; /** already counted as held back by rate limit */
+    SIM800_MQTT_Release_CB_t Release;
+    void *Ctx;
+} MQTT_Queued_t;
+
+/** one priority level of outbound publishes */
+typedef struct MQTT_Queue_t
+{
+    MQTT_Queued_t Entry[MQTT_QUEUE_MAX];
+    uint8_t Head;
+    uint8_t Tail;
+    uint8_t Depth;  /** max queued messages, up to MQTT_QUEUE_MAX */
+    uint8_t Drop;   /** @see SIM800_MQTT_Drop_t */
+    uint8_t Weight; /** messages sent per round while other non critical levels have traffic */
+    uint8_t Credit; /** messages left in current round */
+} MQTT_Queue_t;
+
+/** SUBSCRIBE or UNSUBSCRIBE sent, packet id stays in use until it is acked or expires */
+typedef struct MQTT_Request_t
+{
+    uint16_t Packet_ID; /** 0 if free */
+    uint8_t Header;
+    uint8_t App;   /** sent by app, result is reported to it */
+    uint32_t Tick; /** time packet was sent */
+} MQTT_Request_t;
 
-/** store info about SUBACK received from broker */
-typedef struct MQTT_SUBACK_Data_t
+typedef enum MQTT_Sub_State_t
 {
+    MQTT_SUB_FREE,
+    MQTT_SUB_PENDING, /** SUBSCRIBE needs to be sent */
+    MQTT_SUB_SENT,    /** waiting for SUBACK */
+    MQTT_SUB_ACKED,
+    MQTT_SUB_FAILED, /** refused by broker */
+} MQTT_Sub_State_t;
+
+/** store info about a topic filter registered by app */
+typedef struct MQTT_Sub_t
+{
+    MQTT_Sub_State_t State;
     uint8_t QOS;
+    uint16_t Packet_ID;
+    uint8_t Packet_Index; /** position of filter in SUBSCRIBE, its code in SUBACK */
+    uint32_t Tick;        /** time SUBSCRIBE was sent */
+    const char *Filter;
+    SIM800_MQTT_Handler_t Handler;
+} MQTT_Sub_t;
+
+/** ack packet waiting to be sent */
+typedef struct MQTT_Ack_t
+{
+    uint8_t Header;
     uint16_t MSG_ID;
-} MQTT_SUBACK_Data_t;
+} MQTT_Ack_t;
+
+/** record from flash log being published, consumed once released */
+typedef struct MQTT_Store_Pending_t
+{
+    SIM800_Flash_Log_Record_t Record;
+    volatile uint8_t Released;
+} MQTT_Store_Pending_t;
 
 typedef struct SIM800_Handle_t
 {
@@ -97,10 +263,57 @@ typedef struct SIM800_Handle_t
 
     SIM800_TCP_Data_t TCP;
 
-    MQTT_PUBREC_Data_t PUBREC;
+    MQTT_PUBLISH_Data_t PUBLISH;
+
+    MQTT_Parser_t Parser;
+    uint8_t Parser_Buffer[MQTT_RX_BUFFER_SIZE];
     MQTT_CONNACK_Data_t CONNACK;
-    MQTT_PUBACK_Data_t PUBACK;
-    MQTT_SUBACK_Data_t SUBACK;
+
+    uint8_t Version; /** protocol level of current connection */
+    MQTT_Server_t Server;
+    MQTT_Alias_t Alias[MQTT_ALIAS_MAX];
+    uint8_t Alias_Next; /** alias table entry replaced next */
+
+    MQTT_Inflight_t Inflight[MQTT_INFLIGHT_MAX];
+    uint8_t Inflight_Window;
+    uint8_t Inflight_Count;
+
+    uint16_t QOS2_RX_ID[MQTT_QOS2_RX_MAX]; /** inbound qos 2 messages waiting for PUBREL, 0 is free */
+
+    MQTT_Ack_t Ack_Queue[MQTT_ACK_QUEUE_MAX];
+    uint8_t Ack_Head;
+    uint8_t Ack_Tail;
+
+    SIM800_MQTT_Stats_t Stats;
+
+    AT_Table_t AT; /** responses matched in AT mode */
+
+    Topic_Trie_t Sub_Trie;
+    MQTT_Sub_t Sub[MQTT_SUB_MAX];
+    MQTT_Request_t Request[MQTT_REQUEST_MAX];
+    Packet_ID_t IDs; /** ids of publishes in flight and of SUBSCRIBE and UNSUBSCRIBE waiting for ack */
+
+    MQTT_Queue_t Queue[SIM800_PRIO_COUNT];
+
+    SIM800_MQTT_Rate_t Rate;
+    uint64_t Rate_Bytes; /** byte bucket, in 1/1000 bytes */
+    uint64_t Rate_Msgs;  /** message bucket, in 1/60000 messages */
+    uint32_t Rate_Tick;  /** time buckets were last refilled */
+
+    SIM800_MQTT_Usage_t Usage;
+    uint32_t Usage_Saved; /** TX_Bytes + RX_Bytes when usage was last reported */
+
+    MQTT_Store_Pending_t Store_Pending[MQTT_STORE_PENDING_MAX];
+    uint8_t Store_Head;
+    uint8_t Store_Tail;
+    SIM800_Flash_Log_Record_t Store_Read; /** last record taken from flash log */
+    uint8_t Store_Deferred;               /** next record already counted as held back by rate limit */
+
+    uint32_t Keep_Alive; /** milliseconds, 0 if automatic ping is disabled */
+    uint32_t TX_Tick;    /** time last packet was queued */
+    uint32_t Ping_Tick;  /** time PINGREQ was sent */
+    uint8_t Ping_Pending;
+    uint8_t Escape_Step;
 
     uint32_t Next_Tick;
 
@@ -110,6 +323,13 @@ typedef struct SIM800_Handle_t
 /** hold sim800 handle */
 SIM800_Handle_t hSIM800;
 
+static void MQTT_Frame_Handler(void *ctx, const MQTT_Frame_t *frame);
+static void MQTT_Line_Handler(void *ctx, const char *line, uint32_t len);
+static void MQTT_Stream_Begin_Handler(void *ctx, const MQTT_Frame_t *frame);
+static void MQTT_Stream_Data_Handler(void *ctx, const MQTT_Frame_t *frame, const uint8_t *data, uint32_t len, uint32_t offset);
+static void MQTT_Stream_End_Handler(void *ctx, const MQTT_Frame_t *frame);
+static uint8_t MQTT_Store_Erase(void);
+
 /**
   * @brief  return ch occurrence in string
   */
@@ -127,6 +347,74 @@ static uint32_t CH_In_STR(char ch, char *str)
     return cnt;
 }
 
+static void AT_OK_Handler(const AT_Args_t *args)
+{
+    hSIM800.RESP_Flags.SIM800_RESP_OK = 1;
+}
+
+static void AT_Call_Ready_Handler(const AT_Args_t *args)
+{
+    hSIM800.RESP_Flags.SIM800_RESP_CALL_READY = 1;
+}
+
+static void AT_SMS_Ready_Handler(const AT_Args_t *args)
+{
+    hSIM800.RESP_Flags.SIM800_RESP_SMS_READY = 1;
+}
+
+/**
+ * @brief "+CGATT: 1" once attached to gprs
+ */
+static void AT_CGATT_Handler(const AT_Args_t *args)
+{
+    if (args->Count >= 1 && args->Num[0] == 1)
+    {
+        hSIM800.RESP_Flags.SIM800_RESP_GPRS_READY = 1;
+    }
+}
+
+static void AT_Shut_OK_Handler(const AT_Args_t *args)
+{
+    hSIM800.RESP_Flags.SIM800_RESP_SHUT_OK = 1;
+}
+
+static void AT_Connect_Handler(const AT_Args_t *args)
+{
+    hSIM800.RESP_Flags.SIM800_RESP_CONNECT = 1;
+}
+
+/**
+ * @brief +CCLK: "yy/MM/dd,hh:mm:ss+zz"
+ */
+static void AT_CCLK_Handler(const AT_Args_t *args)
+{
+    if (args->Count < 6)
+    {
+        return;
+    }
+
+    hSIM800.Time.Year = args->Num[0];
+    hSIM800.Time.Month = args->Num[1];
+    hSIM800.Time.Date = args->Num[2];
+
+    hSIM800.Time.Hours = args->Num[3];
+    hSIM800.Time.Minutes = args->Num[4];
+    hSIM800.Time.Seconds = args->Num[5];
+
+    hSIM800.RESP_Flags.SIM800_RESP_DATE_TIME = 1;
+}
+
+/** lines handled in AT mode, a new response or unsolicited code only needs an entry here */
+static const AT_Response_t SIM800_AT_Responses[] = {
+    {"OK", AT_OK_Handler},
+    {"Call Ready", AT_Call_Ready_Handler},
+    {"SMS Ready", AT_SMS_Ready_Handler},
+    {"+CGATT", AT_CGATT_Handler},
+    {"SHUT OK", AT_Shut_OK_Handler},
+    {"CONNECT", AT_Connect_Handler},
+    {"+CCLK", AT_CCLK_Handler},
+};
+
 /**
   * @brief  sim800 state machine, one of the timer is used to generate periodic interrupt at 10ms (adjustable)
   * @note set NVIC to 4 bit preemption 0 bit for sub priority, this interrupt priority < systick 
@@ -136,6 +424,100 @@ void SIM800_SM_Task_Init(void)
     /** configured in cube @see tim.c */
 }
 
+/**
+  * @brief  return total bytes on wire for a mqtt packet
+  * @param  remaining_len length of variable header and payload
+  */
+static uint32_t MQTT_Packet_Size(uint32_t remaining_len)
+{
+    uint32_t size = 1 + 1 + remaining_len; /** fixed header + first length byte */
+
+    while (remaining_len >= 128)
+    {
+        remaining_len /= 128;
+        size++;
+    }
+
+    return size;
+}
+
+/**
+  * @brief  start assembling a mqtt packet in uart tx buffer, fixed header and remaining length are written
+  * @param  header fixed header byte
+  * @param  remaining_len length of variable header and payload
+  * @param  ref_len part of remaining_len sent from caller buffers, not copied to tx buffer
+  * @retval return 1 if copied part of packet fits in tx buffer
+  */
+static uint8_t MQTT_Packet_Begin_Ref(uint8_t header, uint32_t remaining_len, uint32_t ref_len)
+{
+    if (!SIM800_UART_Packet_Begin(MQTT_Packet_Size(remaining_len) - ref_len))
+    {
+        return 0;
+    }
+
+    hSIM800.Usage.TX_Bytes += MQTT_Packet_Size(remaining_len);
+
+    /** any packet resets broker keep alive timer */
+    hSIM800.TX_Tick = HAL_GetTick();
+
+    SIM800_UART_Packet_Put_Char(header);
+
+    do
+    {
+        uint8_t len = remaining_len % 128;
+        remaining_len = remaining_len / 128;
+        if (remaining_len > 0)
+        {
+            len |= 128;
+        }
+        SIM800_UART_Packet_Put_Char(len);
+    } while (remaining_len > 0);
+
+    return 1;
+}
+
+/**
+  * @brief  start assembling a mqtt packet, all of it is copied to tx buffer
+  * @param  header fixed header byte
+  * @param  remaining_len length of variable header and payload
+  * @retval return 1 if whole packet fits in tx buffer
+  */
+static uint8_t MQTT_Packet_Begin(uint8_t header, uint32_t remaining_len)
+{
+    return MQTT_Packet_Begin_Ref(header, remaining_len, 0);
+}
+
+/**
+  * @brief  append 16 bit big endian value to packet in assembly
+  */
+static void MQTT_Put_U16(uint16_t value)
+{
+    uint8_t bytes[2] = {value >> 8, value & 0xFF};
+    SIM800_UART_Packet_Put(bytes, 2);
+}
+
+/**
+  * @brief  append length prefixed string to packet in assembly
+  */
+static void MQTT_Put_String(const char *str, uint16_t len)
+{
+    MQTT_Put_U16(len);
+    SIM800_UART_Packet_Put(str, len);
+}
+
+/**
+ * @brief reset broker limits to mqtt defaults and forget topic aliases, they last one connection
+ */
+static void MQTT_Server_Defaults(void)
+{
+    hSIM800.Server.Receive_Max = UINT16_MAX;
+    hSIM800.Server.Alias_Max = 0;
+    hSIM800.Server.QOS_Max = 2;
+    hSIM800.Server.Retain = 1;
+    hSIM800.Alias_Next = 0;
+    memset(hSIM800.Alias, 0, sizeof(hSIM800.Alias));
+}
+
 /**
  * @brief Init peripheral used by sim800
  */
@@ -148,6 +530,37 @@ void SIM800_Init(void)
 
     hSIM800.State = SIM800_IDLE;
 
+    hSIM800.Inflight_Window = MQTT_INFLIGHT_MAX;
+
+    hSIM800.Version = 4;
+    MQTT_Server_Defaults();
+
+    if (!AT_Table_Init(&hSIM800.AT, SIM800_AT_Responses, sizeof(SIM800_AT_Responses) / sizeof(SIM800_AT_Responses[0])))
+    {
+        /** table is too big for AT_SLOT_MAX or has a name twice, no response would be handled */
+        Error_Handler();
+    }
+
+    Topic_Trie_Init(&hSIM800.Sub_Trie);
+
+    Packet_ID_Init(&hSIM800.IDs);
+
+    SIM800_MQTT_Set_Queue(SIM800_PRIO_CRITICAL, MQTT_QUEUE_MAX, SIM800_DROP_NEWEST, 1);
+    SIM800_MQTT_Set_Queue(SIM800_PRIO_NORMAL, MQTT_QUEUE_MAX, SIM800_DROP_NEWEST, 4);
+    SIM800_MQTT_Set_Queue(SIM800_PRIO_BULK, MQTT_QUEUE_MAX, SIM800_DROP_OLDEST, 1);
+
+    SIM800_Flash_Log_Init();
+
+    MQTT_Parser_Init(&hSIM800.Parser,
+                     hSIM800.Parser_Buffer,
+                     sizeof(hSIM800.Parser_Buffer),
+                     MQTT_Frame_Handler,
+                     MQTT_Line_Handler,
+                     NULL);
+
+    /** streaming is off until app sets a threshold */
+    SIM800_MQTT_Set_Stream_Threshold(UINT32_MAX);
+
     /** timer used for tx task is configured in cube @see tim.c */
     HAL_TIM_Base_Start_IT(&htim14);
 }
@@ -189,7 +602,7 @@ uint8_t SIM800_Check_Response(char *buff, uint32_t timeout)
  */
 uint8_t SIM800_Is_MQTT_Connected(void)
 {
-    return (hSIM800.State >= SIM800_MQTT_CONNECTED);
+    return (hSIM800.State == SIM800_MQTT_CONNECTED);
 }
 
 /**
@@ -208,7 +621,9 @@ uint8_t SIM800_Get_Time(void)
 {
     if (hSIM800.State < SIM800_TCP_CONNECTED)
     {
+        hSIM800.Lock_SM = 1;
         SIM800_UART_Send_String("AT+CCLK?\r\n");
+        hSIM800.Lock_SM = 0;
         return 1;
     }
 
@@ -237,9 +652,6 @@ uint8_t SIM800_Reset(void)
     hSIM800.RESP_Flags.SIM800_RESP_CONNECT = 0;
 
     hSIM800.RESP_Flags.SIM800_RESP_MQTT_CONNACK = 0;
-    hSIM800.RESP_Flags.SIM800_RESP_MQTT_PUBACK = 0;
-    hSIM800.RESP_Flags.SIM800_RESP_MQTT_PUBREC = 0;
-    hSIM800.RESP_Flags.SIM800_RESP_MQTT_SUBACK = 0;
     hSIM800.RESP_Flags.SIM800_RESP_MQTT_PINGACK = 0;
 
     hSIM800.Reset_Step = 0;
@@ -402,6 +814,9 @@ uint8_t SIM800_TCP_Connect(char *sim_apn, char *broker, uint16_t port)
 {
     if (hSIM800.State == SIM800_RESET_OK)
     {
+        /** last chance to erase drained flash log sectors before rx traffic starts */
+        MQTT_Store_Erase();
+
         hSIM800.Lock_SM = 1;
 
         snprintf(hSIM800.TCP.SIM_APN, sizeof(hSIM800.TCP.SIM_APN), "%s", sim_apn);
@@ -556,9 +971,9 @@ static uint8_t _SIM800_TCP_Connect()
 /**
  * @brief send connect packet to broker
  *        result callback is @see SIM800_MQTT_CONNACK_Callback 
- * @param protocol_version used mqtt version 3 for 3.1 and 4 for 3.1.1
+ * @param protocol_version used mqtt version 3 for 3.1, 4 for 3.1.1 and 5 for 5.0 (protocol name "MQTT")
  * @param flags for control flags
- * @param keep_alive keep alive interval in seconds
+ * @param keep_alive keep alive interval in seconds, PINGREQ is sent automatically when link is idle, 0 disables it
  * @param my_id clients unique ID across mqtt broker
  * @param user_name user name for mqtt broker
  * @param password password for mqtt broker
@@ -572,7 +987,7 @@ uint8_t SIM800_MQTT_Connect(char *protocol_name,
                             char *user_name,
                             char *password)
 {
-    if (hSIM800.State < SIM800_TCP_CONNECTED || hSIM800.UART_TX_Busy)
+    if (hSIM800.State < SIM800_TCP_CONNECTED || hSIM800.State == SIM800_TCP_ESCAPING)
     {
         return 0;
     }
@@ -585,66 +1000,79 @@ uint8_t SIM800_MQTT_Connect(char *protocol_name,
 
     uint32_t packet_len = 2 + protocol_name_len + 1 + 1 + 2 + 2 + my_id_len;
 
-    hSIM800.Lock_SM = 1;
-    hSIM800.UART_TX_Busy = 1;
-    hSIM800.State = SIM800_MQTT_CONNECTING;
+    if (protocol_version >= 5)
+    {
+        /** property length and receive maximum */
+        packet_len += 1 + 3;
+    }
 
-    if (flags.Bits.User_Name && user_name != NULL)
+    if (user_name == NULL)
+    {
+        flags.Bits.User_Name = 0;
+    }
+    if (password == NULL || !flags.Bits.User_Name)
+    {
+        flags.Bits.Password = 0;
+    }
+
+    if (flags.Bits.User_Name)
     {
         user_name_len = strnlen(user_name, 64);
         packet_len += 2 + user_name_len;
-        if (flags.Bits.Password && password != NULL)
+        if (flags.Bits.Password)
         {
             password_len = strnlen(password, 128);
             packet_len += 2 + password_len;
         }
     }
 
-    SIM800_UART_Send_Char(0x10); /** MQTT connect fixed header */
+    hSIM800.Lock_SM = 1;
 
-    do
+    if (!MQTT_Packet_Begin(0x10, packet_len)) /** MQTT connect fixed header */
     {
-        uint8_t len = packet_len % 128;
-        packet_len = packet_len / 128;
-        if (packet_len > 0)
-        {
-            len |= 128;
-        }
-        SIM800_UART_Send_Char(len);
-    } while (packet_len > 0);
+        hSIM800.Lock_SM = 0;
+        return 0;
+    }
+
+    hSIM800.UART_TX_Busy = 1; /** cleared when tx buffer is drained */
+    hSIM800.State = SIM800_MQTT_CONNECTING;
+    hSIM800.Keep_Alive = keep_alive * 1000;
+    hSIM800.Version = protocol_version;
+    MQTT_Parser_Set_Version(&hSIM800.Parser, protocol_version);
+
+    MQTT_Put_String(protocol_name, protocol_name_len);
 
-    SIM800_UART_Send_Char(protocol_name_len >> 8);
-    SIM800_UART_Send_Char(protocol_name_len & 0xFF);
-    SIM800_UART_Send_String(protocol_name);
+    SIM800_UART_Packet_Put_Char(protocol_version);
 
-    SIM800_UART_Send_Char(protocol_version);
+    SIM800_UART_Packet_Put_Char(flags.C_Flags);
 
-    SIM800_UART_Send_Char(flags.C_Flags);
+    MQTT_Put_U16(keep_alive);
 
-    SIM800_UART_Send_Char(keep_alive >> 8);
-    SIM800_UART_Send_Char(keep_alive & 0xFF);
+    if (protocol_version >= 5)
+    {
+        /** broker must not send more unacked qos 2 messages than can be tracked */
+        SIM800_UART_Packet_Put_Char(3);
+        SIM800_UART_Packet_Put_Char(0x21);
+        MQTT_Put_U16(MQTT_QOS2_RX_MAX);
+    }
 
-    SIM800_UART_Send_Char(my_id_len >> 8);
-    SIM800_UART_Send_Char(my_id_len & 0xFF);
-    SIM800_UART_Send_String(my_id);
+    MQTT_Put_String(my_id, my_id_len);
 
     if (flags.Bits.User_Name)
     {
-        SIM800_UART_Send_Char(user_name_len >> 8);
-        SIM800_UART_Send_Char(user_name_len & 0xFF);
-        SIM800_UART_Send_String(user_name);
+        MQTT_Put_String(user_name, user_name_len);
 
         if (flags.Bits.Password)
         {
-            SIM800_UART_Send_Char(password_len >> 8);
-            SIM800_UART_Send_Char(password_len & 0xFF);
-            SIM800_UART_Send_String(password);
+            MQTT_Put_String(password, password_len);
         }
     }
 
+    /** whole packet is sent by one tx dma transfer */
+    SIM800_UART_Packet_End();
+
     /** response must have been received within this period */
     hSIM800.Next_Tick = HAL_GetTick() + 5000;
-    hSIM800.UART_TX_Busy = 0;
     hSIM800.Lock_SM = 0;
 
     return 1;
@@ -675,18 +1103,22 @@ static SIM800_Status_t _SIM800_MQTT_Connect(void)
  */
 uint8_t SIM800_MQTT_Disconnect(void)
 {
-    if (!SIM800_Is_MQTT_Connected() || hSIM800.UART_TX_Busy)
+    if (!SIM800_Is_MQTT_Connected())
     {
         return 0;
     }
 
     hSIM800.Lock_SM = 1;
-    hSIM800.UART_TX_Busy = 1; /** indicates uart tx is busy */
 
-    SIM800_UART_Send_Char(0xD0); /** MQTT disconnect */
-    SIM800_UART_Send_Char(0x00);
+    if (!MQTT_Packet_Begin(0xE0, 0)) /** MQTT disconnect */
+    {
+        hSIM800.Lock_SM = 0;
+        return 0;
+    }
+
+    hSIM800.UART_TX_Busy = 1; /** cleared when tx buffer is drained */
+    SIM800_UART_Packet_End();
 
-    hSIM800.UART_TX_Busy = 0;
     hSIM800.State = SIM800_TCP_CONNECTED; /** mqtt disconnected, goto TCP connected */
     hSIM800.Lock_SM = 0;
 
@@ -694,281 +1126,2712 @@ uint8_t SIM800_MQTT_Disconnect(void)
 }
 
 /**
- * @brief send ping packet
- * @retval return 1 if command can be executed
+ * @brief queue PINGREQ, PINGRESP is then expected within MQTT_PINGRESP_TIMEOUT
+ * @retval return 1 if queued
  */
-uint8_t SIM800_MQTT_Ping(void)
+static uint8_t MQTT_Send_Ping(void)
 {
-    if (!SIM800_Is_MQTT_Connected() || hSIM800.UART_TX_Busy)
+    if (!MQTT_Packet_Begin(0xC0, 0)) /** MQTT ping */
     {
         return 0;
     }
 
-    hSIM800.Lock_SM = 1;
-    hSIM800.UART_TX_Busy = 1; /** indicates uart tx is busy */
-
-    SIM800_UART_Send_Char(0xC0); /** MQTT ping */
-    SIM800_UART_Send_Char(0x00);
+    hSIM800.UART_TX_Busy = 1; /** cleared when tx buffer is drained */
+    SIM800_UART_Packet_End();
 
-    hSIM800.UART_TX_Busy = 0; /** indicates uart tx is done */
-    hSIM800.Lock_SM = 0;
+    if (!hSIM800.Ping_Pending)
+    {
+        hSIM800.Ping_Pending = 1;
+        hSIM800.Ping_Tick = HAL_GetTick();
+    }
 
     return 1;
 }
 
 /**
- * @brief publish message to a topic
- * @param topic topic to which message will be published
- * @param message message to published
- * @param message_len message length
+ * @brief send ping packet
  * @retval return 1 if command can be executed
+ * @note not needed to keep connection, PINGREQ is sent by sim800 timer when link is idle
  */
-uint8_t SIM800_MQTT_Publish(char *topic,
-                            char *message,
-                            uint32_t message_len,
-                            uint8_t dup,
-                            uint8_t qos,
-                            uint8_t retain,
-                            uint16_t message_id)
+uint8_t SIM800_MQTT_Ping(void)
 {
-    if (!SIM800_Is_MQTT_Connected() || hSIM800.UART_TX_Busy)
+    if (!SIM800_Is_MQTT_Connected())
     {
         return 0;
     }
 
-    uint8_t topic_len = strnlen(topic, 128);
-
-    uint8_t pub = 0x30 | ((dup & 0x01) << 3) | ((qos & 0x03) << 1) | (retain & 0x01);
-
     hSIM800.Lock_SM = 1;
-    hSIM800.UART_TX_Busy = 1; /** indicates uart tx is busy */
-
-    SIM800_UART_Send_Char(pub); /** MQTT publish fixed header */
-
-    uint32_t packet_len = 2 + topic_len + message_len;
 
-    if (qos)
-    {
-        packet_len += 2;
-    }
+    uint8_t queued = MQTT_Send_Ping();
 
-    do
-    {
-        uint8_t len = packet_len % 128;
-        packet_len = packet_len / 128;
-        if (packet_len > 0)
-        {
-            len |= 128;
-        }
-        SIM800_UART_Send_Char(len);
-    } while (packet_len > 0);
+    hSIM800.Lock_SM = 0;
 
-    SIM800_UART_Send_Char(topic_len >> 8);
-    SIM800_UART_Send_Char(topic_len & 0xFF);
+    return queued;
+}
 
-    SIM800_UART_Send_String(topic);
+/**
+ * @brief send PINGREQ when nothing was sent for most of keep alive interval, check PINGRESP comes
+ *        called from sim800 timer while connected to broker
+ * @retval return 0 if PINGRESP did not come and link is dead
+ */
+static uint8_t MQTT_Keep_Alive_Task(void)
+{
+    uint32_t tick_now = HAL_GetTick();
 
-    if (qos)
+    if (hSIM800.Ping_Pending)
     {
-        SIM800_UART_Send_Char(message_id >> 8);
-        SIM800_UART_Send_Char(message_id & 0xFF);
+        return (tick_now - hSIM800.Ping_Tick < MQTT_PINGRESP_TIMEOUT);
     }
 
-    if (message_len > 64)
-    {
-        /** non blocking, UART_TX_Busy will be cleared in uart tx dma isr */
-        SIM800_UART_Send_Bytes_DMA(message, message_len);
-    }
-    else
+    /** sent before interval is over, so PINGRESP has time to come before broker gives up on us */
+    if (hSIM800.Keep_Alive != 0 && tick_now - hSIM800.TX_Tick >= hSIM800.Keep_Alive - hSIM800.Keep_Alive / 4)
     {
-        /** blocking */
-        SIM800_UART_Send_Bytes(message, message_len);
-        hSIM800.UART_TX_Busy = 0; /** indicates uart tx is done */
+        /** tried again on next tick if tx buffer is full */
+        MQTT_Send_Ping();
     }
 
-    hSIM800.Lock_SM = 0;
-
     return 1;
 }
 
 /**
- * @brief subscribe to a topic
- * @param topic topic to be subscribe to
- * @param packet_id message ID can be arbitrary?
- * @param qos 0, 1
- * @retval return 1 if command can be executed
+ * @brief leave transparent mode after link is found dead, so tcp connection can be set up again
+ *        without resetting modem
  */
-uint8_t SIM800_MQTT_Subscribe(char *topic, uint8_t packet_id, uint8_t qos)
+static SIM800_Status_t _SIM800_TCP_Escape(void)
 {
-    if (!SIM800_Is_MQTT_Connected() || hSIM800.UART_TX_Busy)
-    {
-        return 0;
-    }
-
-    uint8_t topic_len = strnlen(topic, 128);
-
-    uint32_t packet_len = 2 + 2 + topic_len + 1;
+    SIM800_Status_t sim800_result = SIM800_BUSY;
+    uint32_t tick_now = HAL_GetTick();
 
-    hSIM800.Lock_SM = 1;
-    hSIM800.UART_TX_Busy = 1; /** indicates uart tx is busy */
+    switch (hSIM800.Escape_Step)
+    {
+    case 0:
+        /** guard period starts once everything queued is sent */
+        if (!hSIM800.UART_TX_Busy)
+        {
+            hSIM800.Next_Tick = tick_now + SIM800_ESCAPE_GUARD;
+            hSIM800.Escape_Step++;
+        }
+        break;
 
-    SIM800_UART_Send_Char(0x82); /** MQTT subscribe fixed header */
+    case 1:
+        if (tick_now > hSIM800.Next_Tick)
+        {
+            hSIM800.RESP_Flags.SIM800_RESP_OK = 0;
+            SIM800_UART_Send_String("+++");
+            hSIM800.Next_Tick = tick_now + SIM800_ESCAPE_GUARD + 500;
+            hSIM800.Escape_Step++;
+        }
+        break;
 
-    do
-    {
-        uint8_t len = packet_len % 128;
-        packet_len = packet_len / 128;
-        if (packet_len > 0)
+    case 2:
+        /** check response of previous cmd (+++) */
+        if (tick_now > hSIM800.Next_Tick)
         {
-            len |= 128;
+            if (hSIM800.RESP_Flags.SIM800_RESP_OK)
+            {
+                hSIM800.RESP_Flags.SIM800_RESP_OK = 0;
+                sim800_result = SIM800_SUCCESS;
+            }
+            else
+            {
+                sim800_result = SIM800_FAILED;
+            }
+            hSIM800.Escape_Step = 0;
         }
-        SIM800_UART_Send_Char(len);
-    } while (packet_len > 0);
+        break;
+    }
 
-    SIM800_UART_Send_Char(packet_id >> 8);
-    SIM800_UART_Send_Char(packet_id & 0xFF);
+    return sim800_result;
+}
 
-    SIM800_UART_Send_Char(topic_len >> 8);
-    SIM800_UART_Send_Char(topic_len & 0xFF);
+/**
+ * @brief choose how topic of a publish is sent, for mqtt 5 a topic alias replaces the name once broker knows it
+ * @param dup retransmissions always send the name, alias may have been bound to another topic since
+ * @param use set to topic name and alias to send
+ * @retval length of topic and properties in variable header
+ */
+static uint32_t MQTT_Alias_Select(const SIM800_MQTT_Topic_t *topic, uint8_t dup, MQTT_Alias_Use_t *use)
+{
+    use->Alias = 0;
+    use->Send_Name = 1;
 
-    SIM800_UART_Send_String(topic);
+    if (hSIM800.Version < 5)
+    {
+        return 2 + topic->Len;
+    }
 
-    SIM800_UART_Send_Char(qos);
+    if (!dup && topic->Persistent && hSIM800.Server.Alias_Max > 0)
+    {
+        for (uint8_t i = 0; i < hSIM800.Server.Alias_Max; i++)
+        {
+            if (hSIM800.Alias[i].Name == topic->Name && hSIM800.Alias[i].Len == topic->Len)
+            {
+                use->Alias = i + 1;
+                use->Send_Name = 0;
+                return 2 + 1 + 3;
+            }
+        }
 
-    hSIM800.UART_TX_Busy = 0; /** indicates uart tx is done */
-    hSIM800.Lock_SM = 0;
+        /** bind next entry, replaced in turn when table is full */
+        use->Alias = hSIM800.Alias_Next + 1;
+    }
 
-    return 1;
+    return 2 + topic->Len + 1 + (use->Alias ? 3 : 0);
 }
 
 /**
- * @brief process received data on sim800 uart
- **/
-void SIM800_RX_Process(void)
+ * @brief append topic of publish to packet in assembly, binds new alias as packet is now queued
+ */
+static void MQTT_Put_Publish_Topic(const SIM800_MQTT_Topic_t *topic, const MQTT_Alias_Use_t *use)
 {
-    while (SIM800_UART_Get_Count())
+    if (!use->Send_Name)
     {
-        if (hSIM800.State >= SIM800_TCP_CONNECTED)
-        {
-            /** in transparent mode */
-            char rx_chars[64] = "";
+        /** empty topic name, broker takes it from alias */
+        MQTT_Put_U16(0);
+        return;
+    }
 
-            rx_chars[0] = SIM800_UART_Peek_Char();
+    /** length prefix was encoded by @see SIM800_MQTT_Topic_Init */
+    SIM800_UART_Packet_Put(topic->Prefix, 2);
+    SIM800_UART_Packet_Put(topic->Name, topic->Len);
 
-            if (rx_chars[0] != -1)
+    if (use->Alias)
+    {
+        hSIM800.Alias[use->Alias - 1].Name = topic->Name;
+        hSIM800.Alias[use->Alias - 1].Len = topic->Len;
+        hSIM800.Alias_Next = use->Alias % hSIM800.Server.Alias_Max;
+    }
+}
+
+/**
+ * @brief append publish properties to packet in assembly, mqtt 5 only
+ */
+static void MQTT_Put_Publish_Properties(const MQTT_Alias_Use_t *use)
+{
+    if (hSIM800.Version < 5)
+    {
+        return;
+    }
+
+    if (use->Alias)
+    {
+        SIM800_UART_Packet_Put_Char(3);
+        SIM800_UART_Packet_Put_Char(0x23);
+        MQTT_Put_U16(use->Alias);
+    }
+    else
+    {
+        SIM800_UART_Packet_Put_Char(0);
+    }
+}
+
+/**
+ * @brief queue publish packet in uart tx buffer
+ * @param pub publish fixed header
+ * @param copy_max fragments longer than this are sent by reference
+ * @param release called when referenced fragments are sent, can be NULL
+ *        called from uart interrupt, or before return if all fragments were copied
+ * @retval return 1 if whole packet is queued, release is only called in this case
+ */
+static uint8_t MQTT_Send_Publish(uint8_t pub,
+                                 const SIM800_MQTT_Topic_t *topic,
+                                 const SIM800_IOV_t *iov,
+                                 uint8_t iov_cnt,
+                                 uint16_t message_id,
+                                 uint32_t copy_max,
+                                 SIM800_MQTT_Release_CB_t release,
+                                 void *ctx)
+{
+    uint8_t qos = (pub >> 1) & 0x03;
+
+    uint32_t message_len = 0;
+    uint32_t ref_len = 0;
+    uint8_t ref_cnt = 0;
+    uint8_t last_ref = 0;
+
+    for (uint8_t i = 0; i < iov_cnt; i++)
+    {
+        message_len += iov[i].Len;
+        if (iov[i].Len > copy_max)
+        {
+            ref_len += iov[i].Len;
+            ref_cnt++;
+            last_ref = i;
+        }
+    }
+
+    MQTT_Alias_Use_t use;
+    uint32_t packet_len = MQTT_Alias_Select(topic, (pub >> 3) & 0x01, &use) + message_len;
+
+    if (qos)
+    {
+        packet_len += 2;
+    }
+
+    /** each ref fragment needs a tx descriptor, and so does each run of copied chars before it */
+    if (SIM800_UART_Get_TX_Ref_Free() < 2 * (uint32_t)ref_cnt + 1 ||
+        !MQTT_Packet_Begin_Ref(pub, packet_len, ref_len))
+    {
+        return 0;
+    }
+
+    hSIM800.UART_TX_Busy = 1; /** cleared when tx buffer is drained */
+
+    MQTT_Put_Publish_Topic(topic, &use);
+
+    if (qos)
+    {
+        MQTT_Put_U16(message_id);
+    }
+
+    MQTT_Put_Publish_Properties(&use);
+
+    for (uint8_t i = 0; i < iov_cnt; i++)
+    {
+        if (iov[i].Len > copy_max)
+        {
+            /** release buffers once last referenced fragment is sent */
+            SIM800_UART_Packet_Put_Ref(iov[i].Data,
+                                       iov[i].Len,
+                                       (i == last_ref) ? release : NULL,
+                                       (i == last_ref) ? ctx : NULL);
+        }
+        else
+        {
+            /** small fragments are cheaper to copy than to set up a dma transfer for */
+            SIM800_UART_Packet_Put(iov[i].Data, iov[i].Len);
+        }
+    }
+
+    SIM800_UART_Packet_End();
+
+    if (ref_cnt == 0 && release != NULL)
+    {
+        /** everything was copied */
+        release(ctx);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief send a 2 byte ack packet (PUBACK, PUBREC, PUBREL, PUBCOMP)
+ * @retval return 1 if queued
+ */
+static uint8_t MQTT_Send_Ack(uint8_t header, uint16_t message_id)
+{
+    if (!MQTT_Packet_Begin(header, 2))
+    {
+        return 0;
+    }
+
+    hSIM800.UART_TX_Busy = 1; /** cleared when tx buffer is drained */
+    MQTT_Put_U16(message_id);
+    SIM800_UART_Packet_End();
+
+    return 1;
+}
+
+/**
+ * @brief send queued acks in order
+ */
+static void MQTT_Ack_Task(void)
+{
+    while (hSIM800.Ack_Tail != hSIM800.Ack_Head)
+    {
+        MQTT_Ack_t *ack = &hSIM800.Ack_Queue[hSIM800.Ack_Tail & (MQTT_ACK_QUEUE_MAX - 1)];
+
+        if (!MQTT_Send_Ack(ack->Header, ack->MSG_ID))
+        {
+            break;
+        }
+
+        hSIM800.Ack_Tail++;
+    }
+}
+
+/**
+ * @brief queue ack for an inbound message, sent from sim800 timer as tx buffer has room
+ * @note called while received data is processed in sim800 timer, so queue is flushed in place when full
+ *       ack is dropped only if tx buffer is full too, broker will send message again
+ */
+static void MQTT_Ack_Push(uint8_t header, uint16_t message_id)
+{
+    if ((uint8_t)(hSIM800.Ack_Head - hSIM800.Ack_Tail) >= MQTT_ACK_QUEUE_MAX && SIM800_Is_MQTT_Connected())
+    {
+        /** burst of messages, e.g. persistent session flushed after reconnect */
+        MQTT_Ack_Task();
+    }
+
+    if ((uint8_t)(hSIM800.Ack_Head - hSIM800.Ack_Tail) >= MQTT_ACK_QUEUE_MAX)
+    {
+        hSIM800.Stats.Ack_Dropped++;
+        return;
+    }
+
+    MQTT_Ack_t *ack = &hSIM800.Ack_Queue[hSIM800.Ack_Head & (MQTT_ACK_QUEUE_MAX - 1)];
+    ack->Header = header;
+    ack->MSG_ID = message_id;
+    hSIM800.Ack_Head++;
+}
+
+/**
+ * @brief find inbound qos 2 message waiting for PUBREL
+ * @retval index in hSIM800.QOS2_RX_ID, -1 if not found
+ */
+static int MQTT_QOS2_RX_Find(uint16_t message_id)
+{
+    for (uint8_t i = 0; i < MQTT_QOS2_RX_MAX; i++)
+    {
+        if (hSIM800.QOS2_RX_ID[i] == message_id)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief remember inbound qos 2 message until PUBREL is received
+ * @retval return 1 if stored, 0 if table is full
+ */
+static uint8_t MQTT_QOS2_RX_Add(uint16_t message_id)
+{
+    int i = MQTT_QOS2_RX_Find(0);
+
+    if (i < 0)
+    {
+        return 0;
+    }
+
+    hSIM800.QOS2_RX_ID[i] = message_id;
+    APP_SIM800_MQTT_QOS2_Persist_CB(message_id, 1, 1);
+
+    return 1;
+}
+
+/**
+ * @brief check inbound qos 2 publish, message is delivered only the first time its id is seen
+ * @retval return 1 if message must be delivered to app, @see MQTT_Publish_Delivered after it
+ */
+static uint8_t MQTT_QOS2_RX_Is_New(uint16_t message_id)
+{
+    if (MQTT_QOS2_RX_Find(message_id) >= 0)
+    {
+        /** already delivered, PUBREC was lost */
+        hSIM800.Stats.RX_Duplicates++;
+        MQTT_Ack_Push(0x50, message_id);
+        return 0;
+    }
+
+    if (MQTT_QOS2_RX_Find(0) < 0)
+    {
+        /** table is full, can not guarantee exactly once, no PUBREC so broker sends it again later */
+        hSIM800.Stats.RX_Dropped++;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief ack inbound publish once app has all of it
+ */
+static void MQTT_Publish_Delivered(uint8_t qos, uint16_t message_id)
+{
+    hSIM800.Stats.RX_Messages++;
+
+    if (qos == 1)
+    {
+        MQTT_Ack_Push(0x40, message_id); /** PUBACK */
+    }
+    else if (qos == 2)
+    {
+        MQTT_QOS2_RX_Add(message_id);
+        MQTT_Ack_Push(0x50, message_id); /** PUBREC */
+    }
+}
+
+/**
+ * @brief handle PUBREL received from broker, inbound qos 2 exchange is complete
+ */
+static void MQTT_QOS2_RX_PUBREL(uint16_t message_id)
+{
+    int i = MQTT_QOS2_RX_Find(message_id);
+
+    if (i >= 0)
+    {
+        hSIM800.QOS2_RX_ID[i] = 0;
+        APP_SIM800_MQTT_QOS2_Persist_CB(message_id, 1, 0);
+    }
+
+    /** PUBCOMP is sent even for unknown id, so broker can finish its side */
+    MQTT_Ack_Push(0x70, message_id);
+}
+
+/**
+ * @brief forget inbound state of previous session, called when broker did not keep it
+ *        pending acks belong to old packet ids, and new messages may reuse ids of unreleased qos 2 ones
+ */
+static void MQTT_RX_Session_Clear(void)
+{
+    hSIM800.Ack_Tail = hSIM800.Ack_Head;
+
+    for (uint8_t i = 0; i < MQTT_QOS2_RX_MAX; i++)
+    {
+        if (hSIM800.QOS2_RX_ID[i] != 0)
+        {
+            APP_SIM800_MQTT_QOS2_Persist_CB(hSIM800.QOS2_RX_ID[i], 1, 0);
+            hSIM800.QOS2_RX_ID[i] = 0;
+        }
+    }
+}
+
+/**
+ * @brief called when tx dma is done with buffers of an in-flight publish
+ */
+static void MQTT_Inflight_TX_Done(void *ctx)
+{
+    MQTT_Inflight_t *entry = ctx;
+
+    __atomic_fetch_sub(&entry->TX_Refs, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief send in-flight publish, DUP is set if it was sent before
+ * @retval return 1 if queued
+ */
+static uint8_t MQTT_Inflight_Send(MQTT_Inflight_t *entry)
+{
+    __atomic_fetch_add(&entry->TX_Refs, 1, __ATOMIC_RELAXED);
+
+    if (!MQTT_Send_Publish(entry->Header,
+                           &entry->Topic,
+                           entry->IOV,
+                           entry->IOV_Cnt,
+                           entry->MSG_ID,
+                           entry->Copy_Max,
+                           MQTT_Inflight_TX_Done,
+                           entry))
+    {
+        __atomic_fetch_sub(&entry->TX_Refs, 1, __ATOMIC_RELAXED);
+        entry->State = MQTT_INFLIGHT_RESEND;
+        return 0;
+    }
+
+    entry->Header |= 0x08; /** any later send is a retransmission */
+    entry->Tick = HAL_GetTick();
+    entry->State = (((entry->Header >> 1) & 0x03) == 2) ? MQTT_INFLIGHT_WAIT_PUBREC : MQTT_INFLIGHT_WAIT_PUBACK;
+
+    return 1;
+}
+
+/**
+ * @brief send PUBREL of in-flight qos 2 publish
+ * @retval return 1 if queued
+ */
+static uint8_t MQTT_Inflight_Send_PUBREL(MQTT_Inflight_t *entry)
+{
+    if (!MQTT_Send_Ack(0x62, entry->MSG_ID))
+    {
+        entry->State = MQTT_INFLIGHT_RESEND_PUBREL;
+        return 0;
+    }
+
+    entry->Tick = HAL_GetTick();
+    entry->State = MQTT_INFLIGHT_WAIT_PUBCOMP;
+
+    return 1;
+}
+
+/**
+ * @brief release caller buffers of in-flight entries that no more need them, free finished entries
+ *        called from sim800 timer, so it never runs while an entry is being set up
+ */
+static void MQTT_Inflight_Collect(void)
+{
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        MQTT_Inflight_t *entry = &hSIM800.Inflight[i];
+
+        if (entry->State < MQTT_INFLIGHT_WAIT_PUBCOMP || entry->State == MQTT_INFLIGHT_RESEND ||
+            __atomic_load_n(&entry->TX_Refs, __ATOMIC_ACQUIRE) != 0)
+        {
+            /** message may still be sent again, or tx dma is still reading it */
+            continue;
+        }
+
+        if (entry->Release != NULL)
+        {
+            SIM800_MQTT_Release_CB_t release = entry->Release;
+            entry->Release = NULL;
+            release(entry->Ctx);
+        }
+
+        if (entry->State == MQTT_INFLIGHT_DONE)
+        {
+            entry->State = MQTT_INFLIGHT_FREE;
+            hSIM800.Inflight_Count--;
+            Packet_ID_Release(&hSIM800.IDs, entry->MSG_ID);
+        }
+    }
+}
+
+/**
+ * @brief find in-flight publish waiting for ack
+ * @retval return NULL if message id is not in flight
+ */
+static MQTT_Inflight_t *MQTT_Inflight_Find(uint16_t message_id)
+{
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        MQTT_Inflight_t *entry = &hSIM800.Inflight[i];
+
+        if (entry->State != MQTT_INFLIGHT_FREE && entry->State != MQTT_INFLIGHT_DONE &&
+            entry->MSG_ID == message_id)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief get a free in-flight entry within window
+ * @retval return NULL if window is full
+ */
+static MQTT_Inflight_t *MQTT_Inflight_Alloc(void)
+{
+    if (hSIM800.Inflight_Count >= hSIM800.Inflight_Window ||
+        hSIM800.Inflight_Count >= hSIM800.Server.Receive_Max)
+    {
+        return NULL;
+    }
+
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        if (hSIM800.Inflight[i].State == MQTT_INFLIGHT_FREE)
+        {
+            return &hSIM800.Inflight[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief handle PUBACK, PUBREC or PUBCOMP received from broker
+ * @param header fixed header of received packet
+ * @param reason mqtt 5 reason code, 0x80 and above ends the exchange with failure
+ */
+static void MQTT_Inflight_Ack(uint8_t header, uint16_t message_id, uint8_t reason)
+{
+    MQTT_Inflight_t *entry = MQTT_Inflight_Find(message_id);
+
+    if (entry == NULL)
+    {
+        /** ack for a retransmitted or dropped message */
+        return;
+    }
+
+    uint8_t qos = (entry->Header >> 1) & 0x03;
+    uint8_t publish_sent = (entry->State == MQTT_INFLIGHT_WAIT_PUBACK ||
+                            entry->State == MQTT_INFLIGHT_WAIT_PUBREC ||
+                            entry->State == MQTT_INFLIGHT_RESEND);
+
+    if (reason != 0)
+    {
+        APP_SIM800_MQTT_Reason_CB(header >> 4, message_id, reason);
+    }
+
+    switch (header)
+    {
+    case 0x40: /** PUBACK */
+        if (qos == 1 && publish_sent)
+        {
+            entry->State = MQTT_INFLIGHT_DONE;
+            if (reason >= 0x80)
+            {
+                APP_SIM800_MQTT_PUB_Failed_CB(message_id);
+            }
+            else
+            {
+                APP_SIM800_MQTT_PUBACK_CB(message_id);
+            }
+        }
+        break;
+
+    case 0x50: /** PUBREC */
+        if (qos == 2)
+        {
+            if (reason >= 0x80)
+            {
+                /** refused, no PUBREL follows */
+                if (publish_sent)
+                {
+                    entry->State = MQTT_INFLIGHT_DONE;
+                    APP_SIM800_MQTT_PUB_Failed_CB(message_id);
+                }
+                break;
+            }
+            if (publish_sent)
+            {
+                /** broker owns the message now, it is never sent again */
+                entry->Retry = 0;
+                APP_SIM800_MQTT_QOS2_Persist_CB(message_id, 0, 1);
+            }
+            MQTT_Inflight_Send_PUBREL(entry);
+        }
+        break;
+
+    case 0x70: /** PUBCOMP */
+        if (qos == 2 && !publish_sent)
+        {
+            entry->State = MQTT_INFLIGHT_DONE;
+            APP_SIM800_MQTT_QOS2_Persist_CB(message_id, 0, 0);
+            if (reason >= 0x80)
+            {
+                /** broker lost the packet id, message was delivered at PUBREC */
+                APP_SIM800_MQTT_PUB_Failed_CB(message_id);
+            }
+            else
+            {
+                APP_SIM800_MQTT_PUBCOMP_CB(message_id);
+            }
+        }
+        break;
+    }
+}
+
+/**
+ * @brief retransmit in-flight publishes and PUBRELs that are not acked in time
+ *        called from sim800 timer while connected to broker
+ */
+static void MQTT_Inflight_Task(void)
+{
+    uint32_t tick_now = HAL_GetTick();
+
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        MQTT_Inflight_t *entry = &hSIM800.Inflight[i];
+
+        if ((entry->State == MQTT_INFLIGHT_WAIT_PUBACK ||
+             entry->State == MQTT_INFLIGHT_WAIT_PUBREC ||
+             entry->State == MQTT_INFLIGHT_WAIT_PUBCOMP) &&
+            tick_now - entry->Tick >= MQTT_RETRY_TIMEOUT)
+        {
+            if (entry->Retry >= MQTT_RETRY_MAX)
+            {
+                if (entry->State == MQTT_INFLIGHT_WAIT_PUBCOMP)
+                {
+                    APP_SIM800_MQTT_QOS2_Persist_CB(entry->MSG_ID, 0, 0);
+                }
+                entry->State = MQTT_INFLIGHT_DONE;
+                APP_SIM800_MQTT_PUB_Failed_CB(entry->MSG_ID);
+                continue;
+            }
+
+            entry->Retry++;
+            entry->State = (entry->State == MQTT_INFLIGHT_WAIT_PUBCOMP) ? MQTT_INFLIGHT_RESEND_PUBREL : MQTT_INFLIGHT_RESEND;
+        }
+
+        /** tx buffer is full, keep order and try again on next tick */
+        if (entry->State == MQTT_INFLIGHT_RESEND && !MQTT_Inflight_Send(entry))
+        {
+            break;
+        }
+        if (entry->State == MQTT_INFLIGHT_RESEND_PUBREL && !MQTT_Inflight_Send_PUBREL(entry))
+        {
+            break;
+        }
+    }
+
+    MQTT_Inflight_Collect();
+}
+
+/**
+ * @brief resend everything still in flight, called when connection to broker is established again
+ */
+static void MQTT_Inflight_Resend_All(void)
+{
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        MQTT_Inflight_t *entry = &hSIM800.Inflight[i];
+
+        if (entry->State == MQTT_INFLIGHT_WAIT_PUBACK || entry->State == MQTT_INFLIGHT_WAIT_PUBREC)
+        {
+            entry->State = MQTT_INFLIGHT_RESEND;
+        }
+        else if (entry->State == MQTT_INFLIGHT_WAIT_PUBCOMP)
+        {
+            entry->State = MQTT_INFLIGHT_RESEND_PUBREL;
+        }
+    }
+}
+
+/**
+ * @brief start everything still in flight over, called when broker did not keep previous session
+ *        publishes are sent again as new messages, without DUP
+ *        qos 2 messages waiting for PUBCOMP were already taken by broker (PUBREC), they are complete
+ */
+static void MQTT_Inflight_Restart_All(void)
+{
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        MQTT_Inflight_t *entry = &hSIM800.Inflight[i];
+
+        if (entry->State == MQTT_INFLIGHT_WAIT_PUBACK ||
+            entry->State == MQTT_INFLIGHT_WAIT_PUBREC ||
+            entry->State == MQTT_INFLIGHT_RESEND)
+        {
+            entry->Header &= ~0x08;
+            entry->Retry = 0;
+            entry->State = MQTT_INFLIGHT_RESEND;
+        }
+        else if (entry->State == MQTT_INFLIGHT_WAIT_PUBCOMP || entry->State == MQTT_INFLIGHT_RESEND_PUBREL)
+        {
+            entry->State = MQTT_INFLIGHT_DONE;
+            APP_SIM800_MQTT_QOS2_Persist_CB(entry->MSG_ID, 0, 0);
+            APP_SIM800_MQTT_PUBCOMP_CB(entry->MSG_ID);
+        }
+    }
+}
+
+/**
+ * @brief check publish against limits broker announced in CONNACK (mqtt 5)
+ * @retval return 0 if broker would close the connection on it
+ */
+static uint8_t MQTT_Publish_Allowed(uint8_t qos, uint8_t retain)
+{
+    return qos <= hSIM800.Server.QOS_Max && (!retain || hSIM800.Server.Retain);
+}
+
+/**
+ * @brief estimate size of a publish packet, topic alias may make it smaller
+ */
+static uint32_t MQTT_Publish_Size(const SIM800_MQTT_Topic_t *topic, const SIM800_IOV_t *iov, uint8_t iov_cnt, uint8_t qos)
+{
+    uint32_t len = 2 + topic->Len + ((qos > 0) ? 2 : 0) + ((hSIM800.Version == 5) ? 1 : 0);
+
+    for (uint8_t i = 0; i < iov_cnt; i++)
+    {
+        len += iov[i].Len;
+    }
+
+    return MQTT_Packet_Size(len);
+}
+
+/**
+ * @brief add tokens for time passed since last refill, up to burst size
+ */
+static void MQTT_Rate_Refill(void)
+{
+    uint32_t now = HAL_GetTick();
+    uint32_t elapsed = now - hSIM800.Rate_Tick;
+    uint64_t byte_max = (uint64_t)hSIM800.Rate.Byte_Burst * 1000;
+    uint64_t msg_max = (uint64_t)hSIM800.Rate.Msg_Burst * 60000;
+
+    hSIM800.Rate_Tick = now;
+
+    hSIM800.Rate_Bytes += (uint64_t)elapsed * hSIM800.Rate.Byte_Rate;
+    if (hSIM800.Rate_Bytes > byte_max)
+    {
+        hSIM800.Rate_Bytes = byte_max;
+    }
+
+    hSIM800.Rate_Msgs += (uint64_t)elapsed * hSIM800.Rate.Msg_Rate;
+    if (hSIM800.Rate_Msgs > msg_max)
+    {
+        hSIM800.Rate_Msgs = msg_max;
+    }
+}
+
+/**
+ * @brief byte tokens a publish takes, a publish bigger than burst size takes a full bucket
+ * @param size packet size, @see MQTT_Publish_Size
+ */
+static uint64_t MQTT_Rate_Bytes(uint32_t size)
+{
+    uint64_t bytes = (uint64_t)size * 1000;
+    uint64_t byte_max = (uint64_t)hSIM800.Rate.Byte_Burst * 1000;
+
+    return (bytes > byte_max) ? byte_max : bytes;
+}
+
+/**
+ * @brief take tokens for one publish from rate buckets and check data plan budget
+ *        a publish bigger than burst size goes once the byte bucket is full and empties it
+ * @param prio level publish is sent from, exempt levels only count against budget
+ * @param size packet size, @see MQTT_Publish_Size
+ * @retval return 1 if publish may be sent now, give tokens back with @see MQTT_Rate_Refund if it is not
+ */
+static uint8_t MQTT_Rate_Take(SIM800_MQTT_Prio_t prio, uint32_t size)
+{
+    if (hSIM800.Rate.Budget != 0 && hSIM800.Usage.TX_Bytes + (uint64_t)size > hSIM800.Rate.Budget)
+    {
+        return 0;
+    }
+
+    if (hSIM800.Rate.Exempt & (1 << prio))
+    {
+        return 1;
+    }
+
+    MQTT_Rate_Refill();
+
+    uint64_t bytes = MQTT_Rate_Bytes(size);
+
+    if (hSIM800.Rate.Byte_Rate != 0 && hSIM800.Rate_Bytes < bytes)
+    {
+        return 0;
+    }
+
+    if (hSIM800.Rate.Msg_Rate != 0 && hSIM800.Rate_Msgs < 60000)
+    {
+        return 0;
+    }
+
+    if (hSIM800.Rate.Byte_Rate != 0)
+    {
+        hSIM800.Rate_Bytes -= bytes;
+    }
+
+    if (hSIM800.Rate.Msg_Rate != 0)
+    {
+        hSIM800.Rate_Msgs -= 60000;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief give back tokens of a publish that could not be queued after all
+ * @param size same size as passed to @see MQTT_Rate_Take
+ */
+static void MQTT_Rate_Refund(SIM800_MQTT_Prio_t prio, uint32_t size)
+{
+    if (hSIM800.Rate.Exempt & (1 << prio))
+    {
+        return;
+    }
+
+    if (hSIM800.Rate.Byte_Rate != 0)
+    {
+        hSIM800.Rate_Bytes += MQTT_Rate_Bytes(size);
+    }
+
+    if (hSIM800.Rate.Msg_Rate != 0)
+    {
+        hSIM800.Rate_Msgs += 60000;
+    }
+
+    MQTT_Rate_Refill(); /** caps buckets again */
+}
+
+/**
+ * @brief report usage to app for saving once enough traffic went by since last report
+ *        called from sim800 timer
+ */
+static void MQTT_Usage_Task(void)
+{
+    uint32_t total = hSIM800.Usage.TX_Bytes + hSIM800.Usage.RX_Bytes;
+
+    if (total - hSIM800.Usage_Saved >= MQTT_USAGE_SAVE_STEP)
+    {
+        hSIM800.Usage_Saved = total;
+        APP_SIM800_MQTT_Usage_CB(&hSIM800.Usage);
+    }
+}
+
+/**
+ * @brief queue a publish, qos 1 and 2 messages are kept in flight until their exchange is complete
+ * @retval return 1 if command can be executed, 0 if not connected
+ * @note rate limit is checked by caller, @see MQTT_Rate_Take
+ */
+static uint8_t MQTT_Publish_Online(const SIM800_MQTT_Topic_t *topic,
+                                   const SIM800_IOV_t *iov,
+                                   uint8_t iov_cnt,
+                                   uint8_t dup,
+                                   uint8_t qos,
+                                   uint8_t retain,
+                                   uint16_t message_id,
+                                   uint32_t copy_max,
+                                   SIM800_MQTT_Release_CB_t release,
+                                   void *ctx)
+{
+    if (!SIM800_Is_MQTT_Connected())
+    {
+        return 0;
+    }
+
+    if (!MQTT_Publish_Allowed(qos, retain))
+    {
+        return 0;
+    }
+
+    uint8_t pub = 0x30 | ((dup & 0x01) << 3) | ((qos & 0x03) << 1) | (retain & 0x01);
+
+    if (qos == 0)
+    {
+        hSIM800.Lock_SM = 1;
+        uint8_t queued = MQTT_Send_Publish(pub, topic, iov, iov_cnt, 0, copy_max, release, ctx);
+        hSIM800.Usage.TX_Messages += queued;
+        hSIM800.Lock_SM = 0;
+
+        return queued;
+    }
+
+    if (iov_cnt > MQTT_INFLIGHT_IOV_MAX)
+    {
+        return 0;
+    }
+
+    hSIM800.Lock_SM = 1;
+
+    MQTT_Inflight_t *entry = MQTT_Inflight_Alloc();
+
+    if (entry == NULL)
+    {
+        /** window is full */
+        hSIM800.Lock_SM = 0;
+        return 0;
+    }
+
+    if (message_id == 0)
+    {
+        message_id = Packet_ID_Alloc(&hSIM800.IDs);
+    }
+    else if (!Packet_ID_Take(&hSIM800.IDs, message_id))
+    {
+        /** already in flight */
+        message_id = 0;
+    }
+
+    if (message_id == 0)
+    {
+        hSIM800.Lock_SM = 0;
+        return 0;
+    }
+
+    entry->Header = pub;
+    entry->Retry = 0;
+    entry->TX_Refs = 0;
+    entry->MSG_ID = message_id;
+    entry->Copy_Max = copy_max;
+    entry->Topic = *topic;
+    memcpy(entry->IOV, iov, iov_cnt * sizeof(SIM800_IOV_t));
+    entry->IOV_Cnt = iov_cnt;
+    entry->Release = release;
+    entry->Ctx = ctx;
+
+    if (!MQTT_Inflight_Send(entry))
+    {
+        entry->State = MQTT_INFLIGHT_FREE;
+        Packet_ID_Release(&hSIM800.IDs, message_id);
+        hSIM800.Lock_SM = 0;
+        return 0;
+    }
+
+    hSIM800.Inflight_Count++;
+    hSIM800.Usage.TX_Messages++;
+    hSIM800.Lock_SM = 0;
+
+    return 1;
+}
+
+/**
+ * @brief erase drained flash log sectors
+ *        cpu is stalled for 1 to 2 s per sector, so it is only done while there is no tcp link
+ *        and nothing but an occasional URC can arrive, rx dma ring would overrun otherwise
+ * @retval return 1 if a sector is erased
+ * @note call from main context only
+ */
+static uint8_t MQTT_Store_Erase(void)
+{
+    uint8_t erased = 0;
+
+    if (hSIM800.State >= SIM800_TCP_CONNECTING)
+    {
+        return 0;
+    }
+
+    while (hSIM800.Store_Tail == hSIM800.Store_Head && SIM800_Flash_Log_Erase_Consumed())
+    {
+        /** last record taken may be gone, start again from oldest */
+        hSIM800.Store_Read.Addr = 0;
+        erased = 1;
+    }
+
+    return erased;
+}
+
+/**
+ * @brief journal a publish made while not connected, it is sent by @see SIM800_MQTT_Store_Task once connected
+ *        record holds publish flags, '\0' terminated topic and message
+ * @retval return 1 if written to flash log
+ */
+static uint8_t MQTT_Store_Publish(const SIM800_MQTT_Topic_t *topic,
+                                  const SIM800_IOV_t *iov,
+                                  uint8_t iov_cnt,
+                                  uint8_t qos,
+                                  uint8_t retain,
+                                  SIM800_MQTT_Release_CB_t release,
+                                  void *ctx)
+{
+    SIM800_IOV_t parts[2 + MQTT_INFLIGHT_IOV_MAX];
+    uint8_t flags = ((qos & 0x03) << 1) | (retain & 0x01);
+
+    if (iov_cnt > MQTT_INFLIGHT_IOV_MAX)
+    {
+        return 0;
+    }
+
+    parts[0].Data = &flags;
+    parts[0].Len = 1;
+    parts[1].Data = topic->Name;
+    parts[1].Len = topic->Len + 1;
+    memcpy(&parts[2], iov, iov_cnt * sizeof(SIM800_IOV_t));
+
+    if (!SIM800_Flash_Log_Append(parts, iov_cnt + 2) &&
+        !(MQTT_Store_Erase() && SIM800_Flash_Log_Append(parts, iov_cnt + 2)))
+    {
+        /** log is full, drained sectors are erased only while there is no tcp link */
+        return 0;
+    }
+
+    if (release != NULL)
+    {
+        /** message is copied to flash */
+        release(ctx);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief publish if connected, otherwise journal message to flash log
+ * @retval return 1 if command can be executed
+ */
+static uint8_t MQTT_Publish(const SIM800_MQTT_Topic_t *topic,
+                            const SIM800_IOV_t *iov,
+                            uint8_t iov_cnt,
+                            uint8_t dup,
+                            uint8_t qos,
+                            uint8_t retain,
+                            uint16_t message_id,
+                            uint32_t copy_max,
+                            SIM800_MQTT_Release_CB_t release,
+                            void *ctx)
+{
+    if (!SIM800_Is_MQTT_Connected())
+    {
+        return MQTT_Store_Publish(topic, iov, iov_cnt, qos, retain, release, ctx);
+    }
+
+    uint32_t size = MQTT_Publish_Size(topic, iov, iov_cnt, qos);
+
+    hSIM800.Lock_SM = 1;
+    uint8_t allowed = MQTT_Rate_Take(SIM800_PRIO_NORMAL, size);
+    hSIM800.Lock_SM = 0;
+
+    if (!allowed)
+    {
+        /** there is no queue to wait in, app may retry later or use @see SIM800_MQTT_Publish_Queued */
+        hSIM800.Stats.Rate_Dropped++;
+        return 0;
+    }
+
+    if (!MQTT_Publish_Online(topic, iov, iov_cnt, dup, qos, retain, message_id, copy_max, release, ctx))
+    {
+        hSIM800.Lock_SM = 1;
+        MQTT_Rate_Refund(SIM800_PRIO_NORMAL, size);
+        hSIM800.Lock_SM = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief publish message to a topic
+ *        qos 1 and 2 messages are retransmitted until acked, result callback is @see APP_SIM800_MQTT_PUBACK_CB
+ *        (qos 1), @see APP_SIM800_MQTT_PUBCOMP_CB (qos 2) or @see APP_SIM800_MQTT_PUB_Failed_CB
+ * @param topic topic to which message will be published
+ * @param message message to published
+ * @param message_len message length
+ * @param message_id 0 to let sim800 pick a free id for qos 1 and 2, it is passed to result callback
+ *        an id chosen by app must not be in flight
+ * @retval return 1 if command can be executed, 0 also if in-flight window is full
+ * @note for qos 1 and 2 topic and message must stay valid and unchanged until result callback is called
+ * @note while not connected message is written to flash log and sent after reconnect, @see SIM800_MQTT_Store_Task
+ *       call from main context only in that case
+ */
+uint8_t SIM800_MQTT_Publish(char *topic,
+                            char *message,
+                            uint32_t message_len,
+                            uint8_t dup,
+                            uint8_t qos,
+                            uint8_t retain,
+                            uint16_t message_id)
+{
+    SIM800_IOV_t iov = {message, message_len};
+    SIM800_MQTT_Topic_t handle;
+
+    if (!SIM800_MQTT_Topic_Init(&handle, topic))
+    {
+        return 0;
+    }
+    handle.Persistent = 0;
+
+    /** message is copied to tx buffer, whole frame is sent by one tx dma transfer */
+    return MQTT_Publish(&handle, &iov, 1, dup, qos, retain, message_id, UINT32_MAX, NULL, NULL);
+}
+
+/**
+ * @brief publish message made of several fragments, large fragments are sent by dma without copy
+ * @param topic topic to which message will be published
+ * @param iov message fragments, sent in order, up to MQTT_INFLIGHT_IOV_MAX for qos 1 and 2
+ * @param iov_cnt number of fragments
+ * @param release called when fragment buffers can be reused, can be NULL
+ *        for qos 0 called from uart interrupt, or before return if all fragments were copied
+ *        for qos 1 and 2 called from sim800 timer once message is acked (PUBACK or PUBREC) or dropped
+ * @param ctx passed to release
+ * @retval return 1 if command can be executed, release is only called in this case
+ * @note fragment buffers (and topic for qos 1 and 2) must stay valid and unchanged until release is called
+ */
+uint8_t SIM800_MQTT_Publish_IOV(char *topic,
+                                const SIM800_IOV_t *iov,
+                                uint8_t iov_cnt,
+                                uint8_t dup,
+                                uint8_t qos,
+                                uint8_t retain,
+                                uint16_t message_id,
+                                SIM800_MQTT_Release_CB_t release,
+                                void *ctx)
+{
+    SIM800_MQTT_Topic_t handle;
+
+    if (!SIM800_MQTT_Topic_Init(&handle, topic))
+    {
+        return 0;
+    }
+    handle.Persistent = 0;
+
+    return MQTT_Publish(&handle, iov, iov_cnt, dup, qos, retain, message_id, MQTT_IOV_COPY_MAX, release, ctx);
+}
+
+/**
+ * @brief validate a topic name and encode its length prefix once, so it is not done on each publish
+ * @param topic handle to init, can be kept for the life of the app
+ * @param name topic name, must stay valid and unchanged while handle is used
+ * @retval return 1 if name is a valid topic name (not empty, no wildcards, up to 65535 chars)
+ */
+uint8_t SIM800_MQTT_Topic_Init(SIM800_MQTT_Topic_t *topic, const char *name)
+{
+    size_t len = strnlen(name, UINT16_MAX + 1);
+
+    if (len == 0 || len > UINT16_MAX || strpbrk(name, "+#") != NULL)
+    {
+        return 0;
+    }
+
+    topic->Name = name;
+    topic->Len = len;
+    topic->Prefix[0] = len >> 8;
+    topic->Prefix[1] = len & 0xFF;
+    topic->Persistent = 1;
+
+    return 1;
+}
+
+/**
+ * @brief publish message to a topic handle, same as @see SIM800_MQTT_Publish_IOV
+ *        but topic is not measured and encoded again
+ * @param topic handle set by @see SIM800_MQTT_Topic_Init
+ * @retval return 1 if command can be executed, release is only called in this case
+ */
+uint8_t SIM800_MQTT_Publish_Topic(const SIM800_MQTT_Topic_t *topic,
+                                  const SIM800_IOV_t *iov,
+                                  uint8_t iov_cnt,
+                                  uint8_t dup,
+                                  uint8_t qos,
+                                  uint8_t retain,
+                                  uint16_t message_id,
+                                  SIM800_MQTT_Release_CB_t release,
+                                  void *ctx)
+{
+    return MQTT_Publish(topic, iov, iov_cnt, dup, qos, retain, message_id, MQTT_IOV_COPY_MAX, release, ctx);
+}
+
+/**
+ * @brief cbor writer, appends to packet in assembly
+ */
+static void MQTT_CBOR_Write(void *ctx, const void *data, uint32_t len)
+{
+    SIM800_UART_Packet_Put(data, len);
+}
+
+/**
+ * @brief encode cbor payload into a bounded buffer and journal it like @see MQTT_Store_Publish
+ * @retval return 1 if written to flash log, 0 if payload is over MQTT_CBOR_STORE_MAX or log is full
+ */
+static uint8_t MQTT_Store_Publish_CBOR(const SIM800_MQTT_Topic_t *topic,
+                                       uint8_t retain,
+                                       SIM800_MQTT_Encode_CB_t encode,
+                                       void *ctx)
+{
+    uint8_t buffer[MQTT_CBOR_STORE_MAX];
+    CBOR_t cbor;
+
+    CBOR_Init(&cbor, buffer, sizeof(buffer));
+    encode(&cbor, ctx);
+
+    if (!CBOR_Is_Complete(&cbor))
+    {
+        return 0;
+    }
+
+    SIM800_IOV_t iov = {buffer, cbor.Len};
+
+    return MQTT_Store_Publish(topic, &iov, 1, 0, retain, NULL, NULL);
+}
+
+/**
+ * @brief publish qos 0 message encoded straight into uart tx buffer, without printf or payload buffer
+ *        encode is called once to size payload, then again to write it
+ * @param topic handle set by @see SIM800_MQTT_Topic_Init
+ * @param encode writes payload with CBOR_Put_ and CBOR_Begin_ functions
+ * @param ctx passed to encode
+ * @retval return 1 if queued or journaled, 0 if tx buffer or flash log is full,
+ *         or if encode wrote a different length the second time (counted in Encode_Errors)
+ * @note for qos 1 and 2, encode into a buffer with @see CBOR_Init and publish it, so it can be sent again
+ * @note while not connected payload is encoded into a buffer of MQTT_CBOR_STORE_MAX chars on stack
+ *       and written to flash log, @see SIM800_MQTT_Store_Task, call from main context only in that case
+ */
+uint8_t SIM800_MQTT_Publish_CBOR(const SIM800_MQTT_Topic_t *topic,
+                                 uint8_t retain,
+                                 SIM800_MQTT_Encode_CB_t encode,
+                                 void *ctx)
+{
+    CBOR_t cbor;
+
+    if (!SIM800_Is_MQTT_Connected())
+    {
+        return MQTT_Store_Publish_CBOR(topic, retain, encode, ctx);
+    }
+
+    CBOR_Init(&cbor, NULL, 0);
+    encode(&cbor, ctx);
+
+    uint32_t payload_len = cbor.Len;
+
+    if (retain && !hSIM800.Server.Retain)
+    {
+        return 0;
+    }
+
+    SIM800_IOV_t iov = {NULL, payload_len};
+    uint32_t size = MQTT_Publish_Size(topic, &iov, 1, 0);
+
+    hSIM800.Lock_SM = 1;
+
+    if (!MQTT_Rate_Take(SIM800_PRIO_NORMAL, size))
+    {
+        hSIM800.Stats.Rate_Dropped++;
+        hSIM800.Lock_SM = 0;
+        return 0;
+    }
+
+    MQTT_Alias_Use_t use;
+    uint32_t header_len = MQTT_Alias_Select(topic, 0, &use);
+
+    if (!MQTT_Packet_Begin(0x30 | (retain & 0x01), header_len + payload_len))
+    {
+        MQTT_Rate_Refund(SIM800_PRIO_NORMAL, size);
+        hSIM800.Lock_SM = 0;
+        return 0;
+    }
+
+    hSIM800.UART_TX_Busy = 1; /** cleared when tx buffer is drained */
+
+    MQTT_Put_Publish_Topic(topic, &use);
+    MQTT_Put_Publish_Properties(&use);
+
+    CBOR_Init_Writer(&cbor, MQTT_CBOR_Write, NULL, payload_len);
+    encode(&cbor, ctx);
+
+    if (cbor.Len != payload_len)
+    {
+        /** encode did not repeat itself, packet length no more fits payload, nothing was sent yet */
+        SIM800_UART_Packet_Abort();
+
+        if (use.Alias && use.Send_Name)
+        {
+            /** binding never reached broker */
+            hSIM800.Alias[use.Alias - 1].Name = NULL;
+        }
+
+        hSIM800.Usage.TX_Bytes -= MQTT_Packet_Size(header_len + payload_len);
+        MQTT_Rate_Refund(SIM800_PRIO_NORMAL, size);
+        hSIM800.Stats.Encode_Errors++;
+        hSIM800.Lock_SM = 0;
+        return 0;
+    }
+
+    SIM800_UART_Packet_End();
+
+    hSIM800.Usage.TX_Messages++;
+    hSIM800.Lock_SM = 0;
+
+    return 1;
+}
+
+/**
+ * @brief find queued message on same topic handle that may be replaced
+ * @retval return NULL if there is none
+ */
+static MQTT_Queued_t *MQTT_Queue_Find_Conflated(MQTT_Queue_t *queue, const SIM800_MQTT_Topic_t *topic)
+{
+    for (uint8_t i = queue->Tail; i != queue->Head; i++)
+    {
+        MQTT_Queued_t *entry = &queue->Entry[i & (MQTT_QUEUE_MAX - 1)];
+
+        if (entry->Conflate && entry->Topic.Name == topic->Name && entry->Topic.Len == topic->Len)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief put publish in queue of its level, or over the queued one on same topic if conflating
+ * @retval return 1 if queued
+ */
+static uint8_t MQTT_Queue_Put(SIM800_MQTT_Prio_t prio,
+                              const SIM800_MQTT_Topic_t *topic,
+                              const SIM800_IOV_t *iov,
+                              uint8_t iov_cnt,
+                              uint8_t qos,
+                              uint8_t retain,
+                              uint8_t conflate,
+                              SIM800_MQTT_Release_CB_t release,
+                              void *ctx)
+{
+    MQTT_Queued_t dropped = {0};
+    MQTT_Queued_t *entry = NULL;
+
+    if (prio >= SIM800_PRIO_COUNT || iov_cnt > MQTT_INFLIGHT_IOV_MAX || qos > 2)
+    {
+        return 0;
+    }
+
+    MQTT_Queue_t *queue = &hSIM800.Queue[prio];
+
+    hSIM800.Lock_SM = 1;
+
+    if (conflate)
+    {
+        entry = MQTT_Queue_Find_Conflated(queue, topic);
+    }
+
+    if (entry != NULL)
+    {
+        /** stale value is not sent, newer one takes its place in line */
+        dropped = *entry;
+        hSIM800.Stats.Queue_Conflated++;
+    }
+    else
+    {
+        if ((uint8_t)(queue->Head - queue->Tail) >= queue->Depth)
+        {
+            hSIM800.Stats.Queue_Dropped++;
+
+            if (queue->Drop == SIM800_DROP_NEWEST)
+            {
+                hSIM800.Lock_SM = 0;
+                return 0;
+            }
+
+            /** make room, oldest message is released after unlock */
+            dropped = queue->Entry[queue->Tail & (MQTT_QUEUE_MAX - 1)];
+            queue->Tail++;
+        }
+
+        entry = &queue->Entry[queue->Head & (MQTT_QUEUE_MAX - 1)];
+        queue->Head++;
+    }
+
+    entry->Topic = *topic;
+    memcpy(entry->IOV, iov, iov_cnt * sizeof(SIM800_IOV_t));
+    entry->IOV_Cnt = iov_cnt;
+    entry->QOS = qos;
+    entry->Retain = retain;
+    entry->Conflate = conflate;
+    entry->Deferred = 0;
+    entry->Release = release;
+    entry->Ctx = ctx;
+
+    hSIM800.Lock_SM = 0;
+
+    if (dropped.Release != NULL)
+    {
+        dropped.Release(dropped.Ctx);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief queue a publish by priority, it is sent by sim800 timer once higher priority traffic is out
+ *        critical messages always go first, normal and bulk share the link by weight
+ *        a message is handed to uart only when little is waiting for tx dma, so critical latency
+ *        is one packet on the wire plus a timer tick, not the whole backlog
+ * @param prio queue level
+ * @param topic handle set by @see SIM800_MQTT_Topic_Init, copied
+ * @param iov message fragments, up to MQTT_INFLIGHT_IOV_MAX, copied
+ * @param qos 0, 1, 2, packet id is picked by sim800 and passed to result callback
+ * @param release called when fragment buffers can be reused, can be NULL
+ *        when dropped from queue, called from main context to make room, or from sim800 timer if broker limits
+ *        refuse it, else as for @see SIM800_MQTT_Publish_IOV
+ * @retval return 1 if queued, 0 if queue is full and drops newest, or arguments are invalid
+ * @note queued messages wait while not connected, call from main context only
+ */
+uint8_t SIM800_MQTT_Publish_Queued(SIM800_MQTT_Prio_t prio,
+                                   const SIM800_MQTT_Topic_t *topic,
+                                   const SIM800_IOV_t *iov,
+                                   uint8_t iov_cnt,
+                                   uint8_t qos,
+                                   uint8_t retain,
+                                   SIM800_MQTT_Release_CB_t release,
+                                   void *ctx)
+{
+    return MQTT_Queue_Put(prio, topic, iov, iov_cnt, qos, retain, 0, release, ctx);
+}
+
+/**
+ * @brief queue a publish where only the latest value on a topic matters, e.g. a gauge
+ *        same as @see SIM800_MQTT_Publish_Queued, but a message on the same topic handle still in queue
+ *        is replaced in place and released unsent, so under congestion uplink is bounded by
+ *        number of topics rather than sample rate
+ * @param topic handle set by @see SIM800_MQTT_Topic_Init, messages match by handle name, not by content
+ * @retval return 1 if queued or replaced
+ * @note a message already handed to uart is not replaced, the new one is queued after it
+ */
+uint8_t SIM800_MQTT_Publish_Latest(SIM800_MQTT_Prio_t prio,
+                                   const SIM800_MQTT_Topic_t *topic,
+                                   const SIM800_IOV_t *iov,
+                                   uint8_t iov_cnt,
+                                   uint8_t qos,
+                                   uint8_t retain,
+                                   SIM800_MQTT_Release_CB_t release,
+                                   void *ctx)
+{
+    return MQTT_Queue_Put(prio, topic, iov, iov_cnt, qos, retain, 1, release, ctx);
+}
+
+/**
+ * @brief set depth, drop policy and weight of a publish queue
+ * @param depth 1 to MQTT_QUEUE_MAX, messages already queued above it are kept
+ * @param weight messages sent per round against the other non critical level, at least 1, not used for critical
+ * @retval return 1 if arguments are valid
+ */
+uint8_t SIM800_MQTT_Set_Queue(SIM800_MQTT_Prio_t prio, uint8_t depth, SIM800_MQTT_Drop_t drop, uint8_t weight)
+{
+    if (prio >= SIM800_PRIO_COUNT || depth == 0 || depth > MQTT_QUEUE_MAX || weight == 0)
+    {
+        return 0;
+    }
+
+    hSIM800.Lock_SM = 1;
+
+    hSIM800.Queue[prio].Depth = depth;
+    hSIM800.Queue[prio].Drop = drop;
+    hSIM800.Queue[prio].Weight = weight;
+    hSIM800.Queue[prio].Credit = weight;
+
+    hSIM800.Lock_SM = 0;
+
+    return 1;
+}
+
+/**
+ * @brief get number of messages waiting in a publish queue
+ */
+uint8_t SIM800_MQTT_Get_Queue_Count(SIM800_MQTT_Prio_t prio)
+{
+    if (prio >= SIM800_PRIO_COUNT)
+    {
+        return 0;
+    }
+
+    return hSIM800.Queue[prio].Head - hSIM800.Queue[prio].Tail;
+}
+
+/**
+ * @brief pick queue to send from, critical first, then weighted round robin over the rest
+ * @param skip bit for each level that can not send now
+ * @retval return NULL if no level has a message to send
+ */
+static MQTT_Queue_t *MQTT_Queue_Pick(uint8_t skip)
+{
+    for (uint8_t round = 0; round < 2; round++)
+    {
+        for (uint8_t prio = 0; prio < SIM800_PRIO_COUNT; prio++)
+        {
+            MQTT_Queue_t *queue = &hSIM800.Queue[prio];
+
+            if (queue->Head != queue->Tail && !(skip & (1 << prio)) &&
+                (prio == SIM800_PRIO_CRITICAL || queue->Credit > 0))
+            {
+                return queue;
+            }
+        }
+
+        /** levels with traffic used up their credit, start next round */
+        for (uint8_t prio = 0; prio < SIM800_PRIO_COUNT; prio++)
+        {
+            hSIM800.Queue[prio].Credit = hSIM800.Queue[prio].Weight;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief hand queued publishes to uart by priority, one at a time as tx dma drains
+ *        called from sim800 timer while connected to broker
+ */
+static void MQTT_Queue_Task(void)
+{
+    uint8_t skip = 0;
+
+    while (SIM800_UART_Get_TX_Pending() < MQTT_QUEUE_AHEAD)
+    {
+        MQTT_Queue_t *queue = MQTT_Queue_Pick(skip);
+
+        if (queue == NULL)
+        {
+            break;
+        }
+
+        MQTT_Queued_t *entry = &queue->Entry[queue->Tail & (MQTT_QUEUE_MAX - 1)];
+
+        if (!MQTT_Publish_Allowed(entry->QOS, entry->Retain))
+        {
+            /** never accepted on this connection, do not hold up the queue */
+            queue->Tail++;
+            hSIM800.Stats.Queue_Dropped++;
+            if (entry->Release != NULL)
+            {
+                entry->Release(entry->Ctx);
+            }
+            continue;
+        }
+
+        SIM800_MQTT_Prio_t prio = queue - hSIM800.Queue;
+        uint32_t size = MQTT_Publish_Size(&entry->Topic, entry->IOV, entry->IOV_Cnt, entry->QOS);
+
+        if (!MQTT_Rate_Take(prio, size))
+        {
+            /** message waits in queue for tokens, exempt levels may still send */
+            if (!entry->Deferred)
+            {
+                entry->Deferred = 1;
+                hSIM800.Stats.Rate_Deferred++;
+            }
+            skip |= 1 << prio;
+            continue;
+        }
+
+        if (!MQTT_Publish_Online(&entry->Topic,
+                                 entry->IOV,
+                                 entry->IOV_Cnt,
+                                 0,
+                                 entry->QOS,
+                                 entry->Retain,
+                                 0,
+                                 MQTT_IOV_COPY_MAX,
+                                 entry->Release,
+                                 entry->Ctx))
+        {
+            /** in-flight window or tx buffer is full, other levels may still send */
+            MQTT_Rate_Refund(prio, size);
+            skip |= 1 << prio;
+            continue;
+        }
+
+        queue->Tail++;
+        if (queue->Credit > 0)
+        {
+            queue->Credit--;
+        }
+    }
+}
+
+/**
+ * @brief set max number of qos 1 and 2 messages in flight at a time
+ * @param window 1 to MQTT_INFLIGHT_MAX
+ * @retval return 1 if window is valid
+ */
+uint8_t SIM800_MQTT_Set_Inflight_Window(uint8_t window)
+{
+    if (window == 0 || window > MQTT_INFLIGHT_MAX)
+    {
+        return 0;
+    }
+
+    hSIM800.Inflight_Window = window;
+
+    return 1;
+}
+
+/**
+ * @brief return number of qos 1 and 2 messages in flight
+ */
+uint8_t SIM800_MQTT_Get_Inflight_Count(void)
+{
+    return hSIM800.Inflight_Count;
+}
+
+/**
+ * @brief deliver large messages in parts instead of whole, so their size is not limited by rx buffers
+ *        streamed messages go to @see APP_SIM800_MQTT_Stream_Begin_CB, @see APP_SIM800_MQTT_Stream_Data_CB
+ *        and @see APP_SIM800_MQTT_Stream_End_CB instead of @see APP_SIM800_MQTT_PUBLISH_CB
+ * @param len messages with more chars after fixed header (topic, id and payload) are streamed
+ *        0 to stream all messages, UINT32_MAX to stream none
+ */
+void SIM800_MQTT_Set_Stream_Threshold(uint32_t len)
+{
+    hSIM800.Lock_SM = 1;
+
+    MQTT_Parser_Set_Stream(&hSIM800.Parser,
+                           len,
+                           MQTT_Stream_Begin_Handler,
+                           MQTT_Stream_Data_Handler,
+                           MQTT_Stream_End_Handler);
+
+    hSIM800.Lock_SM = 0;
+}
+
+/**
+ * @brief get inbound traffic counters, counters are never reset
+ * @param stats destination
+ */
+void SIM800_MQTT_Get_Stats(SIM800_MQTT_Stats_t *stats)
+{
+    *stats = hSIM800.Stats;
+    stats->RX_Errors = hSIM800.Parser.Error_Count;
+    stats->RX_Overrun = SIM800_UART_Get_RX_Overrun_Count();
+}
+
+/**
+ * @brief set uplink rate limits and data plan budget, buckets start full
+ *        direct and journaled publishes count as normal level, over the limit direct ones are refused
+ *        and queued or journaled ones wait, @see SIM800_MQTT_Stats_t
+ * @param rate limits, all 0 to turn limiting off
+ * @note with a rate set, a smaller burst is raised to one message and to @see MQTT_RATE_BYTE_BURST_MIN bytes
+ */
+void SIM800_MQTT_Set_Rate(const SIM800_MQTT_Rate_t *rate)
+{
+    hSIM800.Lock_SM = 1;
+
+    hSIM800.Rate = *rate;
+
+    /** a 0 burst would refuse every message or let every byte through */
+    if (hSIM800.Rate.Byte_Rate != 0 && hSIM800.Rate.Byte_Burst < MQTT_RATE_BYTE_BURST_MIN)
+    {
+        hSIM800.Rate.Byte_Burst = MQTT_RATE_BYTE_BURST_MIN;
+    }
+
+    if (hSIM800.Rate.Msg_Rate != 0 && hSIM800.Rate.Msg_Burst == 0)
+    {
+        hSIM800.Rate.Msg_Burst = 1;
+    }
+
+    hSIM800.Rate_Bytes = (uint64_t)hSIM800.Rate.Byte_Burst * 1000;
+    hSIM800.Rate_Msgs = (uint64_t)hSIM800.Rate.Msg_Burst * 60000;
+    hSIM800.Rate_Tick = HAL_GetTick();
+
+    hSIM800.Lock_SM = 0;
+}
+
+/**
+ * @brief set data plan usage, call at startup with usage saved by @see APP_SIM800_MQTT_Usage_CB,
+ *        or with zeros when a new billing period starts
+ */
+void SIM800_MQTT_Set_Usage(const SIM800_MQTT_Usage_t *usage)
+{
+    hSIM800.Lock_SM = 1;
+
+    hSIM800.Usage = *usage;
+    hSIM800.Usage_Saved = usage->TX_Bytes + usage->RX_Bytes;
+
+    hSIM800.Lock_SM = 0;
+}
+
+/**
+ * @brief get data plan usage, counted across sessions from last @see SIM800_MQTT_Set_Usage
+ * @param usage destination
+ */
+void SIM800_MQTT_Get_Usage(SIM800_MQTT_Usage_t *usage)
+{
+    hSIM800.Lock_SM = 1;
+
+    *usage = hSIM800.Usage;
+
+    hSIM800.Lock_SM = 0;
+}
+
+/**
+ * @brief restore qos 2 exchange saved by @see APP_SIM800_MQTT_QOS2_Persist_CB, call before connecting
+ *        outbound message continues with PUBREL, inbound message id is not delivered again
+ * @param message_id id of message
+ * @param inbound 1 for message received from broker, 0 for message published by app
+ * @retval return 1 if restored
+ */
+uint8_t SIM800_MQTT_QOS2_Restore(uint16_t message_id, uint8_t inbound)
+{
+    if (message_id == 0 || SIM800_Is_MQTT_Connected())
+    {
+        return 0;
+    }
+
+    uint8_t restored = 0;
+
+    hSIM800.Lock_SM = 1;
+
+    if (inbound)
+    {
+        restored = (MQTT_QOS2_RX_Find(message_id) >= 0) || MQTT_QOS2_RX_Add(message_id);
+    }
+    else
+    {
+        MQTT_Inflight_t *entry = MQTT_Inflight_Alloc();
+
+        if (entry != NULL && Packet_ID_Take(&hSIM800.IDs, message_id))
+        {
+            memset(entry, 0, sizeof(MQTT_Inflight_t));
+            entry->Header = 0x34; /** qos 2 publish, only id is needed from now on */
+            entry->MSG_ID = message_id;
+            entry->State = MQTT_INFLIGHT_RESEND_PUBREL;
+            hSIM800.Inflight_Count++;
+            restored = 1;
+        }
+    }
+
+    hSIM800.Lock_SM = 0;
+
+    return restored;
+}
+
+/**
+ * @brief check filter fits MQTT_FILTER_LEN_MAX, longer ones are refused rather than cut,
+ *        a cut filter would subscribe to something else
+ */
+static uint8_t MQTT_Filter_Len_Valid(const char *filter)
+{
+    return filter != NULL && strnlen(filter, MQTT_FILTER_LEN_MAX + 1) <= MQTT_FILTER_LEN_MAX;
+}
+
+/**
+ * @brief queue SUBSCRIBE or UNSUBSCRIBE packet for several topic filters
+ * @param header 0x82 for SUBSCRIBE, 0xA2 for UNSUBSCRIBE
+ * @param qos requested qos of each filter, NULL for UNSUBSCRIBE
+ * @retval return 1 if queued
+ */
+static uint8_t MQTT_Send_Subscribe(uint8_t header, const char *const *filters, const uint8_t *qos, uint8_t count, uint16_t packet_id)
+{
+    uint32_t packet_len = 2;
+
+    if (hSIM800.Version >= 5)
+    {
+        /** empty property length */
+        packet_len += 1;
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        packet_len += 2 + strnlen(filters[i], MQTT_FILTER_LEN_MAX) + (qos != NULL ? 1 : 0);
+    }
+
+    if (!MQTT_Packet_Begin(header, packet_len))
+    {
+        return 0;
+    }
+
+    hSIM800.UART_TX_Busy = 1; /** cleared when tx buffer is drained */
+
+    MQTT_Put_U16(packet_id);
+
+    if (hSIM800.Version >= 5)
+    {
+        SIM800_UART_Packet_Put_Char(0);
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        MQTT_Put_String(filters[i], strnlen(filters[i], MQTT_FILTER_LEN_MAX));
+
+        if (qos != NULL)
+        {
+            SIM800_UART_Packet_Put_Char(qos[i]);
+        }
+    }
+
+    SIM800_UART_Packet_End();
+
+    return 1;
+}
+
+/**
+ * @brief find SUBSCRIBE or UNSUBSCRIBE waiting for ack
+ * @param packet_id 0 to find a free entry
+ * @retval return index of entry, -1 if not found
+ */
+static int MQTT_Request_Find(uint16_t packet_id)
+{
+    for (uint8_t i = 0; i < MQTT_REQUEST_MAX; i++)
+    {
+        if (hSIM800.Request[i].Packet_ID == packet_id)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief keep track of a sent SUBSCRIBE or UNSUBSCRIBE until it is acked, its packet id is taken by caller
+ *        a free entry must have been checked for before sending
+ */
+static void MQTT_Request_Add(uint8_t header, uint16_t packet_id, uint8_t app)
+{
+    int index = MQTT_Request_Find(0);
+
+    if (index >= 0)
+    {
+        hSIM800.Request[index].Packet_ID = packet_id;
+        hSIM800.Request[index].Header = header;
+        hSIM800.Request[index].App = app;
+        hSIM800.Request[index].Tick = HAL_GetTick();
+    }
+}
+
+/**
+ * @brief drop requests not acked in time, registered filters are sent again by @see MQTT_Sub_Task
+ * @param all 1 to drop all, acks of previous connection never come
+ */
+static void MQTT_Request_Expire(uint8_t all)
+{
+    uint32_t tick_now = HAL_GetTick();
+
+    for (uint8_t i = 0; i < MQTT_REQUEST_MAX; i++)
+    {
+        MQTT_Request_t *request = &hSIM800.Request[i];
+
+        if (request->Packet_ID != 0 && (all || tick_now - request->Tick >= MQTT_RETRY_TIMEOUT))
+        {
+            if (request->App)
+            {
+                APP_SIM800_MQTT_SUB_Failed_CB(request->Packet_ID);
+            }
+            Packet_ID_Release(&hSIM800.IDs, request->Packet_ID);
+            request->Packet_ID = 0;
+        }
+    }
+}
+
+/**
+ * @brief send SUBSCRIBE or UNSUBSCRIBE for app
+ * @param packet_id 0 to allocate one, else an id not in use
+ * @retval return packet id used if queued, else 0
+ */
+static uint16_t MQTT_Request_Send(uint8_t header, const char *const *filters, const uint8_t *qos, uint8_t count, uint16_t packet_id)
+{
+    uint16_t queued = 0;
+
+    if (!SIM800_Is_MQTT_Connected() || count == 0)
+    {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (!MQTT_Filter_Len_Valid(filters[i]))
+        {
+            return 0;
+        }
+    }
+
+    hSIM800.Lock_SM = 1;
+
+    if (MQTT_Request_Find(0) >= 0)
+    {
+        /** id is reserved under lock, so timer can not hand it out in between */
+        if (packet_id == 0)
+        {
+            packet_id = Packet_ID_Alloc(&hSIM800.IDs);
+        }
+        else if (!Packet_ID_Take(&hSIM800.IDs, packet_id))
+        {
+            packet_id = 0;
+        }
+
+        if (packet_id != 0)
+        {
+            if (MQTT_Send_Subscribe(header, filters, qos, count, packet_id))
+            {
+                MQTT_Request_Add(header, packet_id, 1);
+                queued = packet_id;
+            }
+            else
+            {
+                Packet_ID_Release(&hSIM800.IDs, packet_id);
+            }
+        }
+    }
+
+    hSIM800.Lock_SM = 0;
+
+    return queued;
+}
+
+/**
+ * @brief subscribe to a topic
+ * @param topic topic to be subscribe to
+ * @param packet_id 0 to let library allocate one,
+ *        else not in use by a publish in flight or a request waiting for ack
+ * @param qos 0, 1, 2
+ * @retval return packet id of SUBSCRIBE if command can be executed, else 0
+ * @note not resent after reconnect, use @see SIM800_MQTT_Register for that
+ */
+uint16_t SIM800_MQTT_Subscribe(char *topic, uint16_t packet_id, uint8_t qos)
+{
+    const char *filters[1] = {topic};
+
+    return MQTT_Request_Send(0x82, filters, &qos, 1, packet_id);
+}
+
+/**
+ * @brief subscribe to several topic filters with one SUBSCRIBE packet
+ *        result is @see APP_SIM800_MQTT_SUBACK_CB with a code for each filter, or @see APP_SIM800_MQTT_SUB_Failed_CB
+ * @param filters topic filters, only needed until return
+ * @param qos requested qos of each filter
+ * @param count number of filters
+ * @param packet_id 0 to let library allocate one,
+ *        else not in use by a publish in flight or a request waiting for ack
+ * @retval return packet id of SUBSCRIBE if command can be executed, 0 also if MQTT_REQUEST_MAX requests wait for ack
+ * @note not resent after reconnect, use @see SIM800_MQTT_Register for that
+ */
+uint16_t SIM800_MQTT_Subscribe_Multi(const char *const *filters, const uint8_t *qos, uint8_t count, uint16_t packet_id)
+{
+    return MQTT_Request_Send(0x82, filters, qos, count, packet_id);
+}
+
+/**
+ * @brief unsubscribe from several topic filters with one UNSUBSCRIBE packet
+ *        result is @see APP_SIM800_MQTT_UNSUBACK_CB or @see APP_SIM800_MQTT_SUB_Failed_CB
+ * @param filters topic filters as they were subscribed, only needed until return
+ * @param count number of filters
+ * @param packet_id 0 to let library allocate one,
+ *        else not in use by a publish in flight or a request waiting for ack
+ * @retval return packet id of UNSUBSCRIBE if command can be executed, else 0
+ */
+uint16_t SIM800_MQTT_Unsubscribe(const char *const *filters, uint8_t count, uint16_t packet_id)
+{
+    return MQTT_Request_Send(0xA2, filters, NULL, count, packet_id);
+}
+
+/**
+ * @brief register handler for messages on topics matching a filter
+ *        SUBSCRIBE is sent by sim800 timer once connected, and again after each reconnect
+ * @param filter topic filter, may contain '+' and '#', must stay valid
+ * @param qos max qos of messages on this filter
+ * @param handler called from sim800 timer for each matching message
+ * @retval return 1 if registered, 0 if filter is invalid, longer than MQTT_FILTER_LEN_MAX,
+ *         has more than TOPIC_DEPTH_MAX levels, is already registered or table is full
+ * @note messages matching no registered filter go to @see APP_SIM800_MQTT_PUBLISH_CB
+ */
+uint8_t SIM800_MQTT_Register(const char *filter, uint8_t qos, SIM800_MQTT_Handler_t handler)
+{
+    uint8_t registered = 0;
+
+    if (handler == NULL || qos > 2 || !MQTT_Filter_Len_Valid(filter))
+    {
+        return 0;
+    }
+
+    hSIM800.Lock_SM = 1;
+
+    for (uint8_t i = 0; i < MQTT_SUB_MAX; i++)
+    {
+        MQTT_Sub_t *sub = &hSIM800.Sub[i];
+
+        if (sub->State == MQTT_SUB_FREE)
+        {
+            if (Topic_Trie_Insert(&hSIM800.Sub_Trie, filter, i))
+            {
+                sub->Filter = filter;
+                sub->QOS = qos;
+                sub->Handler = handler;
+                sub->State = MQTT_SUB_PENDING;
+                registered = 1;
+            }
+            break;
+        }
+    }
+
+    hSIM800.Lock_SM = 0;
+
+    return registered;
+}
+
+/**
+ * @brief remove handler registered with @see SIM800_MQTT_Register
+ *        UNSUBSCRIBE is sent right away if filter was subscribed and connected, its UNSUBACK is not reported
+ * @param filter same filter as registered, compared by content
+ * @retval return 1 if filter was registered
+ * @note if UNSUBSCRIBE can not be sent, broker keeps the subscription until session ends,
+ *       matching messages then go to @see APP_SIM800_MQTT_PUBLISH_CB
+ */
+uint8_t SIM800_MQTT_Unregister(const char *filter)
+{
+    uint8_t removed = 0;
+
+    hSIM800.Lock_SM = 1;
+
+    for (uint8_t i = 0; i < MQTT_SUB_MAX; i++)
+    {
+        MQTT_Sub_t *sub = &hSIM800.Sub[i];
+
+        if (sub->State == MQTT_SUB_FREE || strcmp(sub->Filter, filter) != 0)
+        {
+            continue;
+        }
+
+        uint8_t subscribed = (sub->State == MQTT_SUB_SENT || sub->State == MQTT_SUB_ACKED);
+
+        if (!Topic_Trie_Remove(&hSIM800.Sub_Trie, sub->Filter))
+        {
+            /** slot is kept, a reused slot must not inherit the trie entry */
+            break;
+        }
+
+        sub->State = MQTT_SUB_FREE;
+        removed = 1;
+
+        if (subscribed && SIM800_Is_MQTT_Connected() && MQTT_Request_Find(0) >= 0)
+        {
+            uint16_t packet_id = Packet_ID_Alloc(&hSIM800.IDs);
+
+            if (packet_id != 0)
+            {
+                if (MQTT_Send_Subscribe(0xA2, &sub->Filter, NULL, 1, packet_id))
+                {
+                    MQTT_Request_Add(0xA2, packet_id, 0);
+                }
+                else
+                {
+                    Packet_ID_Release(&hSIM800.IDs, packet_id);
+                }
+            }
+        }
+        break;
+    }
+
+    hSIM800.Lock_SM = 0;
+
+    return removed;
+}
+
+/**
+ * @brief send SUBSCRIBE for registered filters not yet subscribed, resend if SUBACK does not come
+ *        pending filters are packed into one packet, so resubscribing after reconnect takes one round trip
+ *        called from sim800 timer while connected to broker
+ */
+static void MQTT_Sub_Task(void)
+{
+    const char *filters[MQTT_SUBSCRIBE_FILTER_MAX];
+    uint8_t qos[MQTT_SUBSCRIBE_FILTER_MAX];
+    uint8_t index[MQTT_SUBSCRIBE_FILTER_MAX];
+    uint8_t count = 0;
+    uint32_t len = 0;
+    uint32_t tick_now = HAL_GetTick();
+
+    MQTT_Request_Expire(0);
+
+    for (uint8_t i = 0; i < MQTT_SUB_MAX; i++)
+    {
+        MQTT_Sub_t *sub = &hSIM800.Sub[i];
+
+        if (sub->State == MQTT_SUB_SENT && tick_now - sub->Tick >= MQTT_RETRY_TIMEOUT)
+        {
+            sub->State = MQTT_SUB_PENDING;
+        }
+
+        if (sub->State == MQTT_SUB_PENDING && count < MQTT_SUBSCRIBE_FILTER_MAX)
+        {
+            uint32_t filter_len = 2 + strnlen(sub->Filter, MQTT_FILTER_LEN_MAX) + 1;
+
+            if (count > 0 && len + filter_len > MQTT_SUBSCRIBE_LEN_MAX)
+            {
+                /** sent by a later packet */
+                continue;
+            }
+
+            filters[count] = sub->Filter;
+            qos[count] = sub->QOS;
+            index[count] = i;
+            count++;
+            len += filter_len;
+        }
+    }
+
+    if (count == 0 || MQTT_Request_Find(0) < 0)
+    {
+        return;
+    }
+
+    uint16_t packet_id = Packet_ID_Alloc(&hSIM800.IDs);
+
+    if (packet_id == 0)
+    {
+        return;
+    }
+
+    if (!MQTT_Send_Subscribe(0x82, filters, qos, count, packet_id))
+    {
+        /** tx buffer is full, try again on next tick */
+        Packet_ID_Release(&hSIM800.IDs, packet_id);
+        return;
+    }
+
+    MQTT_Request_Add(0x82, packet_id, 0);
+
+    /** SUBACK codes come in the order filters were packed */
+    for (uint8_t k = 0; k < count; k++)
+    {
+        MQTT_Sub_t *sub = &hSIM800.Sub[index[k]];
+
+        sub->Packet_ID = packet_id;
+        sub->Packet_Index = k;
+        sub->Tick = tick_now;
+        sub->State = MQTT_SUB_SENT;
+    }
+}
+
+/**
+ * @brief handle SUBACK for registered filters
+ * @param codes granted qos of each filter in packet order, 0x80 and above on failure
+ * @param count number of codes
+ */
+static void MQTT_Sub_SUBACK(uint16_t packet_id, const uint8_t *codes, uint32_t count)
+{
+    for (uint8_t i = 0; i < MQTT_SUB_MAX; i++)
+    {
+        MQTT_Sub_t *sub = &hSIM800.Sub[i];
+        uint8_t k = sub->Packet_Index;
+
+        if (sub->State == MQTT_SUB_SENT && sub->Packet_ID == packet_id)
+        {
+            /** missing code counts as failure */
+            sub->State = (k >= count || (codes[k] & 0x80)) ? MQTT_SUB_FAILED : MQTT_SUB_ACKED;
+        }
+    }
+}
+
+/**
+ * @brief handle SUBACK or UNSUBACK, codes are in order of filters in request
+ * @param codes SUBACK granted qos or mqtt 5 reason code of each filter, none for mqtt 3.1.1 UNSUBACK
+ */
+static void MQTT_Request_Ack(uint8_t type, uint16_t packet_id, const uint8_t *codes, uint32_t count)
+{
+    int index = MQTT_Request_Find(packet_id);
+
+    if (index < 0 || (hSIM800.Request[index].Header >> 4) + 1 != type)
+    {
+        /** ack for an expired request, or not the ack of this request */
+        return;
+    }
+
+    uint8_t app = hSIM800.Request[index].App;
+
+    hSIM800.Request[index].Packet_ID = 0;
+    Packet_ID_Release(&hSIM800.IDs, packet_id);
+
+    if (type == MQTT_SUBACK)
+    {
+        MQTT_Sub_SUBACK(packet_id, codes, count);
+    }
+
+    if (hSIM800.Version >= 5)
+    {
+        for (uint32_t k = 0; k < count; k++)
+        {
+            if (codes[k] & 0x80)
+            {
+                APP_SIM800_MQTT_Reason_CB(type, packet_id, codes[k]);
+            }
+        }
+    }
+
+    if (!app)
+    {
+        return;
+    }
+
+    if (type == MQTT_SUBACK)
+    {
+        APP_SIM800_MQTT_SUBACK_CB(packet_id, codes, count);
+    }
+    else
+    {
+        APP_SIM800_MQTT_UNSUBACK_CB(packet_id, codes, count);
+    }
+}
+
+/**
+ * @brief subscribe all registered filters again, called when connection to broker is established
+ */
+static void MQTT_Sub_Resubscribe_All(void)
+{
+    for (uint8_t i = 0; i < MQTT_SUB_MAX; i++)
+    {
+        if (hSIM800.Sub[i].State != MQTT_SUB_FREE)
+        {
+            hSIM800.Sub[i].State = MQTT_SUB_PENDING;
+        }
+    }
+}
+
+/**
+ * @brief called when a message taken from flash log is acked, dropped or sent (qos 0)
+ */
+static void MQTT_Store_Released(void *ctx)
+{
+    MQTT_Store_Pending_t *pending = ctx;
+
+    /** flash is not written from interrupts, record is consumed by store task */
+    pending->Released = 1;
+}
+
+/**
+ * @brief send messages journaled in flash log while offline, once connected
+ *        flash log records are consumed as soon as their messages are released, in order, so nothing is lost on
+ *        power failure, messages in flight may be sent twice
+ *        drained flash sectors are not erased here, but before next tcp connect, @see MQTT_Store_Erase
+ * @note call from main loop, not from interrupts
+ */
+void SIM800_MQTT_Store_Task(void)
+{
+    while (hSIM800.Store_Tail != hSIM800.Store_Head)
+    {
+        MQTT_Store_Pending_t *pending = &hSIM800.Store_Pending[hSIM800.Store_Tail & (MQTT_STORE_PENDING_MAX - 1)];
+
+        if (!pending->Released)
+        {
+            break;
+        }
+
+        SIM800_Flash_Log_Consume(&pending->Record);
+        hSIM800.Store_Tail++;
+    }
+
+    /** window is filled, messages go out back to back */
+    while (SIM800_Is_MQTT_Connected() && (uint8_t)(hSIM800.Store_Head - hSIM800.Store_Tail) < MQTT_STORE_PENDING_MAX)
+    {
+        MQTT_Store_Pending_t *pending = &hSIM800.Store_Pending[hSIM800.Store_Head & (MQTT_STORE_PENDING_MAX - 1)];
+        SIM800_Flash_Log_Record_t rec = hSIM800.Store_Read;
+        SIM800_MQTT_Topic_t topic;
+
+        if (!SIM800_Flash_Log_Next(&rec))
+        {
+            break;
+        }
+
+        if (rec.Len < 2 ||
+            memchr(rec.Data + 1, '\0', rec.Len - 1) == NULL ||
+            !SIM800_MQTT_Topic_Init(&topic, (const char *)rec.Data + 1))
+        {
+            /** not a publish record */
+            SIM800_Flash_Log_Consume(&rec);
+            hSIM800.Store_Read = rec;
+            continue;
+        }
+
+        uint8_t flags = rec.Data[0];
+        uint8_t qos = (flags >> 1) & 0x03;
+        SIM800_IOV_t iov = {rec.Data + 1 + topic.Len + 1, rec.Len - 1 - topic.Len - 1};
+
+        uint32_t size = MQTT_Publish_Size(&topic, &iov, 1, qos);
+
+        hSIM800.Lock_SM = 1;
+        uint8_t allowed = MQTT_Rate_Take(SIM800_PRIO_NORMAL, size);
+        hSIM800.Lock_SM = 0;
+
+        if (!allowed)
+        {
+            /** record stays in flash log until tokens are back */
+            if (!hSIM800.Store_Deferred)
+            {
+                hSIM800.Store_Deferred = 1;
+                hSIM800.Stats.Rate_Deferred++;
+            }
+            break;
+        }
+
+        pending->Record = rec;
+        pending->Released = 0;
+
+        if (!MQTT_Publish_Online(&topic,
+                                 &iov,
+                                 1,
+                                 0,
+                                 qos,
+                                 flags & 0x01,
+                                 0,
+                                 MQTT_IOV_COPY_MAX,
+                                 MQTT_Store_Released,
+                                 pending))
+        {
+            /** in-flight window or tx buffer is full */
+            hSIM800.Lock_SM = 1;
+            MQTT_Rate_Refund(SIM800_PRIO_NORMAL, size);
+            hSIM800.Lock_SM = 0;
+            break;
+        }
+
+        hSIM800.Store_Deferred = 0;
+        hSIM800.Store_Head++;
+        hSIM800.Store_Read = rec;
+    }
+}
+
+/** received message being dispatched to registered handlers */
+typedef struct MQTT_Dispatch_t
+{
+    const MQTT_Frame_t *Frame;
+    uint8_t Handled;
+} MQTT_Dispatch_t;
+
+/**
+ * @brief called by topic trie for each registered filter matching received topic
+ */
+static void MQTT_Sub_Dispatch(void *ctx, uint8_t index)
+{
+    MQTT_Dispatch_t *dispatch = ctx;
+    MQTT_Sub_t *sub = &hSIM800.Sub[index];
+
+    /** trie keeps only level hashes, confirm match on whole topic, copy in PUBLISH may be cut */
+    if (!Topic_Filter_Match(sub->Filter, dispatch->Frame->Topic, dispatch->Frame->Topic_Len))
+    {
+        return;
+    }
+
+    sub->Handler(hSIM800.PUBLISH.Topic,
+                 (char *)dispatch->Frame->Data,
+                 hSIM800.PUBLISH.MSG_Len,
+                 hSIM800.PUBLISH.DUP,
+                 hSIM800.PUBLISH.QOS,
+                 hSIM800.PUBLISH.MSG_ID);
+
+    dispatch->Handled = 1;
+}
+
+/**
+ * @brief keep header info of received publish
+ **/
+static void MQTT_Set_Publish_Info(const MQTT_Frame_t *frame)
+{
+    uint16_t topic_len = frame->Topic_Len;
+
+    if (topic_len > sizeof(hSIM800.PUBLISH.Topic) - 1)
+    {
+        topic_len = sizeof(hSIM800.PUBLISH.Topic) - 1;
+    }
+    memcpy(hSIM800.PUBLISH.Topic, frame->Topic, topic_len);
+    hSIM800.PUBLISH.Topic[topic_len] = '\0';
+
+    hSIM800.PUBLISH.DUP = (frame->Header >> 3) & 0x01;
+    hSIM800.PUBLISH.QOS = frame->QOS;
+    hSIM800.PUBLISH.MSG_ID = frame->Packet_ID;
+    hSIM800.PUBLISH.MSG_Len = frame->Data_Len;
+
+    /** qos 2 duplicates are acked again but not delivered */
+    hSIM800.PUBLISH.Skip = (frame->QOS == 2 && !MQTT_QOS2_RX_Is_New(frame->Packet_ID));
+}
+
+/**
+ * @brief handle received publish, payload is handed to app directly from where it was decoded
+ *        (uart rx buffer, or parser buffer if packet was split across rx events)
+ **/
+static void MQTT_Handle_Publish(const MQTT_Frame_t *frame)
+{
+    MQTT_Set_Publish_Info(frame);
+
+    if (hSIM800.PUBLISH.Skip)
+    {
+        return;
+    }
+
+    if (frame->Truncated)
+    {
+        hSIM800.Stats.RX_Truncated++;
+    }
+
+    MQTT_Dispatch_t dispatch = {frame, 0};
+
+    Topic_Trie_Match(&hSIM800.Sub_Trie, frame->Topic, frame->Topic_Len, MQTT_Sub_Dispatch, &dispatch);
+
+    if (!dispatch.Handled)
+    {
+        APP_SIM800_MQTT_PUBLISH_CB(hSIM800.PUBLISH.Topic,
+                                   (char *)frame->Data,
+                                   hSIM800.PUBLISH.MSG_Len,
+                                   hSIM800.PUBLISH.DUP,
+                                   hSIM800.PUBLISH.QOS,
+                                   hSIM800.PUBLISH.MSG_ID);
+    }
+
+    MQTT_Publish_Delivered(frame->QOS, frame->Packet_ID);
+}
+
+/**
+ * @brief called by mqtt parser when a streamed publish starts
+ **/
+static void MQTT_Stream_Begin_Handler(void *ctx, const MQTT_Frame_t *frame)
+{
+    MQTT_Set_Publish_Info(frame);
+
+    if (!hSIM800.PUBLISH.Skip)
+    {
+        APP_SIM800_MQTT_Stream_Begin_CB(hSIM800.PUBLISH.Topic,
+                                        hSIM800.PUBLISH.MSG_Len,
+                                        hSIM800.PUBLISH.DUP,
+                                        hSIM800.PUBLISH.QOS,
+                                        hSIM800.PUBLISH.MSG_ID);
+    }
+}
+
+/**
+ * @brief called by mqtt parser for each part of a streamed publish, data points into uart rx buffer
+ **/
+static void MQTT_Stream_Data_Handler(void *ctx, const MQTT_Frame_t *frame, const uint8_t *data, uint32_t len, uint32_t offset)
+{
+    if (!hSIM800.PUBLISH.Skip)
+    {
+        APP_SIM800_MQTT_Stream_Data_CB(hSIM800.PUBLISH.Topic, (char *)data, len, offset);
+    }
+}
+
+/**
+ * @brief called by mqtt parser when a streamed publish is complete, only now it is acked
+ **/
+static void MQTT_Stream_End_Handler(void *ctx, const MQTT_Frame_t *frame)
+{
+    if (!hSIM800.PUBLISH.Skip)
+    {
+        APP_SIM800_MQTT_Stream_End_CB(hSIM800.PUBLISH.Topic, hSIM800.PUBLISH.MSG_Len, hSIM800.PUBLISH.MSG_ID);
+        MQTT_Publish_Delivered(frame->QOS, frame->Packet_ID);
+    }
+}
+
+/**
+ * @brief take broker limits from CONNACK properties, defaults apply to mqtt 3.1.1 and to properties left out
+ *        unknown properties are skipped by their type
+ **/
+static void MQTT_Server_Properties(const MQTT_Frame_t *frame)
+{
+    const uint8_t *prop = frame->Properties;
+    uint32_t pos = 0;
+
+    MQTT_Server_Defaults();
+
+    while (prop != NULL && pos < frame->Properties_Len)
+    {
+        uint8_t id = prop[pos++];
+        uint32_t left = frame->Properties_Len - pos;
+        uint32_t len;
+
+        switch (id)
+        {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            len = 1;
+            break;
+
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            len = 2;
+            break;
+
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            len = 4;
+            break;
+
+        case 0x0B:
+            /** variable byte integer */
+            for (len = 1; len <= left && len < 4 && (prop[pos + len - 1] & 0x80); len++)
             {
-                /** published msg from broker received */
-                if ((rx_chars[0] & 0x30) == 0x30)
-                {
-                    SIM800_UART_Get_Char();
-
-                    uint8_t qos = (rx_chars[0] >> 1) & 0x03;
-                    uint8_t dup = (rx_chars[0] >> 3) & 0x01;
-
-                    uint32_t multiplier = 1;
-                    uint32_t total_len = 0;
-                    uint32_t msg_len = 0;
-                    uint16_t topic_len = 0;
-                    uint16_t message_id = 0;
-
-                    do
-                    {
-                        SIM800_UART_Get_Chars(rx_chars, 1, 0);
-                        total_len += (rx_chars[0] & 127) * multiplier;
-                        multiplier *= 128;
-                        if (multiplier > 128 * 128 * 128)
-                        {
-                            break;
-                        }
-                    } while ((rx_chars[0] & 128) != 0);
-
-                    SIM800_UART_Get_Chars(rx_chars, 2, 0);
-                    topic_len = (rx_chars[0] << 8) | rx_chars[1];
-
-                    msg_len = total_len - topic_len - 2;
-
-                    if (topic_len > sizeof(hSIM800.PUBREC.Topic) - 1)
-                    {
-                        topic_len = sizeof(hSIM800.PUBREC.Topic) - 1;
-                    }
-                    SIM800_UART_Get_Chars(hSIM800.PUBREC.Topic, topic_len, 0);
-                    hSIM800.PUBREC.Topic[topic_len] = '\0';
-
-                    if (qos)
-                    {
-                        SIM800_UART_Get_Chars(rx_chars, 2, 0);
-                        message_id = (rx_chars[0] << 8) | rx_chars[1];
-                        msg_len -= 2;
-
-                        hSIM800.PUBREC.QOS = qos; /** indicates need to send PUBACK*/
-                        hSIM800.PUBREC.MSG_ID = message_id;
-                    }
-                    else
-                    {
-                        hSIM800.PUBREC.QOS = 0;
-                        hSIM800.PUBREC.MSG_ID = 0;
-                    }
-
-                    if (msg_len > sizeof(hSIM800.PUBREC.MSG))
-                    {
-                        msg_len = sizeof(hSIM800.PUBREC.MSG);
-                    }
-                    SIM800_UART_Get_Chars(hSIM800.PUBREC.MSG, msg_len, 0);
-                    hSIM800.PUBREC.DUP = dup;
-                    hSIM800.PUBREC.MSG_Len = msg_len;
-                    hSIM800.RESP_Flags.SIM800_RESP_MQTT_PUBREC = 1;
-                }
-                else if (rx_chars[0] == 0x20)
-                {
-                    SIM800_UART_Get_Chars(rx_chars, 4, 0);
-                    {
-                        if (rx_chars[0] == 0x20 && rx_chars[1] == 0x02)
-                        {
-                            hSIM800.CONNACK.Code = rx_chars[2] << 8 | rx_chars[3];
-                            hSIM800.RESP_Flags.SIM800_RESP_MQTT_CONNACK = 1;
-                        }
-                    }
-                }
-                else if (rx_chars[0] == 0x40)
-                {
-                    SIM800_UART_Get_Chars(rx_chars, 4, 0);
-                    if (rx_chars[0] == 0x40 && rx_chars[1] == 0x02)
-                    {
-                        hSIM800.PUBACK.MSG_ID = rx_chars[2] << 8 | rx_chars[3];
-                        hSIM800.RESP_Flags.SIM800_RESP_MQTT_PUBACK = 1;
-                    }
-                }
-                else if (rx_chars[0] == 0x90)
-                {
-                    SIM800_UART_Get_Chars(rx_chars, 5, 0);
-                    if (rx_chars[0] == 0x90 && rx_chars[1] == 0x03)
-                    {
-                        hSIM800.SUBACK.MSG_ID = rx_chars[2] << 8 | rx_chars[3];
-                        hSIM800.SUBACK.QOS = rx_chars[4];
-                        hSIM800.RESP_Flags.SIM800_RESP_MQTT_SUBACK = 1;
-                    }
-                }
-                else if (rx_chars[0] == 0xD0)
-                {
-                    SIM800_UART_Get_Chars(rx_chars, 2, 0);
-                    if (rx_chars[0] == 0xD0 && rx_chars[1] == 0x00)
-                    {
-                        hSIM800.RESP_Flags.SIM800_RESP_MQTT_PINGACK = 1;
-                    }
-                }
-                else if (rx_chars[0] == '\r')
-                {
-                    SIM800_UART_Get_Chars(rx_chars, 10, 0);
-                    if (strstr(rx_chars, "\r\nCLOSED\r\n") != NULL)
-                    {
-                        hSIM800.RESP_Flags.SIM800_RESP_CLOSED = 1;
-                    }
-                }
-                else
-                {
-                    SIM800_UART_Get_Char();
-                }
             }
+            break;
+
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            /** string or binary data */
+            len = (left >= 2) ? 2 + ((prop[pos] << 8) | prop[pos + 1]) : 2;
+            break;
+
+        case 0x26:
+            /** user property, string pair */
+            len = (left >= 2) ? 2 + ((prop[pos] << 8) | prop[pos + 1]) : 2;
+            if (len + 2 <= left)
+            {
+                len += 2 + ((prop[pos + len] << 8) | prop[pos + len + 1]);
+            }
+            break;
+
+        default:
+            /** unknown property, rest can not be decoded */
+            return;
+        }
+
+        if (len > left)
+        {
+            return;
+        }
+
+        uint16_t value = (len == 2) ? (prop[pos] << 8) | prop[pos + 1] : prop[pos];
+
+        switch (id)
+        {
+        case 0x21: /** receive maximum */
+            hSIM800.Server.Receive_Max = value;
+            break;
+
+        case 0x22: /** topic alias maximum */
+            hSIM800.Server.Alias_Max = (value > MQTT_ALIAS_MAX) ? MQTT_ALIAS_MAX : value;
+            break;
+
+        case 0x24: /** maximum qos */
+            hSIM800.Server.QOS_Max = value;
+            break;
+
+        case 0x25: /** retain available */
+            hSIM800.Server.Retain = value;
+            break;
+
+        case 0x13: /** server keep alive overrides the one sent in CONNECT */
+            hSIM800.Keep_Alive = value * 1000;
+            break;
+        }
+
+        pos += len;
+    }
+}
+
+/**
+ * @brief called by mqtt parser for each packet received from broker
+ **/
+static void MQTT_Frame_Handler(void *ctx, const MQTT_Frame_t *frame)
+{
+    switch (frame->Type)
+    {
+    case MQTT_CONNACK:
+        if (frame->Data_Len >= 2)
+        {
+            hSIM800.CONNACK.Session_Present = frame->Data[0] & 0x01;
+            hSIM800.CONNACK.Code = frame->Data[1];
+            MQTT_Server_Properties(frame);
+            hSIM800.RESP_Flags.SIM800_RESP_MQTT_CONNACK = 1;
+        }
+        break;
+
+    case MQTT_PUBLISH:
+        MQTT_Handle_Publish(frame);
+        break;
+
+    case MQTT_PUBACK:
+    case MQTT_PUBREC:
+    case MQTT_PUBCOMP:
+        /** ack for a message published by app */
+        MQTT_Inflight_Ack(frame->Header, frame->Packet_ID, frame->Reason);
+        break;
+
+    case MQTT_PUBREL:
+        /** release of a qos 2 message received from broker */
+        MQTT_QOS2_RX_PUBREL(frame->Packet_ID);
+        break;
+
+    case MQTT_SUBACK:
+    case MQTT_UNSUBACK:
+        /** one code for each filter of request */
+        MQTT_Request_Ack(frame->Type, frame->Packet_ID, frame->Data, frame->Data_Len);
+        break;
+
+    case MQTT_DISCONNECT:
+        /** mqtt 5 broker tells why it closes, modem reports CLOSED next */
+        APP_SIM800_MQTT_Reason_CB(MQTT_DISCONNECT, 0, frame->Reason);
+        break;
+
+    case MQTT_PINGRESP:
+        hSIM800.Ping_Pending = 0;
+        hSIM800.RESP_Flags.SIM800_RESP_MQTT_PINGACK = 1;
+        break;
+
+    default:
+        /** not expected from broker */
+        break;
+    }
+}
+
+/**
+ * @brief called by mqtt parser for text sent by modem in transparent mode
+ **/
+static void MQTT_Line_Handler(void *ctx, const char *line, uint32_t len)
+{
+    if (strcmp(line, "CLOSED") == 0)
+    {
+        hSIM800.RESP_Flags.SIM800_RESP_CLOSED = 1;
+    }
+    else if (strcmp(line, "OK") == 0)
+    {
+        /** reply to "+++" escape */
+        hSIM800.RESP_Flags.SIM800_RESP_OK = 1;
+    }
+}
+
+/**
+ * @brief process received data on sim800 uart
+ **/
+void SIM800_RX_Process(void)
+{
+    while (SIM800_UART_Get_Count())
+    {
+        if (SIM800_UART_RX_Resync())
+        {
+            /** chars were lost on a uart error, a packet in progress can not be completed */
+            MQTT_Parser_Reset(&hSIM800.Parser);
+            continue;
+        }
+
+        if (hSIM800.State >= SIM800_TCP_CONNECTED)
+        {
+            /** in transparent mode, everything available is decoded in place, partial packets are kept by parser */
+            RB_Span_t spans[2];
+            uint32_t consumed;
+
+            SIM800_UART_Peek_Spans(spans);
+
+            consumed = MQTT_Parser_Feed(&hSIM800.Parser, spans[0].Data, spans[0].Len);
+            consumed += MQTT_Parser_Feed(&hSIM800.Parser, spans[1].Data, spans[1].Len);
+
+            /** decoded data is valid in rx buffer only up to here */
+            SIM800_UART_Consume(consumed);
+
+            hSIM800.Usage.RX_Bytes += consumed;
         }
         else
         {
@@ -977,47 +3840,12 @@ void SIM800_RX_Process(void)
 
             SIM800_Get_Response(line, sizeof(line), 0);
 
-            if (strcmp(line, "OK") == 0)
-            {
-                hSIM800.RESP_Flags.SIM800_RESP_OK = 1;
-            }
-            else if (strcmp(line, "Call Ready") == 00)
-            {
-                hSIM800.RESP_Flags.SIM800_RESP_CALL_READY = 1;
-            }
-            else if (strcmp(line, "SMS Ready") == 0)
-            {
-                hSIM800.RESP_Flags.SIM800_RESP_SMS_READY = 1;
-            }
-            else if (strcmp(line, "+CGATT: 1") == 0)
-            {
-                hSIM800.RESP_Flags.SIM800_RESP_GPRS_READY = 1;
-            }
-            else if (strcmp(line, "SHUT OK") == 0)
-            {
-                hSIM800.RESP_Flags.SIM800_RESP_SHUT_OK = 1;
-            }
-            else if (strcmp(line, "CONNECT") == 0)
-            {
-                hSIM800.RESP_Flags.SIM800_RESP_CONNECT = 1;
-            }
-            else if (CH_In_STR('.', line) == 3)
+            if (!AT_Table_Dispatch(&hSIM800.AT, line) && CH_In_STR('.', line) == 3)
             {
+                /** reply to AT+CIFSR is a bare address, it has no name to match */
                 strncpy(hSIM800.TCP.MY_IP, line, sizeof(hSIM800.TCP.MY_IP));
                 hSIM800.RESP_Flags.SIM800_RESP_IP = 1;
             }
-            else if (strncmp(line, "+CCLK: ", 7) == 0)
-            {
-                hSIM800.Time.Year = (line[8] - '0') * 10 + line[9] - '0';
-                hSIM800.Time.Month = (line[11] - '0') * 10 + line[12] - '0';
-                hSIM800.Time.Date = (line[14] - '0') * 10 + line[15] - '0';
-
-                hSIM800.Time.Hours = (line[17] - '0') * 10 + line[18] - '0';
-                hSIM800.Time.Minutes = (line[20] - '0') * 10 + line[21] - '0';
-                hSIM800.Time.Seconds = (line[23] - '0') * 10 + line[24] - '0';
-
-                hSIM800.RESP_Flags.SIM800_RESP_DATE_TIME = 1;
-            }
         }
     }
 }
@@ -1072,6 +3900,8 @@ void SIM800_TIM_ISR(void)
         sim800_result = _SIM800_TCP_Connect();
         if (sim800_result == SIM800_SUCCESS)
         {
+            /** transparent mode starts, nothing received before is part of mqtt stream */
+            MQTT_Parser_Reset(&hSIM800.Parser);
             hSIM800.State = SIM800_TCP_CONNECTED;
             APP_SIM800_TCP_CONN_CB(1);
         }
@@ -1097,9 +3927,22 @@ void SIM800_TIM_ISR(void)
         }
         else if (sim800_result == SIM800_SUCCESS)
         {
-            if (hSIM800.CONNACK.Code == 0x00) /** session present ignored "0x01" */
+            if (hSIM800.CONNACK.Code == 0x00)
             {
                 hSIM800.State = SIM800_MQTT_CONNECTED;
+                hSIM800.Ping_Pending = 0;
+                if (hSIM800.CONNACK.Session_Present)
+                {
+                    /** messages not acked on previous connection are sent again */
+                    MQTT_Inflight_Resend_All();
+                }
+                else
+                {
+                    MQTT_Inflight_Restart_All();
+                    MQTT_RX_Session_Clear();
+                }
+                MQTT_Request_Expire(1);
+                MQTT_Sub_Resubscribe_All();
             }
             else
             {
@@ -1111,50 +3954,45 @@ void SIM800_TIM_ISR(void)
     break;
 
     case SIM800_MQTT_CONNECTED:
-        if (hSIM800.PUBREC.PUBACK_Flag && !hSIM800.UART_TX_Busy)
+        if (!MQTT_Keep_Alive_Task())
         {
-            /** send PUBACK */
-            hSIM800.UART_TX_Busy = 1;
-            hSIM800.PUBREC.PUBACK_Flag = 0;
-            SIM800_UART_Send_Char(0x40); /** PUBACK header */
-            SIM800_UART_Send_Char(0x02);
-            SIM800_UART_Send_Char((hSIM800.PUBREC.MSG_ID >> 8) & 0xFF);
-            SIM800_UART_Send_Char(hSIM800.PUBREC.MSG_ID & 0xFF);
-            hSIM800.UART_TX_Busy = 0;
+            /** no PINGRESP, broker or network is gone but modem did not notice */
+            hSIM800.Escape_Step = 0;
+            hSIM800.State = SIM800_TCP_ESCAPING;
+            break;
         }
-        break;
-    }
 
-    /** look for callbacks */
-    if (hSIM800.RESP_Flags.SIM800_RESP_MQTT_PUBREC)
-    {
-        hSIM800.RESP_Flags.SIM800_RESP_MQTT_PUBREC = 0;
+        /** acks for received messages first, they hold up the broker */
+        MQTT_Ack_Task();
 
-        if (hSIM800.PUBREC.QOS)
-        {
-            hSIM800.PUBREC.PUBACK_Flag = 1; /** need to send PUBACK for this MSG */
-        }
+        MQTT_Inflight_Task();
 
-        APP_SIM800_MQTT_PUBREC_CB(hSIM800.PUBREC.Topic,
-                                  hSIM800.PUBREC.MSG,
-                                  hSIM800.PUBREC.MSG_Len,
-                                  hSIM800.PUBREC.DUP,
-                                  hSIM800.PUBREC.QOS,
-                                  hSIM800.PUBREC.MSG_ID);
-    }
+        MQTT_Sub_Task();
 
-    if (hSIM800.RESP_Flags.SIM800_RESP_MQTT_PUBACK)
-    {
-        hSIM800.RESP_Flags.SIM800_RESP_MQTT_PUBACK = 0;
-        APP_SIM800_MQTT_PUBACK_CB(hSIM800.PUBACK.MSG_ID);
-    }
+        MQTT_Queue_Task();
+
+        MQTT_Usage_Task();
+        break;
 
-    if (hSIM800.RESP_Flags.SIM800_RESP_MQTT_SUBACK)
+    case SIM800_TCP_ESCAPING:
     {
-        hSIM800.RESP_Flags.SIM800_RESP_MQTT_SUBACK = 0;
-        APP_SIM800_MQTT_SUBACK_CB(hSIM800.SUBACK.MSG_ID, hSIM800.SUBACK.QOS);
+        sim800_result = _SIM800_TCP_Escape();
+        if (sim800_result == SIM800_SUCCESS)
+        {
+            /** modem is in command mode, new tcp connection is set up by app */
+            hSIM800.State = SIM800_RESET_OK;
+            APP_SIM800_TCP_Closed_CB();
+        }
+        else if (sim800_result == SIM800_FAILED)
+        {
+            /** modem does not respond, start over */
+            SIM800_Reset();
+        }
+    }
+    break;
     }
 
+    /** look for callbacks */
     if (hSIM800.RESP_Flags.SIM800_RESP_MQTT_PINGACK)
     {
         hSIM800.RESP_Flags.SIM800_RESP_MQTT_PINGACK = 0;
@@ -1163,6 +4001,7 @@ void SIM800_TIM_ISR(void)
 
     if (hSIM800.RESP_Flags.SIM800_RESP_CLOSED)
     {
+        hSIM800.RESP_Flags.SIM800_RESP_CLOSED = 0;
         /** TCP connection closed due to inactivity or server closed the connection */
         /** set hSIM800.State to SIM800_RESET_OK to indicate new tcp connection is required */
         hSIM800.State = SIM800_RESET_OK;
@@ -1190,8 +4029,7 @@ void SIM800_RX_Ready_Callback(void)
 }
 
 /**
- * @brief called when sim800 modem is using uart dma mode, @see SIM800_UART_TX_CMPLT_ISR
- * @note only applicable if tx dma is used
+ * @brief called when uart tx dma has sent everything queued in tx buffer, @see SIM800_UART_TX_CMPLT_ISR
  */
 void SIM800_TX_Complete_Callback(void)
 {
@@ -1235,7 +4073,7 @@ __weak void APP_SIM800_TCP_CONN_CB(uint8_t tcp_ok)
 {
 }
 /**
- * @brief called when TCP connection is closed
+ * @brief called when TCP connection is closed, or found dead because PINGRESP did not come
  */
 __weak void APP_SIM800_TCP_Closed_CB(void)
 {
@@ -1252,7 +4090,8 @@ __weak void APP_SIM800_MQTT_CONN_Failed_CB(void)
 /**
  * @brief called when CONNACK is received
  *        callback response for @see SIM800_MQTT_Connect
- * @param code return code from broker
+ * @param code return code from broker, mqtt 5 reason code, 0 on success
+ *        session present flag is not part of it
  */
 __weak void APP_SIM800_MQTT_CONNACK_CB(uint16_t code)
 {
@@ -1267,13 +4106,83 @@ __weak void APP_SIM800_MQTT_PUBACK_CB(uint16_t message_id)
 {
 }
 
+/**
+ * @brief called when PUBCOMP is received, qos 2 message is delivered exactly once
+ *        callback response for @see SIM800_MQTT_Publish
+ * @param message_id message on which ack is received
+ */
+__weak void APP_SIM800_MQTT_PUBCOMP_CB(uint16_t message_id)
+{
+}
+
+/**
+ * @brief called when qos 2 exchange starts or ends, so its state can be kept across a reset
+ *        saved exchanges are given back with @see SIM800_MQTT_QOS2_Restore
+ * @param message_id id of message
+ * @param inbound 1 for message received from broker (PUBREC sent), 0 for message published by app (PUBREC received)
+ * @param active 1 when exchange starts, 0 when it ends
+ */
+__weak void APP_SIM800_MQTT_QOS2_Persist_CB(uint16_t message_id, uint8_t inbound, uint8_t active)
+{
+}
+
+/**
+ * @brief called when qos 1 or 2 message is dropped because no PUBACK was received after all retransmissions
+ *        callback response for @see SIM800_MQTT_Publish
+ * @param message_id message which is dropped
+ */
+__weak void APP_SIM800_MQTT_PUB_Failed_CB(uint16_t message_id)
+{
+}
+
+/**
+ * @brief called when mqtt 5 broker sends a reason code other than success
+ *        PUBACK, PUBREC and PUBCOMP with code 0x80 and above also get @see APP_SIM800_MQTT_PUB_Failed_CB
+ * @param packet_type @see MQTT_Packet_Type_t, MQTT_DISCONNECT if broker closes connection
+ * @param packet_id packet the code is for, 0 for DISCONNECT
+ * @param reason mqtt 5 reason code
+ */
+__weak void APP_SIM800_MQTT_Reason_CB(uint8_t packet_type, uint16_t packet_id, uint8_t reason)
+{
+}
+
 /**
  * @brief called when SUBACK is received
- *        callback response for @see SIM800_MQTT_Subscribe
+ *        callback response for @see SIM800_MQTT_Subscribe and @see SIM800_MQTT_Subscribe_Multi
+ * @param packet_id packet on which ack is received
+ * @param codes granted qos of each filter in request order, 0x80 and above on failure
+ * @param count number of codes
+ */
+__weak void APP_SIM800_MQTT_SUBACK_CB(uint16_t packet_id, const uint8_t *codes, uint32_t count)
+{
+}
+
+/**
+ * @brief called when UNSUBACK is received
+ *        callback response for @see SIM800_MQTT_Unsubscribe
  * @param packet_id packet on which ack is received
- * @param qos of topic
+ * @param codes mqtt 5 reason code of each filter in request order, none (count 0) for mqtt 3.1.1
+ * @param count number of codes
  */
-__weak void APP_SIM800_MQTT_SUBACK_CB(uint16_t packet_id, uint8_t qos)
+__weak void APP_SIM800_MQTT_UNSUBACK_CB(uint16_t packet_id, const uint8_t *codes, uint32_t count)
+{
+}
+
+/**
+ * @brief called when SUBSCRIBE or UNSUBSCRIBE sent by app is not acked in time, or connection is lost first
+ * @param packet_id packet of request
+ */
+__weak void APP_SIM800_MQTT_SUB_Failed_CB(uint16_t packet_id)
+{
+}
+
+/**
+ * @brief called when data plan usage grew by MQTT_USAGE_SAVE_STEP bytes since last call
+ *        called from sim800 timer, copy usage and save it from main context
+ *        restore it at startup with @see SIM800_MQTT_Set_Usage
+ * @param usage counters so far
+ */
+__weak void APP_SIM800_MQTT_Usage_CB(const SIM800_MQTT_Usage_t *usage)
 {
 }
 
@@ -1285,6 +4194,45 @@ __weak void APP_SIM800_MQTT_Ping_CB(void)
 {
 }
 
+/**
+ * @brief called when a streamed mqtt message starts, @see SIM800_MQTT_Set_Stream_Threshold
+ * @param topic topic on which message is received
+ * @param total_len payload length
+ * @param dup duplicates flag
+ * @param qos qos of received message
+ * @param message_id message id
+ * @note if connection is lost before @see APP_SIM800_MQTT_Stream_End_CB the message starts over when broker sends it again
+ */
+__weak void APP_SIM800_MQTT_Stream_Begin_CB(char *topic,
+                                            uint32_t total_len,
+                                            uint8_t dup,
+                                            uint8_t qos,
+                                            uint16_t message_id)
+{
+}
+
+/**
+ * @brief called for each part of a streamed mqtt message, in order
+ * @param topic topic on which message is received
+ * @param data part of payload
+ * @param len part length
+ * @param offset position of part in payload
+ * @note data points directly into uart rx buffer, it is only valid during this call
+ */
+__weak void APP_SIM800_MQTT_Stream_Data_CB(char *topic, char *data, uint32_t len, uint32_t offset)
+{
+}
+
+/**
+ * @brief called when whole payload of a streamed mqtt message is delivered, message is acked after this
+ * @param topic topic on which message is received
+ * @param total_len payload length
+ * @param message_id message id
+ */
+__weak void APP_SIM800_MQTT_Stream_End_CB(char *topic, uint32_t total_len, uint16_t message_id)
+{
+}
+
 /**
  * @brief called when mqtt message is received
  * @param topic topic on which message is received
@@ -1293,12 +4241,14 @@ __weak void APP_SIM800_MQTT_Ping_CB(void)
  * @param dup duplicates flag
  * @param qos qos of received message
  * @param message_id message id
+ * @note message may point directly into uart rx buffer, it is only valid during this call
+ *       message split across rx events is cut at MQTT_RX_BUFFER_SIZE, use streaming for larger ones
  */
-__weak void APP_SIM800_MQTT_PUBREC_CB(char *topic,
-                                      char *message,
-                                      uint32_t msg_len,
-                                      uint8_t dup,
-                                      uint8_t qos,
-                                      uint16_t message_id)
+__weak void APP_SIM800_MQTT_PUBLISH_CB(char *topic,
+                                       char *message,
+                                       uint32_t msg_len,
+                                       uint8_t dup,
+                                       uint8_t qos,
+                                       uint16_t message_id)
 {
 }
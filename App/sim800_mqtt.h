@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "sim800_cbor.h"
+
 /**
  * mqtt connect flags
  */
@@ -31,8 +33,103 @@ typedef enum SIM800_State_t
 
     SIM800_MQTT_CONNECTING,
     SIM800_MQTT_CONNECTED,
+
+    SIM800_TCP_ESCAPING, /** PINGRESP did not come, leaving transparent mode to reconnect */
 } SIM800_State_t;
 
+/**
+ * message fragment for @see SIM800_MQTT_Publish_IOV
+ */
+typedef struct SIM800_IOV_t
+{
+    const void *Data;
+    uint32_t Len;
+} SIM800_IOV_t;
+
+/**
+ * topic name validated and encoded once, @see SIM800_MQTT_Topic_Init
+ */
+typedef struct SIM800_MQTT_Topic_t
+{
+    const char *Name;
+    uint16_t Len;
+    uint8_t Prefix[2];  /** big endian length, sent before name */
+    uint8_t Persistent; /** name outlives the publish, so mqtt 5 may replace it by a topic alias */
+} SIM800_MQTT_Topic_t;
+
+/** encodes payload for @see SIM800_MQTT_Publish_CBOR, called twice while connected and must encode the same both times */
+typedef void (*SIM800_MQTT_Encode_CB_t)(CBOR_t *cbor, void *ctx);
+
+/** called when buffers passed to @see SIM800_MQTT_Publish_IOV can be reused */
+typedef void (*SIM800_MQTT_Release_CB_t)(void *ctx);
+
+/** publish queue levels, @see SIM800_MQTT_Publish_Queued */
+typedef enum SIM800_MQTT_Prio_t
+{
+    SIM800_PRIO_CRITICAL, /** always sent first, e.g. alarms */
+    SIM800_PRIO_NORMAL,
+    SIM800_PRIO_BULK, /** e.g. log uploads, shares the link with normal by weight */
+    SIM800_PRIO_COUNT,
+} SIM800_MQTT_Prio_t;
+
+/** what a full publish queue does with one more message */
+typedef enum SIM800_MQTT_Drop_t
+{
+    SIM800_DROP_NEWEST, /** new message is refused */
+    SIM800_DROP_OLDEST, /** oldest queued message is released unsent to make room */
+} SIM800_MQTT_Drop_t;
+
+/**
+ * inbound traffic counters, @see SIM800_MQTT_Get_Stats
+ */
+typedef struct SIM800_MQTT_Stats_t
+{
+    uint32_t RX_Messages;     /** messages delivered to app */
+    uint32_t RX_Duplicates;   /** qos 2 messages not delivered again */
+    uint32_t RX_Dropped;      /** qos 2 messages refused because id table was full, broker sends them again */
+    uint32_t RX_Truncated;    /** messages cut at parser buffer size */
+    uint32_t RX_Errors;       /** malformed bytes skipped by parser */
+    uint32_t RX_Overrun;      /** chars lost because uart rx buffer was not read in time */
+    uint32_t Ack_Dropped;     /** acks not sent because ack queue and tx buffer were full, broker sends message again */
+    uint32_t Queue_Dropped;   /** queued publishes dropped by queue policy or refused by broker limits */
+    uint32_t Queue_Conflated; /** queued publishes replaced by a newer value on same topic */
+    uint32_t Rate_Dropped;    /** direct publishes refused by rate limit or budget */
+    uint32_t Rate_Deferred;   /** queued or journaled publishes held back by rate limit or budget */
+    uint32_t Encode_Errors;   /** cbor publishes not sent because encode did not repeat itself */
+} SIM800_MQTT_Stats_t;
+
+/**
+ * uplink limits in front of the publish path, @see SIM800_MQTT_Set_Rate
+ * rates refill token buckets up to burst size, a 0 rate turns its bucket off
+ */
+typedef struct SIM800_MQTT_Rate_t
+{
+    uint32_t Byte_Rate;  /** sustained publish bytes per second */
+    uint32_t Byte_Burst; /** publish bytes sent back to back after idle time, up to 4 MB */
+    uint32_t Msg_Rate;   /** sustained publishes per minute */
+    uint32_t Msg_Burst;  /** publishes sent back to back after idle time */
+    uint32_t Budget;     /** max TX_Bytes of @see SIM800_MQTT_Usage_t, e.g. monthly plan share, 0 for none */
+    uint8_t Exempt;      /** bit (1 << prio) for each level not limited, direct publishes count as normal */
+} SIM800_MQTT_Rate_t;
+
+/**
+ * data plan usage, kept across sessions by app, @see SIM800_MQTT_Set_Usage
+ */
+typedef struct SIM800_MQTT_Usage_t
+{
+    uint32_t TX_Bytes;    /** mqtt bytes sent, including acks, pings and resends */
+    uint32_t RX_Bytes;    /** mqtt bytes received */
+    uint32_t TX_Messages; /** publishes sent, not counting resends */
+} SIM800_MQTT_Usage_t;
+
+/** handler for messages on a registered topic filter, @see SIM800_MQTT_Register */
+typedef void (*SIM800_MQTT_Handler_t)(char *topic,
+                                      char *message,
+                                      uint32_t msg_len,
+                                      uint8_t dup,
+                                      uint8_t qos,
+                                      uint16_t message_id);
+
 typedef struct SIM800_Date_Time_t
 {
     uint8_t Year;
@@ -80,7 +177,82 @@ uint8_t SIM800_MQTT_Publish(char *topic,
                             uint8_t retain,
                             uint16_t message_id);
 
-uint8_t SIM800_MQTT_Subscribe(char *topic, uint8_t packet_id, uint8_t qos);
+uint8_t SIM800_MQTT_Publish_IOV(char *topic,
+                                const SIM800_IOV_t *iov,
+                                uint8_t iov_cnt,
+                                uint8_t dup,
+                                uint8_t qos,
+                                uint8_t retain,
+                                uint16_t message_id,
+                                SIM800_MQTT_Release_CB_t release,
+                                void *ctx);
+
+uint8_t SIM800_MQTT_Topic_Init(SIM800_MQTT_Topic_t *topic, const char *name);
+
+uint8_t SIM800_MQTT_Publish_Topic(const SIM800_MQTT_Topic_t *topic,
+                                  const SIM800_IOV_t *iov,
+                                  uint8_t iov_cnt,
+                                  uint8_t dup,
+                                  uint8_t qos,
+                                  uint8_t retain,
+                                  uint16_t message_id,
+                                  SIM800_MQTT_Release_CB_t release,
+                                  void *ctx);
+
+uint8_t SIM800_MQTT_Publish_CBOR(const SIM800_MQTT_Topic_t *topic,
+                                 uint8_t retain,
+                                 SIM800_MQTT_Encode_CB_t encode,
+                                 void *ctx);
+
+void SIM800_MQTT_Store_Task(void);
+
+uint8_t SIM800_MQTT_Publish_Queued(SIM800_MQTT_Prio_t prio,
+                                   const SIM800_MQTT_Topic_t *topic,
+                                   const SIM800_IOV_t *iov,
+                                   uint8_t iov_cnt,
+                                   uint8_t qos,
+                                   uint8_t retain,
+                                   SIM800_MQTT_Release_CB_t release,
+                                   void *ctx);
+
+uint8_t SIM800_MQTT_Publish_Latest(SIM800_MQTT_Prio_t prio,
+                                   const SIM800_MQTT_Topic_t *topic,
+                                   const SIM800_IOV_t *iov,
+                                   uint8_t iov_cnt,
+                                   uint8_t qos,
+                                   uint8_t retain,
+                                   SIM800_MQTT_Release_CB_t release,
+                                   void *ctx);
+
+uint8_t SIM800_MQTT_Set_Queue(SIM800_MQTT_Prio_t prio, uint8_t depth, SIM800_MQTT_Drop_t drop, uint8_t weight);
+
+uint8_t SIM800_MQTT_Get_Queue_Count(SIM800_MQTT_Prio_t prio);
+
+uint8_t SIM800_MQTT_Set_Inflight_Window(uint8_t window);
+
+uint8_t SIM800_MQTT_Get_Inflight_Count(void);
+
+uint8_t SIM800_MQTT_QOS2_Restore(uint16_t message_id, uint8_t inbound);
+
+void SIM800_MQTT_Set_Stream_Threshold(uint32_t len);
+
+void SIM800_MQTT_Get_Stats(SIM800_MQTT_Stats_t *stats);
+
+void SIM800_MQTT_Set_Rate(const SIM800_MQTT_Rate_t *rate);
+
+void SIM800_MQTT_Set_Usage(const SIM800_MQTT_Usage_t *usage);
+
+void SIM800_MQTT_Get_Usage(SIM800_MQTT_Usage_t *usage);
+
+uint16_t SIM800_MQTT_Subscribe(char *topic, uint16_t packet_id, uint8_t qos);
+
+uint16_t SIM800_MQTT_Subscribe_Multi(const char *const *filters, const uint8_t *qos, uint8_t count, uint16_t packet_id);
+
+uint16_t SIM800_MQTT_Unsubscribe(const char *const *filters, uint8_t count, uint16_t packet_id);
+
+uint8_t SIM800_MQTT_Register(const char *filter, uint8_t qos, SIM800_MQTT_Handler_t handler);
+
+uint8_t SIM800_MQTT_Unregister(const char *filter);
 
 /** WAEK callbacks need to br defined by user app ****/
 void APP_SIM800_Reset_CB(uint8_t reset_ok);
@@ -91,13 +263,27 @@ void APP_SIM800_TCP_Closed_CB(void);
 void APP_SIM800_MQTT_CONN_Failed_CB(void);
 void APP_SIM800_MQTT_CONNACK_CB(uint16_t mqtt_ok);
 void APP_SIM800_MQTT_PUBACK_CB(uint16_t message_id);
-void APP_SIM800_MQTT_SUBACK_CB(uint16_t packet_id, uint8_t qos);
+void APP_SIM800_MQTT_PUBCOMP_CB(uint16_t message_id);
+void APP_SIM800_MQTT_QOS2_Persist_CB(uint16_t message_id, uint8_t inbound, uint8_t active);
+void APP_SIM800_MQTT_PUB_Failed_CB(uint16_t message_id);
+void APP_SIM800_MQTT_Reason_CB(uint8_t packet_type, uint16_t packet_id, uint8_t reason);
+void APP_SIM800_MQTT_SUBACK_CB(uint16_t packet_id, const uint8_t *codes, uint32_t count);
+void APP_SIM800_MQTT_UNSUBACK_CB(uint16_t packet_id, const uint8_t *codes, uint32_t count);
+void APP_SIM800_MQTT_SUB_Failed_CB(uint16_t packet_id);
+void APP_SIM800_MQTT_Usage_CB(const SIM800_MQTT_Usage_t *usage);
 void APP_SIM800_MQTT_Ping_CB(void);
-void APP_SIM800_MQTT_PUBREC_CB(char *topic,
-                               char *message,
-                               uint32_t mesg_len,
-                               uint8_t dup,
-                               uint8_t qos,
-                               uint16_t message_id);
+void APP_SIM800_MQTT_PUBLISH_CB(char *topic,
+                                char *message,
+                                uint32_t mesg_len,
+                                uint8_t dup,
+                                uint8_t qos,
+                                uint16_t message_id);
+void APP_SIM800_MQTT_Stream_Begin_CB(char *topic,
+                                     uint32_t total_len,
+                                     uint8_t dup,
+                                     uint8_t qos,
+                                     uint16_t message_id);
+void APP_SIM800_MQTT_Stream_Data_CB(char *topic, char *data, uint32_t len, uint32_t offset);
+void APP_SIM800_MQTT_Stream_End_CB(char *topic, uint32_t total_len, uint16_t message_id);
 
 #endif /* SIM800_MQTT_H_ */
@@ -0,0 +1,638 @@
+/** standard includes */
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+/** app includes */
+#include "sim800_mqtt_parser.h"
+
+/**
+ * @brief init decoder
+ * @param buffer holds packet body when it is split across feeds, bodies longer than it are truncated
+ * @param buffer_size size of buffer
+ * @param frame_cb called for each complete packet
+ * @param line_cb called for each text line, can be NULL
+ * @param ctx passed to callbacks
+ */
+void MQTT_Parser_Init(MQTT_Parser_t *parser,
+                      uint8_t *buffer,
+                      uint32_t buffer_size,
+                      MQTT_Parser_Frame_CB_t frame_cb,
+                      MQTT_Parser_Line_CB_t line_cb,
+                      void *ctx)
+{
+    parser->Buffer = buffer;
+    parser->Buffer_Size = buffer_size;
+    parser->Frame_CB = frame_cb;
+    parser->Line_CB = line_cb;
+    parser->Ctx = ctx;
+    parser->Frame_Count = 0;
+    parser->Error_Count = 0;
+    parser->Version = 4;
+
+    MQTT_Parser_Set_Stream(parser, UINT32_MAX, NULL, NULL, NULL);
+    MQTT_Parser_Reset(parser);
+}
+
+/**
+ * @brief stream large publishes instead of assembling them in buffer, so payload size is not limited by it
+ * @param threshold publishes with remaining length above this are streamed, UINT32_MAX to disable
+ * @param begin_cb called when topic and packet id are known, Data_Len of frame is payload length
+ * @param data_cb called for each part of payload in order, data points into fed chunk
+ * @param end_cb called after last part of payload
+ * @note a stream interrupted by @see MQTT_Parser_Reset gets no end callback
+ */
+void MQTT_Parser_Set_Stream(MQTT_Parser_t *parser,
+                            uint32_t threshold,
+                            MQTT_Parser_Frame_CB_t begin_cb,
+                            MQTT_Parser_Data_CB_t data_cb,
+                            MQTT_Parser_Frame_CB_t end_cb)
+{
+    parser->Stream_Threshold = threshold;
+    parser->Stream_Begin_CB = begin_cb;
+    parser->Stream_Data_CB = data_cb;
+    parser->Stream_End_CB = end_cb;
+}
+
+/**
+ * @brief set protocol level of the connection, packets of mqtt 5 carry properties
+ * @param version 4 for mqtt 3.1.1, 5 for mqtt 5
+ */
+void MQTT_Parser_Set_Version(MQTT_Parser_t *parser, uint8_t version)
+{
+    parser->Version = version;
+}
+
+/**
+ * @brief drop partly received packet, next byte is expected to be a fixed header
+ */
+void MQTT_Parser_Reset(MQTT_Parser_t *parser)
+{
+    parser->State = MQTT_PARSER_HEADER;
+    parser->Remaining_Len = 0;
+    parser->Length_Bytes = 0;
+    parser->Body_Pos = 0;
+    parser->Line_Len = 0;
+}
+
+/**
+ * @brief check fixed header flags as required by mqtt 3.1.1
+ * @retval return 1 if byte is a valid fixed header
+ */
+static uint8_t MQTT_Parser_Header_Valid(uint8_t header)
+{
+    uint8_t type = header >> 4;
+    uint8_t flags = header & 0x0F;
+
+    switch (type)
+    {
+    case MQTT_PUBLISH:
+        return ((flags >> 1) & 0x03) != 0x03; /** qos 3 is not allowed */
+
+    case MQTT_PUBREL:
+    case MQTT_SUBSCRIBE:
+    case MQTT_UNSUBSCRIBE:
+        return flags == 0x02;
+
+    case MQTT_CONNECT:
+    case MQTT_CONNACK:
+    case MQTT_PUBACK:
+    case MQTT_PUBREC:
+    case MQTT_PUBCOMP:
+    case MQTT_SUBACK:
+    case MQTT_UNSUBACK:
+    case MQTT_PINGREQ:
+    case MQTT_PINGRESP:
+    case MQTT_DISCONNECT:
+        return flags == 0x00;
+
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief decode variable byte integer
+ * @param pos position in data, advanced past integer
+ * @retval return 1 on success, 0 if it is longer than 4 bytes or data ends
+ */
+static uint8_t MQTT_Parser_Varint(const uint8_t *data, uint32_t len, uint32_t *pos, uint32_t *value)
+{
+    *value = 0;
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        if (*pos >= len)
+        {
+            return 0;
+        }
+
+        uint8_t ch = data[(*pos)++];
+        *value |= (uint32_t)(ch & 127) << (7 * i);
+
+        if ((ch & 128) == 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief locate mqtt 5 property block, properties are decoded by the user of the frame
+ * @param pos position of property length, advanced past the block
+ * @retval return 1 on success, 0 if block is malformed or longer than body
+ */
+static uint8_t MQTT_Parser_Properties(const uint8_t *body, uint32_t body_len, uint32_t *pos, MQTT_Frame_t *frame)
+{
+    uint32_t len;
+
+    if (!MQTT_Parser_Varint(body, body_len, pos, &len) || len > body_len - *pos)
+    {
+        return 0;
+    }
+
+    frame->Properties = &body[*pos];
+    frame->Properties_Len = len;
+    *pos += len;
+
+    return 1;
+}
+
+/**
+ * @brief decode variable header of publish: topic, packet id and for mqtt 5 properties
+ * @param pos set to position of payload
+ * @retval return 1 on success
+ */
+static uint8_t MQTT_Parser_Publish_Vars(const MQTT_Parser_t *parser, const uint8_t *body, uint32_t body_len, MQTT_Frame_t *frame, uint32_t *pos)
+{
+    if (body_len < 2)
+    {
+        return 0;
+    }
+
+    frame->Topic_Len = (body[0] << 8) | body[1];
+    frame->Topic = (const char *)&body[2];
+    *pos = 2 + frame->Topic_Len;
+
+    if (frame->QOS)
+    {
+        *pos += 2;
+    }
+
+    if (*pos > body_len)
+    {
+        return 0;
+    }
+
+    if (frame->QOS)
+    {
+        frame->Packet_ID = (body[*pos - 2] << 8) | body[*pos - 1];
+    }
+
+    if (parser->Version >= 5)
+    {
+        return MQTT_Parser_Properties(body, body_len, pos, frame);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief decode variable header of complete packet and hand it to frame callback
+ * @param body packet body, NULL if remaining length is 0
+ * @param body_len chars available in body
+ */
+static void MQTT_Parser_Emit(MQTT_Parser_t *parser, const uint8_t *body, uint32_t body_len, uint8_t truncated)
+{
+    MQTT_Frame_t frame = {0};
+    uint32_t pos = 0;
+
+    frame.Header = parser->Header;
+    frame.Type = parser->Header >> 4;
+    frame.Remaining_Len = parser->Remaining_Len;
+    frame.Truncated = truncated;
+
+    switch (frame.Type)
+    {
+    case MQTT_PUBLISH:
+        frame.QOS = (parser->Header >> 1) & 0x03;
+
+        if (!MQTT_Parser_Publish_Vars(parser, body, body_len, &frame, &pos))
+        {
+            parser->Error_Count++;
+            return;
+        }
+        break;
+
+    case MQTT_PUBACK:
+    case MQTT_PUBREC:
+    case MQTT_PUBREL:
+    case MQTT_PUBCOMP:
+    case MQTT_SUBSCRIBE:
+    case MQTT_SUBACK:
+    case MQTT_UNSUBSCRIBE:
+    case MQTT_UNSUBACK:
+        if (body_len < 2)
+        {
+            parser->Error_Count++;
+            return;
+        }
+
+        frame.Packet_ID = (body[0] << 8) | body[1];
+        pos = 2;
+
+        if (parser->Version < 5)
+        {
+            break;
+        }
+
+        if (frame.Type == MQTT_SUBACK || frame.Type == MQTT_UNSUBACK)
+        {
+            /** properties come before reason codes */
+            if (!MQTT_Parser_Properties(body, body_len, &pos, &frame))
+            {
+                parser->Error_Count++;
+                return;
+            }
+        }
+        else if (frame.Type != MQTT_SUBSCRIBE && frame.Type != MQTT_UNSUBSCRIBE && body_len > 2)
+        {
+            /** reason code and properties may be left out when code is 0 */
+            frame.Reason = body[pos++];
+            if (body_len > 3 && !MQTT_Parser_Properties(body, body_len, &pos, &frame))
+            {
+                parser->Error_Count++;
+                return;
+            }
+        }
+        break;
+
+    case MQTT_CONNACK:
+        if (body_len < 2)
+        {
+            parser->Error_Count++;
+            return;
+        }
+
+        /** Data keeps flags and code for both versions */
+        frame.Reason = body[1];
+        if (parser->Version >= 5 && body_len > 2)
+        {
+            uint32_t prop_pos = 2;
+            if (!MQTT_Parser_Properties(body, body_len, &prop_pos, &frame))
+            {
+                parser->Error_Count++;
+                return;
+            }
+        }
+        break;
+
+    case MQTT_DISCONNECT:
+        if (parser->Version >= 5 && body_len > 0)
+        {
+            frame.Reason = body[pos++];
+            if (body_len > 1 && !MQTT_Parser_Properties(body, body_len, &pos, &frame))
+            {
+                parser->Error_Count++;
+                return;
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    frame.Data = (body != NULL) ? &body[pos] : NULL;
+    frame.Data_Len = body_len - pos;
+
+    parser->Frame_Count++;
+
+    if (parser->Frame_CB != NULL)
+    {
+        parser->Frame_CB(parser->Ctx, &frame);
+    }
+}
+
+/**
+ * @brief get length of variable header of streamed publish from chars collected so far
+ * @param known set to 1 if length is final, else it is only the chars needed to learn more
+ */
+static uint32_t MQTT_Parser_Publish_Header_Len(const MQTT_Parser_t *parser, uint8_t qos, uint8_t *known)
+{
+    const uint8_t *buf = parser->Buffer;
+    uint32_t have = parser->Body_Pos;
+
+    *known = 0;
+
+    if (have < 2)
+    {
+        /** topic length first */
+        return 2;
+    }
+
+    uint32_t len = 2 + ((buf[0] << 8) | buf[1]) + (qos ? 2 : 0);
+
+    if (parser->Version < 5)
+    {
+        *known = 1;
+        return len;
+    }
+
+    /** mqtt 5 property length follows, one char at a time until it ends */
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        if (have < len + i + 1)
+        {
+            return len + i + 1;
+        }
+
+        if ((buf[len + i] & 128) == 0)
+        {
+            uint32_t pos = len;
+            uint32_t prop_len;
+
+            MQTT_Parser_Varint(buf, have, &pos, &prop_len);
+            *known = 1;
+            return pos + prop_len;
+        }
+    }
+
+    /** malformed, too long for buffer so body state counts it */
+    *known = 1;
+    return UINT32_MAX;
+}
+
+/**
+ * @brief collect variable header of a streamed publish in buffer, then start the stream
+ * @retval number of chars used
+ */
+static uint32_t MQTT_Parser_Publish_Header(MQTT_Parser_t *parser, const uint8_t *data, uint32_t len)
+{
+    uint8_t qos = (parser->Header >> 1) & 0x03;
+    uint32_t used = 0;
+    uint32_t header_len;
+
+    while (1)
+    {
+        uint8_t known;
+
+        header_len = MQTT_Parser_Publish_Header_Len(parser, qos, &known);
+
+        if (header_len > parser->Buffer_Size || header_len > parser->Remaining_Len)
+        {
+            /** can not stream it, body state truncates it or counts it as error */
+            parser->State = MQTT_PARSER_BODY;
+            return used;
+        }
+
+        if (known && parser->Body_Pos == header_len)
+        {
+            break;
+        }
+
+        uint32_t count = header_len - parser->Body_Pos;
+        if (count > len - used)
+        {
+            count = len - used;
+        }
+        if (count == 0)
+        {
+            /** wait for rest of header */
+            return used;
+        }
+
+        memcpy(&parser->Buffer[parser->Body_Pos], &data[used], count);
+        parser->Body_Pos += count;
+        used += count;
+    }
+
+    MQTT_Frame_t *frame = &parser->Stream_Frame;
+
+    memset(frame, 0, sizeof(MQTT_Frame_t));
+    frame->Header = parser->Header;
+    frame->Type = MQTT_PUBLISH;
+    frame->QOS = qos;
+    frame->Remaining_Len = parser->Remaining_Len;
+
+    uint32_t pos;
+    MQTT_Parser_Publish_Vars(parser, parser->Buffer, header_len, frame, &pos);
+
+    frame->Data_Len = parser->Remaining_Len - header_len;
+
+    parser->Stream_Offset = 0;
+    parser->Frame_Count++;
+
+    if (parser->Stream_Begin_CB != NULL)
+    {
+        parser->Stream_Begin_CB(parser->Ctx, frame);
+    }
+
+    parser->State = MQTT_PARSER_PUBLISH_DATA;
+
+    if (frame->Data_Len == 0)
+    {
+        /** empty payload, stream ends right here */
+        if (parser->Stream_End_CB != NULL)
+        {
+            parser->Stream_End_CB(parser->Ctx, frame);
+        }
+        parser->State = MQTT_PARSER_HEADER;
+    }
+
+    return used;
+}
+
+/**
+ * @brief feed received chars to decoder, callbacks are called for each packet completed by them
+ * @param data received chars
+ * @param len number of chars
+ * @retval number of chars consumed, always len, data is not referenced after return
+ */
+uint32_t MQTT_Parser_Feed(MQTT_Parser_t *parser, const uint8_t *data, uint32_t len)
+{
+    uint32_t pos = 0;
+
+    while (pos < len)
+    {
+        switch (parser->State)
+        {
+        case MQTT_PARSER_HEADER:
+        {
+            uint8_t ch = data[pos++];
+
+            if (ch == '\r' || ch == '\n')
+            {
+                /** never a valid fixed header, modem is sending text */
+                parser->Line_Len = 0;
+                parser->State = MQTT_PARSER_LINE;
+            }
+            else if (MQTT_Parser_Header_Valid(ch))
+            {
+                parser->Header = ch;
+                parser->Remaining_Len = 0;
+                parser->Length_Bytes = 0;
+                parser->State = MQTT_PARSER_LENGTH;
+            }
+            else
+            {
+                /** out of sync, skip until a valid header */
+                parser->Error_Count++;
+            }
+        }
+        break;
+
+        case MQTT_PARSER_LENGTH:
+        {
+            uint8_t ch = data[pos++];
+
+            parser->Remaining_Len |= (uint32_t)(ch & 127) << (7 * parser->Length_Bytes);
+            parser->Length_Bytes++;
+
+            if ((ch & 128) == 0)
+            {
+                parser->Body_Pos = 0;
+                if (parser->Remaining_Len == 0)
+                {
+                    MQTT_Parser_Emit(parser, NULL, 0, 0);
+                    parser->State = MQTT_PARSER_HEADER;
+                }
+                else if ((parser->Header >> 4) == MQTT_PUBLISH && parser->Remaining_Len > parser->Stream_Threshold)
+                {
+                    parser->State = MQTT_PARSER_PUBLISH_HEADER;
+                }
+                else
+                {
+                    parser->State = MQTT_PARSER_BODY;
+                }
+            }
+            else if (parser->Length_Bytes >= 4)
+            {
+                /** remaining length is at most 4 bytes */
+                parser->Error_Count++;
+                parser->State = MQTT_PARSER_HEADER;
+            }
+        }
+        break;
+
+        case MQTT_PARSER_BODY:
+        {
+            uint32_t count = parser->Remaining_Len - parser->Body_Pos;
+
+            if (count > len - pos)
+            {
+                count = len - pos;
+            }
+
+            if (parser->Body_Pos == 0 && count == parser->Remaining_Len)
+            {
+                /** whole body is in this chunk, decode it in place without copy */
+                MQTT_Parser_Emit(parser, &data[pos], count, 0);
+            }
+            else
+            {
+                /** body is split across feeds, assemble it in buffer */
+                if (parser->Body_Pos < parser->Buffer_Size)
+                {
+                    uint32_t copy = parser->Buffer_Size - parser->Body_Pos;
+                    if (copy > count)
+                    {
+                        copy = count;
+                    }
+                    memcpy(&parser->Buffer[parser->Body_Pos], &data[pos], copy);
+                }
+
+                if (parser->Body_Pos + count == parser->Remaining_Len)
+                {
+                    uint8_t truncated = parser->Remaining_Len > parser->Buffer_Size;
+                    MQTT_Parser_Emit(parser,
+                                     parser->Buffer,
+                                     truncated ? parser->Buffer_Size : parser->Remaining_Len,
+                                     truncated);
+                }
+            }
+
+            pos += count;
+            parser->Body_Pos += count;
+
+            if (parser->Body_Pos == parser->Remaining_Len)
+            {
+                parser->State = MQTT_PARSER_HEADER;
+            }
+        }
+        break;
+
+        case MQTT_PARSER_PUBLISH_HEADER:
+            pos += MQTT_Parser_Publish_Header(parser, &data[pos], len - pos);
+            break;
+
+        case MQTT_PARSER_PUBLISH_DATA:
+        {
+            MQTT_Frame_t *frame = &parser->Stream_Frame;
+            uint32_t count = frame->Data_Len - parser->Stream_Offset;
+
+            if (count > len - pos)
+            {
+                count = len - pos;
+            }
+
+            if (count > 0 && parser->Stream_Data_CB != NULL)
+            {
+                /** passed straight from fed chunk, never copied */
+                parser->Stream_Data_CB(parser->Ctx, frame, &data[pos], count, parser->Stream_Offset);
+            }
+
+            pos += count;
+            parser->Stream_Offset += count;
+
+            if (parser->Stream_Offset == frame->Data_Len)
+            {
+                if (parser->Stream_End_CB != NULL)
+                {
+                    parser->Stream_End_CB(parser->Ctx, frame);
+                }
+                parser->State = MQTT_PARSER_HEADER;
+            }
+        }
+        break;
+
+        case MQTT_PARSER_LINE:
+        {
+            uint8_t ch = data[pos];
+
+            if (ch == '\r' || ch == '\n')
+            {
+                pos++;
+                if (parser->Line_Len > 0)
+                {
+                    if (parser->Line_CB != NULL)
+                    {
+                        parser->Line_CB(parser->Ctx, parser->Line, parser->Line_Len);
+                    }
+                    parser->State = MQTT_PARSER_HEADER;
+                }
+            }
+            else if (parser->Line_Len == 0 && (!((ch >= 'A' && ch <= 'Z') || ch == '+') || MQTT_Parser_Header_Valid(ch)))
+            {
+                /** modem lines start with a capital or '+', else this is a packet after a stray line end,
+                 *  'P' is also PUBREC and goes to packet, no line handled in transparent mode starts with it */
+                parser->State = MQTT_PARSER_HEADER;
+            }
+            else
+            {
+                pos++;
+                if (parser->Line_Len < MQTT_PARSER_LINE_MAX - 1)
+                {
+                    parser->Line[parser->Line_Len++] = ch;
+                    parser->Line[parser->Line_Len] = '\0';
+                }
+            }
+        }
+        break;
+        }
+    }
+
+    return pos;
+}
@@ -0,0 +1,126 @@
+#ifndef SIM800_MQTT_PARSER_H_
+#define SIM800_MQTT_PARSER_H_
+
+/** standard includes */
+#include <stdint.h>
+
+/** mqtt 3.1.1 and 5 control packet types, upper nibble of fixed header */
+typedef enum MQTT_Packet_Type_t
+{
+    MQTT_CONNECT = 1,
+    MQTT_CONNACK,
+    MQTT_PUBLISH,
+    MQTT_PUBACK,
+    MQTT_PUBREC,
+    MQTT_PUBREL,
+    MQTT_PUBCOMP,
+    MQTT_SUBSCRIBE,
+    MQTT_SUBACK,
+    MQTT_UNSUBSCRIBE,
+    MQTT_UNSUBACK,
+    MQTT_PINGREQ,
+    MQTT_PINGRESP,
+    MQTT_DISCONNECT,
+} MQTT_Packet_Type_t;
+
+/**
+ * complete control packet, pointers are only valid during frame callback
+ */
+typedef struct MQTT_Frame_t
+{
+    uint8_t Header; /** fixed header byte */
+    uint8_t Type;   /** @see MQTT_Packet_Type_t */
+    uint8_t QOS;    /** publish only */
+    uint8_t Truncated; /** body was longer than parser buffer, end of Data is missing */
+    uint16_t Packet_ID; /** 0 if packet has none */
+    uint32_t Remaining_Len;
+
+    const char *Topic; /** publish only, not '\0' terminated */
+    uint16_t Topic_Len;
+
+    /** rest of packet after variable header: publish payload, CONNACK flags and code, SUBACK codes */
+    const uint8_t *Data;
+    uint32_t Data_Len;
+
+    /** mqtt 5 only */
+    uint8_t Reason; /** reason code of PUBACK, PUBREC, PUBREL, PUBCOMP, CONNACK and DISCONNECT, 0 if omitted */
+    const uint8_t *Properties; /** property block without its length, NULL if packet has none */
+    uint32_t Properties_Len;
+} MQTT_Frame_t;
+
+typedef void (*MQTT_Parser_Frame_CB_t)(void *ctx, const MQTT_Frame_t *frame);
+
+/** text line received while waiting for a packet, e.g. "CLOSED" from modem */
+typedef void (*MQTT_Parser_Line_CB_t)(void *ctx, const char *line, uint32_t len);
+
+/**
+ * part of a streamed publish payload
+ * @param frame publish header, Data_Len is total payload length
+ * @param offset position of data in payload
+ */
+typedef void (*MQTT_Parser_Data_CB_t)(void *ctx, const MQTT_Frame_t *frame, const uint8_t *data, uint32_t len, uint32_t offset);
+
+typedef enum MQTT_Parser_State_t
+{
+    MQTT_PARSER_HEADER,
+    MQTT_PARSER_LENGTH,
+    MQTT_PARSER_BODY,
+    MQTT_PARSER_LINE,
+    MQTT_PARSER_PUBLISH_HEADER, /** variable header of streamed publish */
+    MQTT_PARSER_PUBLISH_DATA,   /** payload of streamed publish */
+} MQTT_Parser_State_t;
+
+#define MQTT_PARSER_LINE_MAX 16
+
+/**
+ * incremental decoder, bytes can be fed in chunks of any size
+ * state is kept between calls, so packets may be split anywhere
+ */
+typedef struct MQTT_Parser_t
+{
+    MQTT_Parser_State_t State;
+
+    uint8_t Header;
+    uint8_t Length_Bytes;
+    uint8_t Version; /** protocol level, 5 adds reason codes and properties to variable headers */
+    uint32_t Remaining_Len;
+    uint32_t Body_Pos; /** body chars received so far */
+
+    uint8_t *Buffer; /** holds body split across feeds */
+    uint32_t Buffer_Size;
+
+    char Line[MQTT_PARSER_LINE_MAX];
+    uint32_t Line_Len;
+
+    MQTT_Parser_Frame_CB_t Frame_CB;
+    MQTT_Parser_Line_CB_t Line_CB;
+    void *Ctx;
+
+    /** publishes longer than threshold are streamed instead of buffered */
+    uint32_t Stream_Threshold;
+    MQTT_Parser_Frame_CB_t Stream_Begin_CB;
+    MQTT_Parser_Data_CB_t Stream_Data_CB;
+    MQTT_Parser_Frame_CB_t Stream_End_CB;
+    MQTT_Frame_t Stream_Frame;
+    uint32_t Stream_Offset;
+
+    uint32_t Frame_Count;
+    uint32_t Error_Count; /** malformed headers skipped */
+} MQTT_Parser_t;
+
+void MQTT_Parser_Init(MQTT_Parser_t *parser,
+                      uint8_t *buffer,
+                      uint32_t buffer_size,
+                      MQTT_Parser_Frame_CB_t frame_cb,
+                      MQTT_Parser_Line_CB_t line_cb,
+                      void *ctx);
+void MQTT_Parser_Reset(MQTT_Parser_t *parser);
+void MQTT_Parser_Set_Version(MQTT_Parser_t *parser, uint8_t version);
+void MQTT_Parser_Set_Stream(MQTT_Parser_t *parser,
+                            uint32_t threshold,
+                            MQTT_Parser_Frame_CB_t begin_cb,
+                            MQTT_Parser_Data_CB_t data_cb,
+                            MQTT_Parser_Frame_CB_t end_cb);
+uint32_t MQTT_Parser_Feed(MQTT_Parser_t *parser, const uint8_t *data, uint32_t len);
+
+#endif /* SIM800_MQTT_PARSER_H_ */
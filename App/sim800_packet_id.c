@@ -0,0 +1,138 @@
+/** standard includes */
+#include <stdint.h>
+#include <string.h>
+
+/** app includes */
+#include "sim800_packet_id.h"
+
+/**
+ * @brief init allocator with all ids free
+ */
+void Packet_ID_Init(Packet_ID_t *ids)
+{
+    memset(ids, 0, sizeof(Packet_ID_t));
+
+    /** 0 is not a valid packet id */
+    ids->Used[0] = 1;
+    ids->Next = 1;
+}
+
+/**
+ * @brief mark id used and keep summary of full words
+ */
+static void Packet_ID_Set(Packet_ID_t *ids, uint16_t id)
+{
+    uint16_t word = id >> 5;
+
+    ids->Used[word] |= 1u << (id & 31);
+    if (ids->Used[word] == UINT32_MAX)
+    {
+        ids->Full[word >> 5] |= 1u << (word & 31);
+    }
+}
+
+/**
+ * @brief find first word at or after start that has a free id
+ * @retval index of word, PACKET_ID_WORDS if all words after start are full
+ */
+static uint32_t Packet_ID_Free_Word(const Packet_ID_t *ids, uint32_t start)
+{
+    if (start >= PACKET_ID_WORDS)
+    {
+        /** search started after last word */
+        return PACKET_ID_WORDS;
+    }
+
+    uint32_t group = start >> 5;
+    uint32_t free = ~ids->Full[group] & (UINT32_MAX << (start & 31));
+
+    while (free == 0)
+    {
+        if (++group >= PACKET_ID_WORDS / 32)
+        {
+            return PACKET_ID_WORDS;
+        }
+        free = ~ids->Full[group];
+    }
+
+    return (group << 5) + __builtin_ctz(free);
+}
+
+/**
+ * @brief take next free id after the one handed out last
+ * @retval id, 0 if all 65535 ids are in use
+ */
+uint16_t Packet_ID_Alloc(Packet_ID_t *ids)
+{
+    uint32_t next = ids->Next;
+    uint32_t free = ~ids->Used[next >> 5] & (UINT32_MAX << (next & 31));
+
+    if (ids->Count == UINT16_MAX)
+    {
+        return 0;
+    }
+
+    if (free == 0)
+    {
+        /** rest of word is used, go by summary and wrap around once */
+        uint32_t word = Packet_ID_Free_Word(ids, (next >> 5) + 1);
+
+        if (word == PACKET_ID_WORDS)
+        {
+            word = Packet_ID_Free_Word(ids, 0);
+        }
+
+        next = word << 5;
+        free = ~ids->Used[word];
+    }
+
+    uint16_t id = (next & ~31u) + __builtin_ctz(free);
+
+    Packet_ID_Set(ids, id);
+    ids->Count++;
+    ids->Next = id + 1; /** wraps to 0, which is always used */
+
+    return id;
+}
+
+/**
+ * @brief take an id chosen by caller
+ * @retval return 1 if it was free, 0 if it is 0 or in use
+ */
+uint8_t Packet_ID_Take(Packet_ID_t *ids, uint16_t id)
+{
+    if (Packet_ID_Is_Used(ids, id))
+    {
+        return 0;
+    }
+
+    Packet_ID_Set(ids, id);
+    ids->Count++;
+
+    return 1;
+}
+
+/**
+ * @brief give id back, releasing a free id or 0 is ignored
+ */
+void Packet_ID_Release(Packet_ID_t *ids, uint16_t id)
+{
+    uint16_t word = id >> 5;
+
+    if (id == 0 || !Packet_ID_Is_Used(ids, id))
+    {
+        return;
+    }
+
+    ids->Used[word] &= ~(1u << (id & 31));
+    ids->Full[word >> 5] &= ~(1u << (word & 31));
+    ids->Count--;
+}
+
+/**
+ * @brief check if id is in use, 0 always is
+ */
+uint8_t Packet_ID_Is_Used(const Packet_ID_t *ids, uint16_t id)
+{
+    return (ids->Used[id >> 5] >> (id & 31)) & 1;
+}
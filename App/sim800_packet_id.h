@@ -0,0 +1,28 @@
+#ifndef SIM800_PACKET_ID_H_
+#define SIM800_PACKET_ID_H_
+
+/** standard includes */
+#include <stdint.h>
+
+#define PACKET_ID_WORDS 2048 /** one bit for each id, 0 to 65535 */
+
+/**
+ * allocator of mqtt packet ids 1 to 65535
+ * ids are handed out from a rolling counter, so a released id is not reused right away,
+ * a summary of full words lets allocation skip 32 used ids at a time and 1024 per summary word
+ */
+typedef struct Packet_ID_t
+{
+    uint32_t Used[PACKET_ID_WORDS];     /** bit set if id is in use, id 0 is always set */
+    uint32_t Full[PACKET_ID_WORDS / 32]; /** bit set if word of Used is all ones */
+    uint16_t Next;                       /** allocation starts here */
+    uint16_t Count;                      /** ids in use, not counting 0 */
+} Packet_ID_t;
+
+void Packet_ID_Init(Packet_ID_t *ids);
+uint16_t Packet_ID_Alloc(Packet_ID_t *ids);
+uint8_t Packet_ID_Take(Packet_ID_t *ids, uint16_t id);
+void Packet_ID_Release(Packet_ID_t *ids, uint16_t id);
+uint8_t Packet_ID_Is_Used(const Packet_ID_t *ids, uint16_t id);
+
+#endif /* SIM800_PACKET_ID_H_ */
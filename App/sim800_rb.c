@@ -0,0 +1,280 @@
+/** standard includes */
+#include <stdint.h>
+#include <string.h>
+
+/** app includes */
+#include "sim800_rb.h"
+
+#define RB_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define RB_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/**
+ * @brief init ring buffer
+ * @param rb ring buffer handle
+ * @param storage buffer used to hold data
+ * @param size size of storage, must be power of two
+ * @retval return 1 if success
+ */
+uint8_t RB_Init(RB_t *rb, uint8_t *storage, uint32_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+    {
+        return 0;
+    }
+
+    rb->Storage = storage;
+    rb->Size = size;
+    rb->Mask = size - 1;
+    rb->Overrun_Count = 0;
+
+    RB_Reset(rb);
+
+    return 1;
+}
+
+/**
+ * @brief discard all data
+ * @note not safe while producer or consumer is active
+ */
+void RB_Reset(RB_t *rb)
+{
+    rb->Head = 0;
+    rb->Tail = 0;
+}
+
+/**
+ * @brief number of chars that can be written without overwriting unread data
+ * @note producer side
+ */
+uint32_t RB_Get_Free(RB_t *rb)
+{
+    uint32_t used = rb->Head - RB_LOAD_ACQUIRE(&rb->Tail);
+
+    if (used >= rb->Size)
+    {
+        return 0;
+    }
+
+    return rb->Size - used;
+}
+
+/**
+ * @brief write a char to ring buffer
+ * @retval return 1 if char is written, 0 if buffer is full
+ * @note producer side
+ */
+uint8_t RB_Put_Char(RB_t *rb, uint8_t data)
+{
+    return RB_Put_Chars(rb, &data, 1);
+}
+
+/**
+ * @brief write chars to ring buffer, chars that do not fit are dropped and counted as overrun
+ * @param data input buffer
+ * @param count number of chars to write
+ * @retval number of chars written
+ * @note producer side
+ */
+uint32_t RB_Put_Chars(RB_t *rb, const uint8_t *data, uint32_t count)
+{
+    uint32_t free = RB_Get_Free(rb);
+
+    if (count > free)
+    {
+        rb->Overrun_Count += count - free;
+        count = free;
+    }
+
+    RB_Write(rb, 0, data, count);
+
+    RB_STORE_RELEASE(&rb->Head, rb->Head + count);
+
+    return count;
+}
+
+/**
+ * @brief write chars after head without publishing them to consumer
+ *        used to assemble data in place, publish it later with @see RB_Produce
+ * @param offset position relative to current head
+ * @param data input buffer
+ * @param count number of chars to write
+ * @note producer side, caller must check space with @see RB_Get_Free
+ */
+void RB_Write(RB_t *rb, uint32_t offset, const uint8_t *data, uint32_t count)
+{
+    uint32_t index = (rb->Head + offset) & rb->Mask;
+    uint32_t first = rb->Size - index;
+
+    if (first > count)
+    {
+        first = count;
+    }
+
+    memcpy(&rb->Storage[index], data, first);
+    memcpy(&rb->Storage[0], data + first, count - first);
+}
+
+/**
+ * @brief publish chars that were written directly to storage (e.g. by dma)
+ * @param count number of chars written after previous head position
+ * @note producer side, chars written over unread data are counted as overrun
+ */
+void RB_Produce(RB_t *rb, uint32_t count)
+{
+    uint32_t head = rb->Head + count;
+    uint32_t used = head - RB_LOAD_ACQUIRE(&rb->Tail);
+
+    if (used > rb->Size)
+    {
+        rb->Overrun_Count += used - rb->Size;
+    }
+
+    RB_STORE_RELEASE(&rb->Head, head);
+}
+
+/**
+ * @brief number of unread chars
+ * @note consumer side, if producer has overwritten unread data all pending data is dropped
+ */
+uint32_t RB_Get_Count(RB_t *rb)
+{
+    uint32_t head = RB_LOAD_ACQUIRE(&rb->Head);
+    uint32_t count = head - rb->Tail;
+
+    if (count > rb->Size)
+    {
+        /** unread data is partly overwritten, resync with producer */
+        RB_STORE_RELEASE(&rb->Tail, head);
+        count = 0;
+    }
+
+    return count;
+}
+
+/**
+ * @brief read a char
+ * @retval return -1 if no char is available
+ * @note consumer side
+ */
+int RB_Get_Char(RB_t *rb)
+{
+    if (RB_Get_Count(rb) == 0)
+    {
+        return -1;
+    }
+
+    uint32_t tail = rb->Tail;
+    uint8_t temp = rb->Storage[tail & rb->Mask];
+
+    RB_STORE_RELEASE(&rb->Tail, tail + 1);
+
+    return temp;
+}
+
+/**
+ * @brief peek a char without removing it
+ * @retval return -1 if no char is available
+ * @note consumer side
+ */
+int RB_Peek_Char(RB_t *rb)
+{
+    if (RB_Get_Count(rb) == 0)
+    {
+        return -1;
+    }
+
+    return rb->Storage[rb->Tail & rb->Mask];
+}
+
+/**
+ * @brief read up to count chars
+ * @param buffer destination
+ * @param count max number of chars to read
+ * @retval number of chars read
+ * @note consumer side
+ */
+uint32_t RB_Get_Chars(RB_t *rb, uint8_t *buffer, uint32_t count)
+{
+    uint32_t available = RB_Get_Count(rb);
+
+    if (count > available)
+    {
+        count = available;
+    }
+
+    uint32_t tail = rb->Tail;
+    uint32_t index = tail & rb->Mask;
+    uint32_t first = rb->Size - index;
+
+    if (first > count)
+    {
+        first = count;
+    }
+
+    memcpy(buffer, &rb->Storage[index], first);
+    memcpy(buffer + first, &rb->Storage[0], count - first);
+
+    RB_STORE_RELEASE(&rb->Tail, tail + count);
+
+    return count;
+}
+
+/**
+ * @brief drop all unread chars
+ * @note consumer side
+ */
+void RB_Flush(RB_t *rb)
+{
+    RB_STORE_RELEASE(&rb->Tail, RB_LOAD_ACQUIRE(&rb->Head));
+}
+
+/**
+ * @brief get unread data in place, without copying
+ *        data is split in two spans if it wraps around end of storage
+ * @param spans filled with up to two regions, unused span has Len 0
+ * @retval total number of unread chars
+ * @note consumer side, data stays valid until it is released with @see RB_Consume
+ */
+uint32_t RB_Peek_Spans(RB_t *rb, RB_Span_t spans[2])
+{
+    uint32_t count = RB_Get_Count(rb);
+    uint32_t index = rb->Tail & rb->Mask;
+    uint32_t first = rb->Size - index;
+
+    if (first > count)
+    {
+        first = count;
+    }
+
+    spans[0].Data = &rb->Storage[index];
+    spans[0].Len = first;
+    spans[1].Data = &rb->Storage[0];
+    spans[1].Len = count - first;
+
+    return count;
+}
+
+/**
+ * @brief release chars obtained with @see RB_Peek_Spans
+ * @param count number of chars to release, clipped to unread count
+ * @note consumer side
+ */
+void RB_Consume(RB_t *rb, uint32_t count)
+{
+    uint32_t available = RB_Get_Count(rb);
+
+    if (count > available)
+    {
+        count = available;
+    }
+
+    RB_STORE_RELEASE(&rb->Tail, rb->Tail + count);
+}
+
+/**
+ * @brief total number of chars lost due to overrun
+ */
+uint32_t RB_Get_Overrun_Count(RB_t *rb)
+{
+    return RB_LOAD_ACQUIRE(&rb->Overrun_Count);
+}
@@ -0,0 +1,52 @@
+#ifndef SIM800_RB_H_
+#define SIM800_RB_H_
+
+/** standard includes */
+#include <stdint.h>
+
+/**
+ * single producer single consumer ring buffer
+ * Head and Tail are free running counters, index into storage is (counter & Mask)
+ * Head is only written by producer, Tail is only written by consumer
+ */
+typedef struct RB_t
+{
+    uint8_t *Storage;
+    uint32_t Size;          /** must be power of two */
+    uint32_t Mask;          /** Size - 1 */
+    uint32_t Head;          /** total chars written */
+    uint32_t Tail;          /** total chars read */
+    uint32_t Overrun_Count; /** total chars lost because consumer was too slow */
+} RB_t;
+
+/**
+ * contiguous region of ring buffer storage
+ */
+typedef struct RB_Span_t
+{
+    uint8_t *Data;
+    uint32_t Len;
+} RB_Span_t;
+
+uint8_t RB_Init(RB_t *rb, uint8_t *storage, uint32_t size);
+void RB_Reset(RB_t *rb);
+
+/** producer side */
+uint32_t RB_Get_Free(RB_t *rb);
+uint8_t RB_Put_Char(RB_t *rb, uint8_t data);
+uint32_t RB_Put_Chars(RB_t *rb, const uint8_t *data, uint32_t count);
+void RB_Write(RB_t *rb, uint32_t offset, const uint8_t *data, uint32_t count);
+void RB_Produce(RB_t *rb, uint32_t count);
+
+/** consumer side */
+uint32_t RB_Get_Count(RB_t *rb);
+int RB_Get_Char(RB_t *rb);
+int RB_Peek_Char(RB_t *rb);
+uint32_t RB_Get_Chars(RB_t *rb, uint8_t *buffer, uint32_t count);
+void RB_Flush(RB_t *rb);
+uint32_t RB_Peek_Spans(RB_t *rb, RB_Span_t spans[2]);
+void RB_Consume(RB_t *rb, uint32_t count);
+
+uint32_t RB_Get_Overrun_Count(RB_t *rb);
+
+#endif /* SIM800_RB_H_ */
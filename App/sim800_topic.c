@@ -0,0 +1,436 @@
+/** standard includes */
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+/** app includes */
+#include "sim800_topic.h"
+
+/**
+ * @brief FNV-1a hash of a topic level
+ */
+static uint32_t Topic_Hash(const char *level, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        hash ^= (uint8_t)level[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief get length of level starting at str
+ * @param last set to 1 if it is the last level
+ */
+static uint32_t Topic_Level_Len(const char *str, uint8_t *last)
+{
+    const char *end = strchr(str, '/');
+
+    *last = (end == NULL);
+
+    return (end != NULL) ? (uint32_t)(end - str) : strlen(str);
+}
+
+/**
+ * @brief get length of level starting at str within a topic name that is not '\0' terminated
+ * @param len chars left in topic name
+ * @param last set to 1 if it is the last level
+ */
+static uint32_t Topic_Name_Level_Len(const char *str, uint32_t len, uint8_t *last)
+{
+    const char *end = memchr(str, '/', len);
+
+    *last = (end == NULL);
+
+    return (end != NULL) ? (uint32_t)(end - str) : len;
+}
+
+/**
+ * @brief init empty trie
+ */
+void Topic_Trie_Init(Topic_Trie_t *trie)
+{
+    for (uint8_t i = 0; i < TOPIC_NODE_MAX; i++)
+    {
+        trie->Node[i].Sibling = (i + 1 < TOPIC_NODE_MAX) ? i + 1 : TOPIC_NONE;
+    }
+
+    trie->Root = TOPIC_NONE;
+    trie->Free = 0;
+}
+
+/**
+ * @brief check topic filter syntax, wildcards must take a whole level and '#' must be last
+ * @retval return 1 if filter is valid
+ */
+uint8_t Topic_Filter_Valid(const char *filter)
+{
+    uint8_t last = 0;
+
+    if (filter == NULL || filter[0] == '\0')
+    {
+        return 0;
+    }
+
+    while (!last)
+    {
+        uint32_t len = Topic_Level_Len(filter, &last);
+        const char *wild = memchr(filter, '+', len);
+
+        if (wild == NULL)
+        {
+            wild = memchr(filter, '#', len);
+            if (wild != NULL && !last)
+            {
+                return 0;
+            }
+        }
+
+        if (wild != NULL && len != 1)
+        {
+            return 0;
+        }
+
+        filter += len + 1;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief check if topic matches filter, filter must be valid
+ * @param topic topic name, not '\0' terminated
+ * @param topic_len chars in topic name
+ * @retval return 1 on match
+ */
+uint8_t Topic_Filter_Match(const char *filter, const char *topic, uint32_t topic_len)
+{
+    if (topic_len > 0 && topic[0] == '$' && (filter[0] == '+' || filter[0] == '#'))
+    {
+        /** topics starting with '$' are not matched by leading wildcards */
+        return 0;
+    }
+
+    while (1)
+    {
+        uint8_t filter_last;
+        uint8_t topic_last;
+        uint32_t filter_len = Topic_Level_Len(filter, &filter_last);
+        uint32_t level_len = Topic_Name_Level_Len(topic, topic_len, &topic_last);
+
+        if (filter[0] == '#')
+        {
+            return 1;
+        }
+
+        if (!(filter[0] == '+' && filter_len == 1) &&
+            (filter_len != level_len || memcmp(filter, topic, level_len) != 0))
+        {
+            return 0;
+        }
+
+        if (topic_last)
+        {
+            /** "a/#" also matches "a" */
+            return filter_last || strcmp(filter + filter_len, "/#") == 0;
+        }
+
+        if (filter_last)
+        {
+            return 0;
+        }
+
+        filter += filter_len + 1;
+        topic += level_len + 1;
+        topic_len -= level_len + 1;
+    }
+}
+
+/**
+ * @brief find node of a level in sibling list
+ */
+static uint8_t Topic_Find(Topic_Trie_t *trie, uint8_t node, uint8_t type, uint32_t hash)
+{
+    while (node != TOPIC_NONE && (trie->Node[node].Type != type || trie->Node[node].Hash != hash))
+    {
+        node = trie->Node[node].Sibling;
+    }
+
+    return node;
+}
+
+/**
+ * @brief get type and hash of filter level
+ */
+static uint8_t Topic_Level_Type(const char *level, uint32_t len, uint32_t *hash)
+{
+    *hash = 0;
+
+    if (len == 1 && level[0] == '+')
+    {
+        return TOPIC_PLUS;
+    }
+    if (len == 1 && level[0] == '#')
+    {
+        return TOPIC_HASH;
+    }
+
+    *hash = Topic_Hash(level, len);
+
+    return TOPIC_LEVEL;
+}
+
+/**
+ * @brief give back levels added by a failed insert
+ * @param link link to first added level, later ones are its only descendants
+ */
+static void Topic_Free_Added(Topic_Trie_t *trie, uint8_t *link)
+{
+    uint8_t node = *link;
+
+    *link = trie->Node[node].Sibling;
+
+    while (node != TOPIC_NONE)
+    {
+        uint8_t child = trie->Node[node].Child;
+
+        trie->Node[node].Sibling = trie->Free;
+        trie->Free = node;
+        node = child;
+    }
+}
+
+/**
+ * @brief add topic filter
+ * @param filter topic filter, may contain '+' and '#'
+ * @param sub subscription reported by @see Topic_Trie_Match, must not be TOPIC_NONE
+ * @retval return 1 if added, 0 if filter is invalid, has more than TOPIC_DEPTH_MAX levels,
+ *         is already added or trie is full
+ */
+uint8_t Topic_Trie_Insert(Topic_Trie_t *trie, const char *filter, uint8_t sub)
+{
+    uint8_t *link = &trie->Root;
+    uint8_t *added = NULL; /** link to first level added by this call */
+    uint8_t node = TOPIC_NONE;
+    uint8_t depth = 0;
+    uint8_t last = 0;
+
+    if (sub == TOPIC_NONE || !Topic_Filter_Valid(filter))
+    {
+        return 0;
+    }
+
+    while (!last)
+    {
+        uint32_t hash;
+        uint32_t len = Topic_Level_Len(filter, &last);
+        uint8_t type = Topic_Level_Type(filter, len, &hash);
+
+        node = Topic_Find(trie, *link, type, hash);
+
+        if (depth++ >= TOPIC_DEPTH_MAX || (node == TOPIC_NONE && trie->Free == TOPIC_NONE))
+        {
+            /** deeper than @see Topic_Trie_Remove can go, or trie is full, give back levels added so far */
+            if (added != NULL)
+            {
+                Topic_Free_Added(trie, added);
+            }
+            return 0;
+        }
+
+        if (node == TOPIC_NONE)
+        {
+            if (added == NULL)
+            {
+                added = link;
+            }
+
+            node = trie->Free;
+            trie->Free = trie->Node[node].Sibling;
+
+            trie->Node[node].Hash = hash;
+            trie->Node[node].Type = type;
+            trie->Node[node].Child = TOPIC_NONE;
+            trie->Node[node].Sub = TOPIC_NONE;
+            trie->Node[node].Sibling = *link;
+            *link = node;
+        }
+
+        link = &trie->Node[node].Child;
+        filter += len + 1;
+    }
+
+    if (trie->Node[node].Sub != TOPIC_NONE)
+    {
+        return 0;
+    }
+
+    trie->Node[node].Sub = sub;
+
+    return 1;
+}
+
+/**
+ * @brief remove topic filter, levels no more used by other filters are freed
+ * @retval return 1 if removed
+ */
+uint8_t Topic_Trie_Remove(Topic_Trie_t *trie, const char *filter)
+{
+    uint8_t *path[TOPIC_DEPTH_MAX];
+    uint8_t depth = 0;
+    uint8_t *link = &trie->Root;
+    uint8_t last = 0;
+
+    if (!Topic_Filter_Valid(filter))
+    {
+        return 0;
+    }
+
+    while (!last)
+    {
+        uint32_t hash;
+        uint32_t len = Topic_Level_Len(filter, &last);
+        uint8_t type = Topic_Level_Type(filter, len, &hash);
+        uint8_t node;
+
+        if (depth >= TOPIC_DEPTH_MAX)
+        {
+            return 0;
+        }
+
+        /** keep link to node, so it can be unlinked */
+        while (*link != TOPIC_NONE && (trie->Node[*link].Type != type || trie->Node[*link].Hash != hash))
+        {
+            link = &trie->Node[*link].Sibling;
+        }
+
+        node = *link;
+        if (node == TOPIC_NONE)
+        {
+            return 0;
+        }
+
+        path[depth++] = link;
+        link = &trie->Node[node].Child;
+        filter += len + 1;
+    }
+
+    uint8_t node = *path[depth - 1];
+
+    if (trie->Node[node].Sub == TOPIC_NONE)
+    {
+        return 0;
+    }
+
+    trie->Node[node].Sub = TOPIC_NONE;
+
+    /** free levels from the end while they lead to nothing */
+    while (depth > 0)
+    {
+        link = path[--depth];
+        node = *link;
+
+        if (trie->Node[node].Child != TOPIC_NONE || trie->Node[node].Sub != TOPIC_NONE)
+        {
+            break;
+        }
+
+        *link = trie->Node[node].Sibling;
+        trie->Node[node].Sibling = trie->Free;
+        trie->Free = node;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief report subscriptions of '#' nodes in sibling list
+ */
+static uint32_t Topic_Match_Hash(Topic_Trie_t *trie, uint8_t node, Topic_Match_CB_t cb, void *ctx)
+{
+    uint32_t matches = 0;
+
+    for (; node != TOPIC_NONE; node = trie->Node[node].Sibling)
+    {
+        if (trie->Node[node].Type == TOPIC_HASH && trie->Node[node].Sub != TOPIC_NONE)
+        {
+            cb(ctx, trie->Node[node].Sub);
+            matches++;
+        }
+    }
+
+    return matches;
+}
+
+/**
+ * @brief match one topic level against sibling list, recurse into next level
+ * @param left chars left in topic name from level on
+ * @param first 1 for top level, where '$' topics are not matched by wildcards
+ */
+static uint32_t Topic_Match_Level(Topic_Trie_t *trie,
+                                  uint8_t node,
+                                  const char *level,
+                                  uint32_t left,
+                                  uint8_t first,
+                                  Topic_Match_CB_t cb,
+                                  void *ctx)
+{
+    uint8_t last;
+    uint32_t len = Topic_Name_Level_Len(level, left, &last);
+    uint32_t hash = Topic_Hash(level, len);
+    uint8_t wild = !(first && len > 0 && level[0] == '$');
+    uint32_t matches = 0;
+
+    for (; node != TOPIC_NONE; node = trie->Node[node].Sibling)
+    {
+        Topic_Node_t *n = &trie->Node[node];
+
+        if (n->Type == TOPIC_HASH)
+        {
+            if (wild && n->Sub != TOPIC_NONE)
+            {
+                cb(ctx, n->Sub);
+                matches++;
+            }
+            continue;
+        }
+
+        if ((n->Type == TOPIC_PLUS && !wild) || (n->Type == TOPIC_LEVEL && n->Hash != hash))
+        {
+            continue;
+        }
+
+        if (last)
+        {
+            if (n->Sub != TOPIC_NONE)
+            {
+                cb(ctx, n->Sub);
+                matches++;
+            }
+            /** "a/#" also matches "a" */
+            matches += Topic_Match_Hash(trie, n->Child, cb, ctx);
+        }
+        else
+        {
+            matches += Topic_Match_Level(trie, n->Child, level + len + 1, left - len - 1, 0, cb, ctx);
+        }
+    }
+
+    return matches;
+}
+
+/**
+ * @brief find all filters matching a topic
+ * @param topic topic name, not '\0' terminated, e.g. in place in a received packet
+ * @param topic_len chars in topic name
+ * @param cb called for each matching subscription, confirm it with @see Topic_Filter_Match
+ * @retval number of matches
+ */
+uint32_t Topic_Trie_Match(Topic_Trie_t *trie, const char *topic, uint32_t topic_len, Topic_Match_CB_t cb, void *ctx)
+{
+    return Topic_Match_Level(trie, trie->Root, topic, topic_len, 1, cb, ctx);
+}
@@ -0,0 +1,53 @@
+#ifndef SIM800_TOPIC_H_
+#define SIM800_TOPIC_H_
+
+/** standard includes */
+#include <stdint.h>
+
+#define TOPIC_NODE_MAX 64  /** total topic levels of all filters, max 254 */
+#define TOPIC_DEPTH_MAX 16 /** max levels in a filter */
+#define TOPIC_NONE 0xFF
+
+typedef enum Topic_Node_Type_t
+{
+    TOPIC_LEVEL, /** literal level */
+    TOPIC_PLUS,  /** '+' single level wildcard */
+    TOPIC_HASH,  /** '#' multi level wildcard, always last */
+} Topic_Node_Type_t;
+
+/**
+ * one level of one or more topic filters
+ * levels are kept as hash only, so a match must be confirmed with @see Topic_Filter_Match
+ */
+typedef struct Topic_Node_t
+{
+    uint32_t Hash;   /** FNV-1a of level name */
+    uint8_t Type;    /** @see Topic_Node_Type_t */
+    uint8_t Child;   /** first node of next level */
+    uint8_t Sibling; /** next node of same level, next free node if unused */
+    uint8_t Sub;     /** subscription ending at this level */
+} Topic_Node_t;
+
+/**
+ * trie of topic filters, matching a topic costs time proportional to its depth
+ * not to the number of filters
+ */
+typedef struct Topic_Trie_t
+{
+    Topic_Node_t Node[TOPIC_NODE_MAX];
+    uint8_t Root; /** first node of top level */
+    uint8_t Free; /** first unused node */
+} Topic_Trie_t;
+
+/** called for each subscription matching a topic */
+typedef void (*Topic_Match_CB_t)(void *ctx, uint8_t sub);
+
+void Topic_Trie_Init(Topic_Trie_t *trie);
+uint8_t Topic_Trie_Insert(Topic_Trie_t *trie, const char *filter, uint8_t sub);
+uint8_t Topic_Trie_Remove(Topic_Trie_t *trie, const char *filter);
+uint32_t Topic_Trie_Match(Topic_Trie_t *trie, const char *topic, uint32_t topic_len, Topic_Match_CB_t cb, void *ctx);
+
+uint8_t Topic_Filter_Valid(const char *filter);
+uint8_t Topic_Filter_Match(const char *filter, const char *topic, uint32_t topic_len);
+
+#endif /* SIM800_TOPIC_H_ */
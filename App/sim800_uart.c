@@ -9,232 +9,486 @@
 
 /** app includes */
 #include "sim800_uart.h"
+#include "sim800_rb.h"
 #include "sim800_mqtt.h"
 
-#define USE_UART_RX_DMA 0
-
 /** uart used for comm with sim800 */
 UART_HandleTypeDef *SIM800_UART = &huart3;
 
 /** rx ring buffer data reception from sim800 */
-#define RB_STORAGE_SIZE 1500
+/** written in background by uart rx dma (DMA1_Stream1) in circular mode */
+#define RB_STORAGE_SIZE 2048 /** must be power of two */
 static uint8_t RB_Storage[RB_STORAGE_SIZE];
-static uint32_t RB_Read_Index;
-static volatile uint32_t RB_Write_Index;
-static volatile uint8_t RB_Full_Flag;
+static RB_t RX_RB;
+
+/** last published dma write position in RB_Storage */
+static uint32_t RX_DMA_Index;
+
+/** set by uart error isr when rx dma was restarted, chars before RX_Resync_Head are dropped by consumer */
+static volatile uint8_t RX_Resync;
+static uint32_t RX_Resync_Head;
+static uint32_t RX_Resync_Valid; /** head before skipped part of storage */
+/** chars received before an error that were dropped on resync, written by consumer only */
+static uint32_t RX_Resync_Dropped;
+
+/** tx ring buffer data transmission to sim800 */
+/** packets are assembled in place and drained in background by uart tx dma (DMA1_Stream3) */
+#define TX_RB_STORAGE_SIZE 2048 /** must be power of two */
+static uint8_t TX_RB_Storage[TX_RB_STORAGE_SIZE];
+static RB_t TX_RB;
 
 /**
- * @brief Init uart used for sim800
+ * tx dma works through a queue of descriptors, each one is either a run of chars
+ * in tx ring buffer (Data is NULL) or a caller owned buffer sent without copy
  */
-void SIM800_UART_Init(void)
+typedef struct TX_Desc_t
 {
-    /** configured in cube @see usart.c*/
+    const uint8_t *Data;
+    uint32_t Len;
+    SIM800_UART_Release_CB_t Release; /** called when caller owned buffer is sent */
+    void *Ctx;
+} TX_Desc_t;
 
-#if (USE_UART_RX_DMA == 1)
-    /** start uart data reception */
+#define TX_DESC_COUNT 16 /** must be power of two */
+static TX_Desc_t TX_Desc[TX_DESC_COUNT];
+static volatile uint32_t TX_Desc_Head;
+static volatile uint32_t TX_Desc_Tail;
+
+/** chars of descriptor at TX_Desc_Tail already sent */
+static uint32_t TX_Desc_Offset;
+
+/** length of running tx dma transfer, 0 if tx dma is idle */
+static volatile uint32_t TX_DMA_Len;
+
+/** chars written to tx buffer by packet in assembly, not yet visible to tx dma */
+static uint32_t TX_Packet_Len;
+static uint32_t TX_Packet_Size;
+
+/**
+ * @brief start circular dma reception into ring buffer
+ */
+static void RB_Start_DMA(void)
+{
+    RX_DMA_Index = 0;
+
+    /** dma is configured in circular mode in cube @see usart.c */
     HAL_UART_Receive_DMA(SIM800_UART, RB_Storage, RB_STORAGE_SIZE);
-#else
-    HAL_UART_Receive_IT(SIM800_UART, &RB_Storage[0], 1);
-#endif
 
     /** enable idle interrupt */
     __HAL_UART_ENABLE_IT(SIM800_UART, UART_IT_IDLE);
 }
 
+/**
+ * @brief Init uart used for sim800
+ */
+void SIM800_UART_Init(void)
+{
+    /** configured in cube @see usart.c*/
+
+    RB_Init(&TX_RB, TX_RB_Storage, TX_RB_STORAGE_SIZE);
+    RB_Init(&RX_RB, RB_Storage, RB_STORAGE_SIZE);
+
+    /** start uart data reception */
+    RB_Start_DMA();
+}
+
 /**
  * @brief restart uart
  */
 void SIM800_UART_Restart(void)
 {
-#if (USE_UART_RX_DMA == 1)
     __HAL_UART_DISABLE_IT(SIM800_UART, UART_IT_IDLE);
     HAL_UART_DMAStop(SIM800_UART);
     HAL_UART_DeInit(SIM800_UART);
 
     HAL_UART_Init(SIM800_UART);
-    HAL_UART_Receive_DMA(SIM800_UART, RB_Storage, RB_STORAGE_SIZE);
-    __HAL_UART_ENABLE_IT(SIM800_UART, UART_IT_IDLE);
-#endif
+
+    /** drop pending tx, caller owned buffers are released unsent */
+    while (TX_Desc_Tail != TX_Desc_Head)
+    {
+        TX_Desc_t *desc = &TX_Desc[TX_Desc_Tail & (TX_DESC_COUNT - 1)];
+        TX_Desc_Tail++;
+        if (desc->Release != NULL)
+        {
+            desc->Release(desc->Ctx);
+        }
+    }
+    TX_Desc_Offset = 0;
+    RB_Reset(&TX_RB);
+    TX_DMA_Len = 0;
+    TX_Packet_Size = 0;
+
+    /** rx dma is stopped, no producer is active, overrun count is kept */
+    RB_Reset(&RX_RB);
+    RX_Resync = 0;
+
+    RB_Start_DMA();
 }
 
 /**
- * @brief flush ring buffer
+ * @brief publish new write position of rx dma
+ *        called on dma half transfer, transfer complete and uart idle events
  */
-static void RB_Flush(void)
+static void RB_Update_Write_Index(void)
 {
-    RB_Read_Index = RB_Write_Index;
+    uint32_t write_index = (RB_STORAGE_SIZE - __HAL_DMA_GET_COUNTER(SIM800_UART->hdmarx)) & (RB_STORAGE_SIZE - 1);
+
+    RB_Produce(&RX_RB, (write_index - RX_DMA_Index) & (RB_STORAGE_SIZE - 1));
+    RX_DMA_Index = write_index;
 }
 
 /**
- * @brief check if ring buffer is full
- * @retval return 1 if ring buffer is full
- * @note if using DMA, since data is written by dma, RB_Full_Flag can be not set at proper place. So this function might not be useful in this context.
+ * @brief start tx dma on descriptor at TX_Desc_Tail if dma is idle
+ *        called from thread, sim800 timer and uart tx complete contexts
  */
-static uint8_t RB_Is_Full(void)
+static void TX_Kick(void)
 {
-    return RB_Full_Flag;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (TX_DMA_Len == 0 && TX_Desc_Tail != TX_Desc_Head)
+    {
+        TX_Desc_t *desc = &TX_Desc[TX_Desc_Tail & (TX_DESC_COUNT - 1)];
+        const uint8_t *data;
+        uint32_t len = desc->Len - TX_Desc_Offset;
+
+        if (desc->Data != NULL)
+        {
+            data = desc->Data + TX_Desc_Offset;
+        }
+        else
+        {
+            /** run of chars in tx ring buffer, send first contiguous region of it */
+            RB_Span_t spans[2];
+            RB_Peek_Spans(&TX_RB, spans);
+            data = spans[0].Data;
+            if (len > spans[0].Len)
+            {
+                len = spans[0].Len;
+            }
+        }
+
+        if (len > 0xFFFF)
+        {
+            /** max dma transfer length */
+            len = 0xFFFF;
+        }
+
+        if (len > 0)
+        {
+            TX_DMA_Len = len;
+            if (HAL_UART_Transmit_DMA(SIM800_UART, (uint8_t *)data, len) != HAL_OK)
+            {
+                /** uart handle locked, retried on next kick */
+                TX_DMA_Len = 0;
+            }
+        }
+    }
+
+    __set_PRIMASK(primask);
 }
 
 /**
- * @brief check number of chars in ring buffer
- * @retval return number of chars in ring buffer
+ * @brief check if a descriptor can be queued, or merged with last queued run of tx buffer chars
+ * @note call with interrupts disabled
  */
-static uint32_t RB_Get_Count(void)
+static uint8_t TX_Desc_Available(uint8_t from_rb)
 {
-#if (USE_UART_RX_DMA == 1)
-    /** data is written to buffer via uart DMA in background*/
-    /** need to update Write_Index manually */
-    RB_Write_Index = RB_STORAGE_SIZE - SIM800_UART->hdmarx->Instance->NDTR;
+    if (TX_Desc_Head - TX_Desc_Tail < TX_DESC_COUNT)
+    {
+        return 1;
+    }
 
-    //RB_Full_Flag = (RB_Write_Index == RB_Read_Index);
-#endif
+    TX_Desc_t *last = &TX_Desc[(TX_Desc_Head - 1) & (TX_DESC_COUNT - 1)];
 
-    if (RB_Is_Full())
-        return RB_STORAGE_SIZE;
-    if (RB_Write_Index >= RB_Read_Index)
-        return (RB_Write_Index - RB_Read_Index);
-    return (RB_STORAGE_SIZE - (RB_Read_Index - RB_Write_Index));
+    return (from_rb && last->Data == NULL);
 }
 
 /**
- * @brief check if buffer is empty
- * @retval return 1 if ring buffer is empty
+ * @brief queue a descriptor for tx dma
+ * @param data caller owned buffer, NULL for chars in tx ring buffer
+ * @param len number of chars
+ * @param release called when caller owned buffer is sent
+ * @retval return 1 if queued
  */
-static uint8_t RB_Is_Empty(void)
+static uint8_t TX_Desc_Push(const uint8_t *data, uint32_t len, SIM800_UART_Release_CB_t release, void *ctx)
 {
-    return (RB_Get_Count() == 0);
+    uint8_t queued = 0;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    TX_Desc_t *last = &TX_Desc[(TX_Desc_Head - 1) & (TX_DESC_COUNT - 1)];
+
+    if (data == NULL && TX_Desc_Head != TX_Desc_Tail && last->Data == NULL)
+    {
+        /** extend last run of tx buffer chars, even if it is being sent */
+        last->Len += len;
+        queued = 1;
+    }
+    else if (TX_Desc_Head - TX_Desc_Tail < TX_DESC_COUNT)
+    {
+        TX_Desc_t *desc = &TX_Desc[TX_Desc_Head & (TX_DESC_COUNT - 1)];
+        desc->Data = data;
+        desc->Len = len;
+        desc->Release = release;
+        desc->Ctx = ctx;
+        TX_Desc_Head++;
+        queued = 1;
+    }
+
+    __set_PRIMASK(primask);
+
+    return queued;
 }
 
 /**
- * @brief return a char from from ring buffer
- * @retval char return
+ * @brief queue chars of tx ring buffer, descriptor is queued before chars are published
+ *        so tx dma never sends chars that are not yet covered by a descriptor
+ * @param count number of chars written after head of tx ring buffer
  */
-static int RB_Get_Char(void)
+static uint8_t TX_RB_Commit(uint32_t count)
 {
-    if (RB_Is_Empty())
+    if (count == 0)
     {
-        /** exception */
-        return -1;
+        return 1;
     }
 
-    uint8_t temp = RB_Storage[RB_Read_Index++];
-    RB_Full_Flag = 0;
+    if (!TX_Desc_Push(NULL, count, NULL, NULL))
+    {
+        return 0;
+    }
 
-    if (RB_Read_Index == RB_STORAGE_SIZE)
-        RB_Read_Index = 0;
+    RB_Produce(&TX_RB, count);
+    TX_Kick();
 
-    return temp;
+    return 1;
 }
 
 /**
- * @brief peek a char from from ring buffer
- * @retval char return
+ * @brief start assembling a packet directly in tx buffer
+ *        packet is sent by one dma transfer after @see SIM800_UART_Packet_End
+ *        (two if it wraps around end of tx buffer)
+ * @param size total number of chars in packet
+ * @retval return 1 if tx buffer has space for whole packet
  */
-static int RB_Peek_Char(void)
+uint8_t SIM800_UART_Packet_Begin(uint32_t size)
 {
-    if (RB_Is_Empty())
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t desc_available = TX_Desc_Available(1);
+    __set_PRIMASK(primask);
+
+    /** descriptors and ring space are only released in background, so it still fits at packet end */
+    if (RB_Get_Free(&TX_RB) < size || !desc_available)
     {
-        /** exception */
-        return -1;
+        return 0;
     }
 
-    uint8_t temp = RB_Storage[RB_Read_Index];
+    TX_Packet_Len = 0;
+    TX_Packet_Size = size;
 
-    return temp;
+    return 1;
 }
 
 /**
- * @brief return number of requested char from ring buffer
- *        if timeout occurs return only available chars
- * @param buff buffer where to retrieve
- * @param cnt  number of char to retrieve
- * @param timeout max wait time in milliseconds
+ * @brief append chars to packet in assembly
+ * @param data input buffer
+ * @param count number of chars
  */
-static uint32_t RB_Get_Chars(char *buff, uint32_t cnt, uint32_t timeout)
+void SIM800_UART_Packet_Put(const void *data, uint32_t count)
 {
-    uint32_t tick_now = HAL_GetTick();
-    uint32_t tick_timeout = tick_now + timeout;
-    uint32_t count = cnt;
-
-    while (RB_Get_Count() < cnt && (tick_now <= tick_timeout))
+    if (count > TX_Packet_Size - TX_Packet_Len)
     {
-        tick_now = HAL_GetTick();
+        /** more than reserved in @see SIM800_UART_Packet_Begin */
+        count = TX_Packet_Size - TX_Packet_Len;
     }
 
-    if (tick_now > tick_timeout)
+    RB_Write(&TX_RB, TX_Packet_Len, data, count);
+    TX_Packet_Len += count;
+}
+
+/**
+ * @brief append a char to packet in assembly
+ */
+void SIM800_UART_Packet_Put_Char(uint8_t data)
+{
+    SIM800_UART_Packet_Put(&data, 1);
+}
+
+/**
+ * @brief make assembled packet visible to tx dma and start sending it
+ */
+void SIM800_UART_Packet_End(void)
+{
+    TX_RB_Commit(TX_Packet_Len);
+    TX_Packet_Len = 0;
+    TX_Packet_Size = 0;
+}
+
+/**
+ * @brief drop packet in assembly, nothing of it is sent
+ */
+void SIM800_UART_Packet_Abort(void)
+{
+    TX_Packet_Len = 0;
+    TX_Packet_Size = 0;
+}
+
+/**
+ * @brief queue caller owned buffer for sending without copy, non blocking
+ *        chars are sent in order with everything queued before
+ * @param data buffer, must stay valid and unchanged until release is called
+ * @param count number of chars
+ * @param release called from uart interrupt when buffer is sent, can be NULL
+ * @param ctx passed to release
+ * @retval return 1 if queued, 0 if no tx descriptor is free
+ */
+uint8_t SIM800_UART_Send_Ref(const void *data, uint32_t count, SIM800_UART_Release_CB_t release, void *ctx)
+{
+    if (data == NULL || count == 0)
     {
-        /** get bytes available within timeout */
-        count = RB_Get_Count();
+        return 0;
     }
 
-    for (uint32_t i = 0; i < count; i++)
+    if (!TX_Desc_Push(data, count, release, ctx))
     {
-        buff[i] = RB_Get_Char();
+        return 0;
     }
 
-    return count;
+    TX_Kick();
+
+    return 1;
 }
 
 /**
- * @brief send character
- * @param data char to be sent
+ * @brief append caller owned buffer to packet in assembly without copy
+ *        chars assembled so far are queued first so order is kept
+ * @param data buffer, must stay valid and unchanged until release is called
+ * @param count number of chars, not part of size reserved in @see SIM800_UART_Packet_Begin
+ * @param release called from uart interrupt when buffer is sent, can be NULL
+ * @param ctx passed to release
+ * @retval return 1 if queued
+ * @note needs one tx descriptor for the buffer and one for each run of copied chars before it
  */
-void SIM800_UART_Send_Char(char data)
+uint8_t SIM800_UART_Packet_Put_Ref(const void *data, uint32_t count, SIM800_UART_Release_CB_t release, void *ctx)
 {
-    SIM800_UART->Instance->DR = data;
-    while (__HAL_UART_GET_FLAG(SIM800_UART, UART_FLAG_TC) == 0)
-        ;
+    TX_RB_Commit(TX_Packet_Len);
+    TX_Packet_Size -= TX_Packet_Len;
+    TX_Packet_Len = 0;
+
+    return SIM800_UART_Send_Ref(data, count, release, ctx);
 }
 
 /**
- * @brief send bytes buffer
- * @param data input buffer
- * @param number of chars to send
- **/
-void SIM800_UART_Send_Bytes(char *data, uint32_t count)
+ * @brief get number of caller owned buffers that can be queued with @see SIM800_UART_Send_Ref
+ */
+uint32_t SIM800_UART_Get_TX_Ref_Free(void)
 {
-    while (count--)
-    {
-        SIM800_UART_Send_Char(*data);
-        data++;
-    }
+    return TX_DESC_COUNT - (TX_Desc_Head - TX_Desc_Tail);
+}
+
+/**
+ * @brief queue character for sending, non blocking
+ * @param data char to be sent
+ * @retval return 1 if char is queued, 0 if tx buffer is full
+ */
+uint8_t SIM800_UART_Send_Char(char data)
+{
+    return SIM800_UART_Send_Bytes(&data, 1);
 }
 
 /**
- * @brief send bytes buffer using dma
+ * @brief queue bytes buffer for sending, non blocking
  * @param data input buffer
  * @param number of chars to send
+ * @retval number of chars queued, chars that do not fit in tx buffer are dropped
  **/
-void SIM800_UART_Send_Bytes_DMA(char *data, uint32_t count)
+uint32_t SIM800_UART_Send_Bytes(const char *data, uint32_t count)
 {
-    HAL_UART_Transmit_DMA(SIM800_UART, (uint8_t *)data, count);
+    uint32_t free = RB_Get_Free(&TX_RB);
+
+    if (count > free)
+    {
+        count = free;
+    }
+
+    RB_Write(&TX_RB, 0, (const uint8_t *)data, count);
+
+    if (!TX_RB_Commit(count))
+    {
+        return 0;
+    }
+
+    return count;
 }
 
 /**
- * @brief send null terminated string
+ * @brief queue null terminated string for sending, non blocking
  * @param str string buffer
+ * @retval number of chars queued
  **/
-void SIM800_UART_Send_String(char *str)
+uint32_t SIM800_UART_Send_String(const char *str)
 {
-    while (*str)
-    {
-        SIM800_UART_Send_Char(*str++);
-    }
+    return SIM800_UART_Send_Bytes(str, strlen(str));
 }
 
 /**
  * @brief wrapper printf around SIM800 uart
  * @param fmt formatted string
+ * @retval number of chars queued
  **/
-void SIM800_UART_Printf(const char *fmt, ...)
+uint32_t SIM800_UART_Printf(const char *fmt, ...)
 {
     static char buffer[512];
     va_list args;
     va_start(args, fmt);
-    uint32_t len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+    int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
     va_end(args);
 
-    SIM800_UART_Send_Bytes(buffer, len);
+    if (len < 0)
+    {
+        return 0;
+    }
+    if ((uint32_t)len >= sizeof(buffer))
+    {
+        len = sizeof(buffer) - 1;
+    }
+
+    return SIM800_UART_Send_Bytes(buffer, len);
+}
+
+/**
+ * @brief get number of chars queued for tx dma and not yet sent, caller owned buffers included
+ *        chars of running dma transfer count as not sent
+ */
+uint32_t SIM800_UART_Get_TX_Pending(void)
+{
+    uint32_t pending = 0;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t i = TX_Desc_Tail; i != TX_Desc_Head; i++)
+    {
+        pending += TX_Desc[i & (TX_DESC_COUNT - 1)].Len;
+    }
+
+    if (TX_Desc_Tail != TX_Desc_Head)
+    {
+        pending -= TX_Desc_Offset;
+    }
+
+    __set_PRIMASK(primask);
+
+    return pending;
+}
+
+/**
+ * @brief get free space in tx buffer
+ * @retval number of chars that can be queued without dropping
+ */
+uint32_t SIM800_UART_Get_TX_Free(void)
+{
+    return RB_Get_Free(&TX_RB);
 }
 
 /**
@@ -243,7 +497,44 @@ void SIM800_UART_Printf(const char *fmt, ...)
  */
 uint32_t SIM800_UART_Get_Count(void)
 {
-    return RB_Get_Count();
+    return RB_Get_Count(&RX_RB);
+}
+
+/**
+ * @brief get number of received chars lost because rx buffer was not read in time
+ */
+uint32_t SIM800_UART_Get_RX_Overrun_Count(void)
+{
+    return RB_Get_Overrun_Count(&RX_RB) + RX_Resync_Dropped;
+}
+
+/**
+ * @brief drop chars received before a uart error, stream has a gap there
+ * @retval return 1 once after each error, caller must reset its parser
+ * @note consumer side, call before reading rx buffer
+ */
+uint8_t SIM800_UART_RX_Resync(void)
+{
+    if (!RX_Resync)
+    {
+        return 0;
+    }
+
+    RX_Resync = 0;
+
+    uint32_t tail = RX_RB.Tail;
+
+    if ((int32_t)(RX_Resync_Valid - tail) > 0)
+    {
+        RX_Resync_Dropped += RX_Resync_Valid - tail;
+    }
+
+    if ((int32_t)(RX_Resync_Head - tail) > 0)
+    {
+        RB_Consume(&RX_RB, RX_Resync_Head - tail);
+    }
+
+    return 1;
 }
 
 /**
@@ -252,7 +543,7 @@ uint32_t SIM800_UART_Get_Count(void)
  */
 int SIM800_UART_Get_Char(void)
 {
-    return RB_Get_Char();
+    return RB_Get_Char(&RX_RB);
 }
 
 /**
@@ -261,7 +552,7 @@ int SIM800_UART_Get_Char(void)
  */
 int SIM800_UART_Peek_Char(void)
 {
-    return RB_Peek_Char();
+    return RB_Peek_Char(&RX_RB);
 }
 
 /**
@@ -273,13 +564,22 @@ int SIM800_UART_Peek_Char(void)
  */
 uint32_t SIM800_UART_Get_Chars(char *buffer, uint32_t count, uint32_t timeout)
 {
-    return RB_Get_Chars(buffer, count, timeout);
+    uint32_t tick_now = HAL_GetTick();
+    uint32_t tick_timeout = tick_now + timeout;
+
+    while (RB_Get_Count(&RX_RB) < count && (tick_now <= tick_timeout))
+    {
+        tick_now = HAL_GetTick();
+    }
+
+    /** if timeout occurs return only available chars */
+    return RB_Get_Chars(&RX_RB, (uint8_t *)buffer, count);
 }
 
 /**
  * @brief get chars upto '\r' or max upto timeout or buff_size
  * @param buffer
- * @param buff_size max count that can be written to buffer before '\r' is found
+ * @param buff_size size of buffer, line is always '\0' terminated
  * @param timeout maximum number of millisecond to wait before '\r' is found
  * @retval number chars received
  */
@@ -288,37 +588,92 @@ uint32_t SIM800_UART_Get_Line(char *buffer, uint32_t buff_size, uint32_t timeout
     uint32_t tick_now = HAL_GetTick();
     uint32_t tick_timeout = tick_now + timeout;
     uint32_t rx_chars_cnt = 0;
+    uint8_t line_found = 0;
 
-    while (tick_now <= tick_timeout && rx_chars_cnt < buff_size)
+    if (buff_size == 0)
     {
+        return 0;
+    }
+
+    /** keep room for '\0' */
+    buff_size--;
+
+    while (tick_now <= tick_timeout && rx_chars_cnt < buff_size && !line_found)
+    {
+        RB_Span_t spans[2];
+        uint32_t consumed = 0;
+
         tick_now = HAL_GetTick();
-        int rx_char = SIM800_UART_Get_Char();
-        if (rx_char != -1)
+        RB_Peek_Spans(&RX_RB, spans);
+
+        for (uint8_t i = 0; i < 2 && rx_chars_cnt < buff_size && !line_found; i++)
         {
-            /** carriage return found */
-            if (rx_char == '\r')
+            uint8_t *data = spans[i].Data;
+            uint8_t *cr = memchr(data, '\r', spans[i].Len);
+            uint32_t len = (cr != NULL) ? (uint32_t)(cr - data) : spans[i].Len;
+
+            if (len > buff_size - rx_chars_cnt)
             {
-                SIM800_UART_Get_Char(); /** remove '\n' */
-                buffer[rx_chars_cnt] = '\0';
-                break;
+                len = buff_size - rx_chars_cnt;
+                cr = NULL;
             }
 
-            if (rx_char != '\n') /** ignore '\n' if any */
+            for (uint32_t j = 0; j < len; j++)
             {
-                buffer[rx_chars_cnt++] = rx_char;
+                if (data[j] != '\n') /** ignore '\n' if any */
+                {
+                    buffer[rx_chars_cnt++] = data[j];
+                }
+            }
+            consumed += len;
+
+            /** carriage return found */
+            if (cr != NULL)
+            {
+                consumed++;
+                line_found = 1;
             }
         }
+
+        RB_Consume(&RX_RB, consumed);
     }
 
+    if (line_found && RB_Peek_Char(&RX_RB) == '\n')
+    {
+        RB_Get_Char(&RX_RB); /** remove '\n' */
+    }
+
+    buffer[rx_chars_cnt] = '\0';
+
     return rx_chars_cnt;
 }
 
+/**
+ * @brief get received chars in place without copying
+ * @param spans filled with up to two contiguous regions of rx buffer
+ * @retval number of chars available in spans
+ * @note chars stay valid until released with @see SIM800_UART_Consume
+ */
+uint32_t SIM800_UART_Peek_Spans(RB_Span_t spans[2])
+{
+    return RB_Peek_Spans(&RX_RB, spans);
+}
+
+/**
+ * @brief release chars obtained with @see SIM800_UART_Peek_Spans
+ * @param count number of chars to release
+ */
+void SIM800_UART_Consume(uint32_t count)
+{
+    RB_Consume(&RX_RB, count);
+}
+
 /**
  * @brief flus sim800 rx buffer
  */
 void SIM800_UART_Flush_RX(void)
 {
-    RB_Flush();
+    RB_Flush(&RX_RB);
 }
 
 /**
@@ -331,6 +686,8 @@ void SIM800_UART_RX_ISR(void)
     {
         __HAL_UART_CLEAR_IDLEFLAG(SIM800_UART);
 
+        RB_Update_Write_Index();
+
         /** start sim800 rx process */
         extern void SIM800_RX_Ready_Callback(void);
         SIM800_RX_Ready_Callback();
@@ -338,28 +695,92 @@ void SIM800_UART_RX_ISR(void)
 }
 
 /**
- * @brief called when uart tx dma finishes sending
+ * @brief called when uart tx dma finishes sending, start next region of tx buffer if any
  *        called from @see HAL_UART_TxCpltCallback in stm32f4xx_it.c
  **/
 void SIM800_UART_TX_CMPLT_ISR(void)
 {
-    extern void SIM800_TX_Complete_Callback(void);
-    SIM800_TX_Complete_Callback();
+    TX_Desc_t *desc = &TX_Desc[TX_Desc_Tail & (TX_DESC_COUNT - 1)];
+
+    if (desc->Data == NULL)
+    {
+        RB_Consume(&TX_RB, TX_DMA_Len);
+    }
+
+    TX_Desc_Offset += TX_DMA_Len;
+    TX_DMA_Len = 0;
+
+    if (TX_Desc_Offset >= desc->Len)
+    {
+        SIM800_UART_Release_CB_t release = desc->Release;
+        void *ctx = desc->Ctx;
+
+        TX_Desc_Offset = 0;
+        TX_Desc_Tail++;
+
+        if (release != NULL)
+        {
+            release(ctx);
+        }
+    }
+
+    TX_Kick();
+
+    if (TX_DMA_Len == 0)
+    {
+        /** tx buffer drained */
+        extern void SIM800_TX_Complete_Callback(void);
+        SIM800_TX_Complete_Callback();
+    }
+}
+
+/**
+ * @brief called when rx dma has filled first half of ring buffer
+ *        called from @see HAL_UART_RxHalfCpltCallback in stm32f4xx_it.c
+ **/
+void SIM800_UART_RX_HALF_CMPLT_ISR(void)
+{
+    RB_Update_Write_Index();
+
+    extern void SIM800_RX_Ready_Callback(void);
+    SIM800_RX_Ready_Callback();
 }
 
 /**
- * @brief called when uart rx is complete
+ * @brief called when rx dma has filled second half of ring buffer, dma wraps around
  *        called from @see HAL_UART_RxCpltCallback in stm32f4xx_it.c
  **/
 void SIM800_UART_RX_CMPLT_ISR(void)
 {
-#if (USE_UART_RX_DMA == 0)
-    RB_Write_Index++;
-    if (RB_Write_Index == RB_STORAGE_SIZE)
+    RB_Update_Write_Index();
+
+    extern void SIM800_RX_Ready_Callback(void);
+    SIM800_RX_Ready_Callback();
+}
+
+/**
+ * @brief called on uart error, overrun error aborts rx dma so restart reception
+ *        called from @see HAL_UART_ErrorCallback in stm32f4xx_it.c
+ **/
+void SIM800_UART_Error_ISR(void)
+{
+    if (SIM800_UART->RxState == HAL_UART_STATE_READY)
     {
-        RB_Write_Index = 0;
+        /** publish chars dma wrote before it was aborted */
+        RB_Update_Write_Index();
+
+        /** restarted dma writes from start of storage, skip head over the rest of storage
+         *  consumer drops everything up to there, ring indexes are not reset under it */
+        uint32_t gap = (RB_STORAGE_SIZE - RX_DMA_Index) & (RB_STORAGE_SIZE - 1);
+
+        RX_Resync_Head = RX_RB.Head + gap;
+        RX_Resync_Valid = RX_RB.Head;
+        RX_Resync = 1;
+
+        /** char that caused the error is lost */
+        RX_RB.Overrun_Count++;
+        RB_Produce(&RX_RB, gap);
+
+        RB_Start_DMA();
     }
-    /** start another reception */
-    HAL_UART_Receive_IT(SIM800_UART, (RB_Storage + RB_Write_Index), 1);
-#endif
 }
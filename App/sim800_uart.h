@@ -4,19 +4,40 @@
 /** standard includes */
 #include <stdint.h>
 
+/** app includes */
+#include "sim800_rb.h"
+
+/** called when a buffer queued with @see SIM800_UART_Send_Ref is no more needed */
+typedef void (*SIM800_UART_Release_CB_t)(void *ctx);
+
 void SIM800_UART_Init(void);
 void SIM800_UART_Restart(void);
-void SIM800_UART_Send_Char(char data);
-void SIM800_UART_Send_Bytes(char *data, uint32_t count);
-void SIM800_UART_Send_Bytes_DMA(char *data, uint32_t count);
-void SIM800_UART_Send_String(char *str);
-void SIM800_UART_Printf(const char *fmt, ...);
+uint8_t SIM800_UART_Send_Char(char data);
+uint32_t SIM800_UART_Send_Bytes(const char *data, uint32_t count);
+uint32_t SIM800_UART_Send_String(const char *str);
+uint32_t SIM800_UART_Printf(const char *fmt, ...);
+uint32_t SIM800_UART_Get_TX_Free(void);
+uint32_t SIM800_UART_Get_TX_Pending(void);
+
+uint8_t SIM800_UART_Packet_Begin(uint32_t size);
+void SIM800_UART_Packet_Put(const void *data, uint32_t count);
+void SIM800_UART_Packet_Put_Char(uint8_t data);
+void SIM800_UART_Packet_End(void);
+void SIM800_UART_Packet_Abort(void);
+uint8_t SIM800_UART_Packet_Put_Ref(const void *data, uint32_t count, SIM800_UART_Release_CB_t release, void *ctx);
+
+uint8_t SIM800_UART_Send_Ref(const void *data, uint32_t count, SIM800_UART_Release_CB_t release, void *ctx);
+uint32_t SIM800_UART_Get_TX_Ref_Free(void);
 void SIM800_UART_Flush_RX();
 
 int SIM800_UART_Get_Char(void);
 int SIM800_UART_Peek_Char(void);
 uint32_t SIM800_UART_Get_Count(void);
+uint32_t SIM800_UART_Get_RX_Overrun_Count(void);
+uint8_t SIM800_UART_RX_Resync(void);
 uint32_t SIM800_UART_Get_Chars(char *buffer, uint32_t count, uint32_t timeout);
 uint32_t SIM800_UART_Get_Line(char *buffer, uint32_t buff_size, uint32_t timeout);
+uint32_t SIM800_UART_Peek_Spans(RB_Span_t spans[2]);
+void SIM800_UART_Consume(uint32_t count);
 
 #endif /* SIM800_UART_H_ */
@@ -0,0 +1,128 @@
+/**
+ * host benchmark of sim800_cbor against snprintf json for one telemetry record
+ * reports encoded size and time per record of both, checks cbor bytes against a known encoding
+ *
+ * build and run from repo root:
+ *   gcc -O2 -IApp App/sim800_cbor.c test/bench_cbor.c -o bench_cbor && ./bench_cbor
+ */
+
+/** standard includes */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/** app includes */
+#include "sim800_cbor.h"
+
+#define BENCH_RECORDS 2000000
+
+typedef struct Bench_Sample_t
+{
+    uint32_t Time;
+    float Lat;
+    float Lon;
+    int16_t Speed;
+    uint8_t Fuel;
+    int8_t Temp;
+} Bench_Sample_t;
+
+static uint32_t Bench_CBOR(uint8_t *buffer, uint32_t size, const Bench_Sample_t *sample)
+{
+    CBOR_t cbor;
+
+    CBOR_Init(&cbor, buffer, size);
+
+    CBOR_Begin_Map(&cbor, 6);
+    CBOR_Put_Text(&cbor, "t");
+    CBOR_Put_Uint(&cbor, sample->Time);
+    CBOR_Put_Text(&cbor, "lat");
+    CBOR_Put_Float(&cbor, sample->Lat);
+    CBOR_Put_Text(&cbor, "lon");
+    CBOR_Put_Float(&cbor, sample->Lon);
+    CBOR_Put_Text(&cbor, "v");
+    CBOR_Put_Int(&cbor, sample->Speed);
+    CBOR_Put_Text(&cbor, "fuel");
+    CBOR_Put_Uint(&cbor, sample->Fuel);
+    CBOR_Put_Text(&cbor, "temp");
+    CBOR_Put_Int(&cbor, sample->Temp);
+
+    return cbor.Len;
+}
+
+static uint32_t Bench_JSON(char *buffer, uint32_t size, const Bench_Sample_t *sample)
+{
+    return snprintf(buffer,
+                    size,
+                    "{\"t\":%lu,\"lat\":%.5f,\"lon\":%.5f,\"v\":%d,\"fuel\":%u,\"temp\":%d}",
+                    (unsigned long)sample->Time,
+                    sample->Lat,
+                    sample->Lon,
+                    sample->Speed,
+                    sample->Fuel,
+                    sample->Temp);
+}
+
+static double Bench_Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+    /** RFC 8949 encoding of the record below, floats as single precision */
+    static const uint8_t expected[] = {
+        0xA6,
+        0x61, 't', 0x1A, 0x65, 0x53, 0xF1, 0x00,
+        0x63, 'l', 'a', 't', 0xFA, 0x42, 0x52, 0x14, 0x7E,
+        0x63, 'l', 'o', 'n', 0xFA, 0x41, 0x56, 0x7A, 0xAD,
+        0x61, 'v', 0x18, 0x57,
+        0x64, 'f', 'u', 'e', 'l', 0x18, 0x3F,
+        0x64, 't', 'e', 'm', 'p', 0x23,
+    };
+    Bench_Sample_t sample = {1700000000, 52.52001f, 13.40495f, 87, 63, -4};
+    uint8_t cbor[128];
+    char json[128];
+
+    uint32_t cbor_len = Bench_CBOR(cbor, sizeof(cbor), &sample);
+    uint32_t json_len = Bench_JSON(json, sizeof(json), &sample);
+
+    if (cbor_len != sizeof(expected) || memcmp(cbor, expected, cbor_len) != 0)
+    {
+        printf("FAIL: cbor encoding differs\n");
+        return 1;
+    }
+
+    printf("size: cbor %lu bytes, json %lu bytes\n", (unsigned long)cbor_len, (unsigned long)json_len);
+
+    volatile uint32_t sink = 0;
+    double start = Bench_Now();
+
+    for (uint32_t i = 0; i < BENCH_RECORDS; i++)
+    {
+        sample.Time = i;
+        sink += Bench_CBOR(cbor, sizeof(cbor), &sample);
+    }
+
+    double cbor_time = Bench_Now() - start;
+
+    start = Bench_Now();
+
+    for (uint32_t i = 0; i < BENCH_RECORDS; i++)
+    {
+        sample.Time = i;
+        sink += Bench_JSON(json, sizeof(json), &sample);
+    }
+
+    double json_time = Bench_Now() - start;
+
+    printf("time: cbor %.1f ns, json %.1f ns per record on host\n",
+           cbor_time * 1e9 / BENCH_RECORDS,
+           json_time * 1e9 / BENCH_RECORDS);
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * host benchmark of sim800_lz on telemetry-like json
+ * reports compression ratio for several feed chunk sizes and for 200 byte batches,
+ * and time per input byte, checks every stream decompresses back to its input
+ *
+ * build and run from repo root:
+ *   gcc -O2 -IApp App/sim800_lz.c test/bench_lz.c -o bench_lz && ./bench_lz
+ */
+
+/** standard includes */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC 1
+#endif
+
+/** app includes */
+#include "sim800_lz.h"
+
+#define BENCH_INPUT_SIZE 100000
+#define BENCH_BATCH_SIZE 200 /** typical batch size of @see SIM800_Batch_t */
+#define BENCH_ROUNDS 50
+
+static LZ_t LZ;
+static uint8_t Input[BENCH_INPUT_SIZE + 256];
+static uint8_t Output[2 * BENCH_INPUT_SIZE];
+static uint8_t Decoded[BENCH_INPUT_SIZE + 256];
+
+/**
+ * @brief fill input with one json sample per line, as a tracker would send
+ * @retval input length
+ */
+static uint32_t Bench_Make_Input(void)
+{
+    uint32_t len = 0;
+
+    srand(1);
+
+    for (uint32_t i = 0; len < BENCH_INPUT_SIZE; i++)
+    {
+        len += sprintf((char *)Input + len,
+                       "{\"id\":\"truck-17\",\"t\":%lu,\"lat\":52.%04d,\"lon\":13.%04d,\"v\":%d,\"fuel\":%d}\n",
+                       1700000000ul + i * 10,
+                       3000 + rand() % 50,
+                       4000 + rand() % 50,
+                       40 + rand() % 30,
+                       500 - (int)(i / 100));
+    }
+
+    return len;
+}
+
+/**
+ * @brief compress input as one stream, fed in chunks
+ * @retval compressed length
+ */
+static uint32_t Bench_Compress(const uint8_t *in, uint32_t len, uint32_t chunk)
+{
+    uint32_t out_len = 0;
+
+    LZ_Init(&LZ);
+
+    for (uint32_t pos = 0; pos < len; pos += chunk)
+    {
+        uint32_t count = (len - pos < chunk) ? len - pos : chunk;
+        out_len += LZ_Compress(&LZ, in + pos, count, Output + out_len);
+    }
+
+    return out_len + LZ_Finish(&LZ, Output + out_len);
+}
+
+/**
+ * @brief check compressed stream in Output decodes back to input
+ */
+static int Bench_Check(const uint8_t *in, uint32_t len, uint32_t out_len)
+{
+    uint32_t decoded = LZ_Decompress(Output, out_len, Decoded, sizeof(Decoded));
+
+    return decoded == len && memcmp(Decoded, in, len) == 0;
+}
+
+static double Bench_Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+    uint32_t len = Bench_Make_Input();
+
+    printf("input: %lu bytes of json samples\n", (unsigned long)len);
+
+    for (uint32_t chunk = 8; chunk <= 4096; chunk *= 8)
+    {
+        uint32_t out_len = Bench_Compress(Input, len, chunk);
+
+        if (!Bench_Check(Input, len, out_len))
+        {
+            printf("FAIL: chunk %lu does not decompress\n", (unsigned long)chunk);
+            return 1;
+        }
+
+        printf("one stream, chunks of %4lu: %lu -> %lu bytes (%.1f %%)\n",
+               (unsigned long)chunk,
+               (unsigned long)len,
+               (unsigned long)out_len,
+               100.0 * out_len / len);
+    }
+
+    /** each batch is its own stream, as sent by sim800_batch */
+    uint32_t batch_in = 0;
+    uint32_t batch_out = 0;
+
+    for (uint32_t pos = 0; pos + BENCH_BATCH_SIZE <= len; pos += BENCH_BATCH_SIZE)
+    {
+        uint32_t out_len = Bench_Compress(Input + pos, BENCH_BATCH_SIZE, BENCH_BATCH_SIZE);
+
+        if (!Bench_Check(Input + pos, BENCH_BATCH_SIZE, out_len))
+        {
+            printf("FAIL: batch at %lu does not decompress\n", (unsigned long)pos);
+            return 1;
+        }
+
+        batch_in += BENCH_BATCH_SIZE;
+        batch_out += out_len;
+    }
+
+    printf("%d byte batches: %.1f %%\n", BENCH_BATCH_SIZE, 100.0 * batch_out / batch_in);
+
+    /** incompressible input must stay within bound */
+    for (uint32_t i = 0; i < len; i++)
+    {
+        Input[i] = (uint8_t)rand();
+    }
+    LZ_Init(&LZ);
+    uint32_t bound = LZ_Bound(&LZ, len);
+    uint32_t out_len = Bench_Compress(Input, len, 100);
+
+    printf("random: %lu -> %lu bytes, bound %lu\n", (unsigned long)len, (unsigned long)out_len, (unsigned long)bound);
+
+    if (out_len > bound || !Bench_Check(Input, len, out_len))
+    {
+        printf("FAIL: random input\n");
+        return 1;
+    }
+
+    /** speed on json fed in 64 byte chunks */
+    len = Bench_Make_Input();
+
+    double start = Bench_Now();
+#ifdef BENCH_HAS_TSC
+    uint64_t tsc_start = __rdtsc();
+#endif
+
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        Bench_Compress(Input, len, 64);
+    }
+
+#ifdef BENCH_HAS_TSC
+    uint64_t tsc = __rdtsc() - tsc_start;
+#endif
+    double seconds = Bench_Now() - start;
+
+    printf("compress: %.2f ns per byte", seconds * 1e9 / BENCH_ROUNDS / len);
+#ifdef BENCH_HAS_TSC
+    printf(", %.1f tsc cycles per byte", (double)tsc / BENCH_ROUNDS / len);
+#endif
+    printf(" on host\n");
+
+    return 0;
+}
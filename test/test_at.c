@@ -0,0 +1,142 @@
+/**
+ * host test of sim800_at
+ * checks lines dispatch to the handler of their exact name, arguments are parsed
+ * and bad tables are refused
+ *
+ * build and run from repo root:
+ *   gcc -O2 -fsanitize=address,undefined -IApp App/sim800_at.c test/test_at.c -o test_at && ./test_at
+ */
+
+/** standard includes */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/** app includes */
+#include "sim800_at.h"
+
+#define TEST_CHECK(cond)                                                   \
+    do                                                                     \
+    {                                                                      \
+        if (!(cond))                                                       \
+        {                                                                  \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                      \
+        }                                                                  \
+    } while (0)
+
+static uint32_t Hit[4];
+static AT_Args_t Last;
+
+static void Test_OK(const AT_Args_t *args)
+{
+    Hit[0]++;
+    Last = *args;
+}
+
+static void Test_Connect(const AT_Args_t *args)
+{
+    Hit[1]++;
+    Last = *args;
+}
+
+static void Test_CGATT(const AT_Args_t *args)
+{
+    Hit[2]++;
+    Last = *args;
+}
+
+static void Test_CCLK(const AT_Args_t *args)
+{
+    Hit[3]++;
+    Last = *args;
+}
+
+static const AT_Response_t Test_Responses[] = {
+    {"OK", Test_OK},
+    {"CONNECT", Test_Connect},
+    {"+CGATT", Test_CGATT},
+    {"+CCLK", Test_CCLK},
+};
+
+static AT_Table_t Table;
+
+/**
+ * @brief only whole names or the part before ':' match
+ */
+static int Test_Dispatch(void)
+{
+    TEST_CHECK(AT_Table_Init(&Table, Test_Responses, sizeof(Test_Responses) / sizeof(Test_Responses[0])));
+
+    TEST_CHECK(AT_Table_Dispatch(&Table, "OK") && Hit[0] == 1);
+    TEST_CHECK(!AT_Table_Dispatch(&Table, "OKAY"));
+    TEST_CHECK(!AT_Table_Dispatch(&Table, "O"));
+    TEST_CHECK(!AT_Table_Dispatch(&Table, ""));
+    TEST_CHECK(!AT_Table_Dispatch(&Table, "CONNECT OK"));
+    TEST_CHECK(AT_Table_Dispatch(&Table, "CONNECT") && Hit[1] == 1);
+    TEST_CHECK(!AT_Table_Dispatch(&Table, "10.1.2.3"));
+    TEST_CHECK(Hit[0] == 1 && Hit[1] == 1 && Hit[2] == 0 && Hit[3] == 0);
+    return 0;
+}
+
+/**
+ * @brief numbers after name are parsed, '-' right before a number is its sign
+ */
+static int Test_Args(void)
+{
+    TEST_CHECK(AT_Table_Dispatch(&Table, "+CGATT: 1") && Hit[2] == 1);
+    TEST_CHECK(Last.Count == 1 && Last.Num[0] == 1);
+    TEST_CHECK(strcmp(Last.Text, "1") == 0);
+
+    TEST_CHECK(AT_Table_Dispatch(&Table, "+CCLK: \"26/10/16,12:30:05-08\"") && Hit[3] == 1);
+    TEST_CHECK(Last.Count == 7);
+    TEST_CHECK(Last.Num[0] == 26 && Last.Num[1] == 10 && Last.Num[2] == 16);
+    TEST_CHECK(Last.Num[3] == 12 && Last.Num[4] == 30 && Last.Num[5] == 5 && Last.Num[6] == -8);
+
+    /** extra numbers are not parsed */
+    AT_Args_t args;
+    AT_Args_Parse(&args, ": 1,2,3,4,5,6,7,8,9,10");
+    TEST_CHECK(args.Count == AT_ARG_MAX && args.Num[AT_ARG_MAX - 1] == AT_ARG_MAX);
+
+    /** long digit runs saturate instead of overflowing */
+    AT_Args_Parse(&args, ": 89014103211118510720,-2147483647,2147483648,-99999999999,357938035643809");
+    TEST_CHECK(args.Count == 5);
+    TEST_CHECK(args.Num[0] == INT32_MAX && args.Num[1] == -INT32_MAX && args.Num[2] == INT32_MAX);
+    TEST_CHECK(args.Num[3] == -INT32_MAX && args.Num[4] == INT32_MAX);
+    return 0;
+}
+
+/**
+ * @brief tables with a name given twice or too many responses are refused
+ */
+static int Test_Bad_Table(void)
+{
+    static const AT_Response_t dup[] = {{"OK", Test_OK}, {"OK", Test_Connect}};
+    static AT_Response_t many[AT_SLOT_MAX / 2 + 1];
+    static char names[AT_SLOT_MAX / 2 + 1][8];
+    AT_Table_t table;
+
+    TEST_CHECK(!AT_Table_Init(&table, dup, 2));
+
+    for (uint32_t i = 0; i < sizeof(many) / sizeof(many[0]); i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "R%u", (unsigned)i);
+        many[i].Name = names[i];
+        many[i].Handler = Test_OK;
+    }
+    TEST_CHECK(AT_Table_Init(&table, many, AT_SLOT_MAX / 2));
+    TEST_CHECK(!AT_Table_Init(&table, many, AT_SLOT_MAX / 2 + 1));
+    return 0;
+}
+
+int main(void)
+{
+    int fail = 0;
+
+    fail |= Test_Dispatch();
+    fail |= Test_Args();
+    fail |= Test_Bad_Table();
+
+    printf("at: %s\n", fail ? "FAIL" : "ok");
+    return fail;
+}
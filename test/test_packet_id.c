@@ -0,0 +1,139 @@
+/**
+ * host test of sim800_packet_id
+ * checks allocation order, wrap around from the last word, exhaustion
+ * and random alloc/release churn against a plain reference table
+ *
+ * build and run from repo root:
+ *   gcc -O2 -fsanitize=address,undefined -IApp App/sim800_packet_id.c test/test_packet_id.c -o test_packet_id && ./test_packet_id
+ */
+
+/** standard includes */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** app includes */
+#include "sim800_packet_id.h"
+
+#define TEST_CHURN_ROUNDS 200000
+
+#define TEST_CHECK(cond)                                                   \
+    do                                                                     \
+    {                                                                      \
+        if (!(cond))                                                       \
+        {                                                                  \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                      \
+        }                                                                  \
+    } while (0)
+
+static Packet_ID_t IDs;
+static uint8_t Ref[65536];
+
+/**
+ * @brief ids come out in order 1..65535, then the table is exhausted
+ */
+static int Test_Sequence(void)
+{
+    Packet_ID_Init(&IDs);
+    for (uint32_t i = 1; i <= UINT16_MAX; i++)
+    {
+        TEST_CHECK(Packet_ID_Alloc(&IDs) == i);
+    }
+    TEST_CHECK(IDs.Count == UINT16_MAX);
+    TEST_CHECK(Packet_ID_Alloc(&IDs) == 0);
+
+    /** a released id is found again after wrap around */
+    Packet_ID_Release(&IDs, 100);
+    TEST_CHECK(Packet_ID_Alloc(&IDs) == 100);
+    TEST_CHECK(Packet_ID_Alloc(&IDs) == 0);
+    return 0;
+}
+
+/**
+ * @brief next id in last word with rest of word used must wrap to word 0
+ */
+static int Test_Wrap_Last_Word(void)
+{
+    Packet_ID_Init(&IDs);
+    for (uint32_t i = 65504; i <= UINT16_MAX; i++)
+    {
+        TEST_CHECK(Packet_ID_Take(&IDs, i));
+    }
+    IDs.Next = UINT16_MAX;
+    TEST_CHECK(Packet_ID_Alloc(&IDs) == 1);
+    TEST_CHECK(Packet_ID_Alloc(&IDs) == 2);
+
+    /** same with only a hole far below next */
+    Packet_ID_Init(&IDs);
+    for (uint32_t i = 1; i <= UINT16_MAX; i++)
+    {
+        Packet_ID_Take(&IDs, i);
+    }
+    Packet_ID_Release(&IDs, 5);
+    IDs.Next = 65534;
+    TEST_CHECK(Packet_ID_Alloc(&IDs) == 5);
+    TEST_CHECK(Packet_ID_Alloc(&IDs) == 0);
+    return 0;
+}
+
+/**
+ * @brief random alloc/release, compares every id with the reference table
+ */
+static int Test_Churn(void)
+{
+    uint32_t count = 0;
+
+    Packet_ID_Init(&IDs);
+    memset(Ref, 0, sizeof(Ref));
+    srand(1);
+
+    for (uint32_t round = 0; round < TEST_CHURN_ROUNDS; round++)
+    {
+        /** keep table mostly full so words fill up and wrap */
+        if ((rand() % 64) < 63 || count == 0)
+        {
+            uint16_t id = Packet_ID_Alloc(&IDs);
+            if (count == UINT16_MAX)
+            {
+                TEST_CHECK(id == 0);
+                continue;
+            }
+            TEST_CHECK(id != 0);
+            TEST_CHECK(Ref[id] == 0);
+            Ref[id] = 1;
+            count++;
+        }
+        else
+        {
+            uint16_t id = (uint16_t)(1 + rand() % UINT16_MAX);
+            TEST_CHECK(Packet_ID_Is_Used(&IDs, id) == Ref[id]);
+            if (Ref[id])
+            {
+                Packet_ID_Release(&IDs, id);
+                Ref[id] = 0;
+                count--;
+            }
+        }
+        TEST_CHECK(IDs.Count == count);
+    }
+
+    for (uint32_t i = 1; i <= UINT16_MAX; i++)
+    {
+        TEST_CHECK(Packet_ID_Is_Used(&IDs, (uint16_t)i) == Ref[i]);
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int fail = 0;
+
+    fail |= Test_Sequence();
+    fail |= Test_Wrap_Last_Word();
+    fail |= Test_Churn();
+
+    printf("packet_id: %s\n", fail ? "FAIL" : "ok");
+    return fail;
+}
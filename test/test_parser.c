@@ -0,0 +1,403 @@
+/**
+ * host test of sim800_mqtt_parser for mqtt 3.1.1
+ * checks every control packet type, the same stream split at every byte boundary and fed byte by byte,
+ * bodies truncated to the parser buffer, input cut off mid packet, modem text lines,
+ * random input, and reports decode time per byte
+ *
+ * build and run from repo root:
+ *   gcc -O2 -fsanitize=address,undefined -IApp App/sim800_mqtt_parser.c test/test_parser.c -o test_parser && ./test_parser
+ */
+
+/** standard includes */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** app includes */
+#include "sim800_mqtt_parser.h"
+
+#define TEST_CHECK(cond)                                                   \
+    do                                                                     \
+    {                                                                      \
+        if (!(cond))                                                       \
+        {                                                                  \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                      \
+        }                                                                  \
+    } while (0)
+
+#define TEST_FRAME_MAX 32
+#define TEST_DATA_MAX 32
+#define TEST_FUZZ_BYTES 2000000
+#define TEST_SPEED_ROUNDS 20000
+
+/** frame copied out of callback, its pointers are only valid during the call */
+typedef struct Test_Frame_t
+{
+    uint8_t Header;
+    uint8_t Type;
+    uint8_t QOS;
+    uint8_t Truncated;
+    uint16_t Packet_ID;
+    char Topic[TEST_DATA_MAX];
+    uint8_t Data[TEST_DATA_MAX];
+    uint32_t Data_Len;
+} Test_Frame_t;
+
+typedef struct Test_Log_t
+{
+    Test_Frame_t Frame[TEST_FRAME_MAX];
+    uint32_t Frame_Count;
+    char Line[4][MQTT_PARSER_LINE_MAX];
+    uint32_t Line_Count;
+} Test_Log_t;
+
+/** one packet of each type, as a broker or client would send it */
+static const uint8_t Test_Stream[] = {
+    0x10, 0x0C, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x00, 0x3C, 0x00, 0x00, /** CONNECT */
+    0x20, 0x02, 0x01, 0x00,                                                         /** CONNACK */
+    0x30, 0x0A, 0x00, 0x03, 'a', '/', 'b', 'h', 'e', 'l', 'l', 'o',                 /** PUBLISH qos 0 */
+    0x32, 0x09, 0x00, 0x01, 'x', 0x12, 0x34, 'd', 'a', 't', 'a',                    /** PUBLISH qos 1 */
+    0x35, 0x07, 0x00, 0x01, 'y', 0x00, 0x07, 'z', 'z',                              /** PUBLISH qos 2 retain */
+    0x40, 0x02, 0x00, 0x01,                                                         /** PUBACK */
+    0x50, 0x02, 0x00, 0x02,                                                         /** PUBREC */
+    0x62, 0x02, 0x00, 0x03,                                                         /** PUBREL */
+    0x70, 0x02, 0x00, 0x04,                                                         /** PUBCOMP */
+    0x82, 0x06, 0x00, 0x05, 0x00, 0x01, 'a', 0x01,                                  /** SUBSCRIBE */
+    0x90, 0x03, 0x00, 0x05, 0x01,                                                   /** SUBACK */
+    0xA2, 0x05, 0x00, 0x06, 0x00, 0x01, 'a',                                        /** UNSUBSCRIBE */
+    0xB0, 0x02, 0x00, 0x06,                                                         /** UNSUBACK */
+    0xC0, 0x00,                                                                     /** PINGREQ */
+    0xD0, 0x00,                                                                     /** PINGRESP */
+    0xE0, 0x00,                                                                     /** DISCONNECT */
+};
+
+/** expected frames of @see Test_Stream */
+static const struct
+{
+    uint8_t Type;
+    uint8_t QOS;
+    uint16_t Packet_ID;
+    const char *Topic;
+    uint32_t Data_Len;
+} Test_Expect[] = {
+    {MQTT_CONNECT, 0, 0, "", 12},
+    {MQTT_CONNACK, 0, 0, "", 2},
+    {MQTT_PUBLISH, 0, 0, "a/b", 5},
+    {MQTT_PUBLISH, 1, 0x1234, "x", 4},
+    {MQTT_PUBLISH, 2, 7, "y", 2},
+    {MQTT_PUBACK, 0, 1, "", 0},
+    {MQTT_PUBREC, 0, 2, "", 0},
+    {MQTT_PUBREL, 0, 3, "", 0},
+    {MQTT_PUBCOMP, 0, 4, "", 0},
+    {MQTT_SUBSCRIBE, 0, 5, "", 4},
+    {MQTT_SUBACK, 0, 5, "", 1},
+    {MQTT_UNSUBSCRIBE, 0, 6, "", 3},
+    {MQTT_UNSUBACK, 0, 6, "", 0},
+    {MQTT_PINGREQ, 0, 0, "", 0},
+    {MQTT_PINGRESP, 0, 0, "", 0},
+    {MQTT_DISCONNECT, 0, 0, "", 0},
+};
+#define TEST_EXPECT_COUNT (sizeof(Test_Expect) / sizeof(Test_Expect[0]))
+
+static MQTT_Parser_t Parser;
+static uint8_t Buffer[64];
+static Test_Log_t Log;
+
+static void Test_Frame_CB(void *ctx, const MQTT_Frame_t *frame)
+{
+    Test_Log_t *log = ctx;
+
+    if (log->Frame_Count >= TEST_FRAME_MAX)
+    {
+        return;
+    }
+
+    Test_Frame_t *copy = &log->Frame[log->Frame_Count++];
+
+    memset(copy, 0, sizeof(Test_Frame_t));
+    copy->Header = frame->Header;
+    copy->Type = frame->Type;
+    copy->QOS = frame->QOS;
+    copy->Truncated = frame->Truncated;
+    copy->Packet_ID = frame->Packet_ID;
+    copy->Data_Len = frame->Data_Len;
+
+    if (frame->Topic != NULL && frame->Topic_Len < TEST_DATA_MAX)
+    {
+        memcpy(copy->Topic, frame->Topic, frame->Topic_Len);
+    }
+    if (frame->Data != NULL)
+    {
+        memcpy(copy->Data, frame->Data, (frame->Data_Len < TEST_DATA_MAX) ? frame->Data_Len : TEST_DATA_MAX);
+    }
+}
+
+static void Test_Line_CB(void *ctx, const char *line, uint32_t len)
+{
+    Test_Log_t *log = ctx;
+
+    if (log->Line_Count < 4)
+    {
+        memcpy(log->Line[log->Line_Count], line, len + 1);
+        log->Line_Count++;
+    }
+}
+
+static void Test_Start(uint32_t buffer_size)
+{
+    memset(&Log, 0, sizeof(Log));
+    MQTT_Parser_Init(&Parser, Buffer, buffer_size, Test_Frame_CB, Test_Line_CB, &Log);
+}
+
+/**
+ * @brief frames logged so far are those of @see Test_Stream
+ */
+static int Test_Check_Stream(void)
+{
+    TEST_CHECK(Log.Frame_Count == TEST_EXPECT_COUNT);
+    TEST_CHECK(Parser.Error_Count == 0);
+
+    for (uint32_t i = 0; i < TEST_EXPECT_COUNT; i++)
+    {
+        const Test_Frame_t *frame = &Log.Frame[i];
+
+        TEST_CHECK(frame->Type == Test_Expect[i].Type);
+        TEST_CHECK(frame->QOS == Test_Expect[i].QOS);
+        TEST_CHECK(frame->Packet_ID == Test_Expect[i].Packet_ID);
+        TEST_CHECK(strcmp(frame->Topic, Test_Expect[i].Topic) == 0);
+        TEST_CHECK(frame->Data_Len == Test_Expect[i].Data_Len);
+        TEST_CHECK(frame->Truncated == 0);
+    }
+
+    TEST_CHECK(memcmp(Log.Frame[1].Data, "\x01\x00", 2) == 0);
+    TEST_CHECK(memcmp(Log.Frame[2].Data, "hello", 5) == 0);
+    TEST_CHECK(memcmp(Log.Frame[3].Data, "data", 4) == 0);
+    TEST_CHECK(Log.Frame[4].Header == 0x35);
+    TEST_CHECK(Log.Frame[10].Data[0] == 0x01);
+    return 0;
+}
+
+/**
+ * @brief every packet type in one chunk
+ */
+static int Test_Types(void)
+{
+    Test_Start(sizeof(Buffer));
+    TEST_CHECK(MQTT_Parser_Feed(&Parser, Test_Stream, sizeof(Test_Stream)) == sizeof(Test_Stream));
+    return Test_Check_Stream();
+}
+
+/**
+ * @brief stream split in two at every byte boundary, then fed byte by byte
+ */
+static int Test_Split(void)
+{
+    for (uint32_t split = 0; split <= sizeof(Test_Stream); split++)
+    {
+        Test_Start(sizeof(Buffer));
+        MQTT_Parser_Feed(&Parser, Test_Stream, split);
+        MQTT_Parser_Feed(&Parser, &Test_Stream[split], sizeof(Test_Stream) - split);
+        if (Test_Check_Stream())
+        {
+            printf("split at %u\n", (unsigned)split);
+            return 1;
+        }
+    }
+
+    Test_Start(sizeof(Buffer));
+    for (uint32_t i = 0; i < sizeof(Test_Stream); i++)
+    {
+        MQTT_Parser_Feed(&Parser, &Test_Stream[i], 1);
+    }
+    return Test_Check_Stream();
+}
+
+/**
+ * @brief split body longer than buffer is cut to it, a variable header cut off is an error,
+ *        input cut off mid packet is dropped by reset
+ */
+static int Test_Truncate(void)
+{
+    static const uint8_t publish[] = {0x30, 0x19, 0x00, 0x03, 'a', '/', 'b',
+                                      '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+                                      '0', '1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    static const uint8_t pingresp[] = {0xD0, 0x00};
+
+    /** in one chunk body is decoded in place, buffer size does not matter */
+    Test_Start(8);
+    MQTT_Parser_Feed(&Parser, publish, sizeof(publish));
+    TEST_CHECK(Log.Frame_Count == 1 && !Log.Frame[0].Truncated && Log.Frame[0].Data_Len == 20);
+
+    /** split, only first 8 body chars are kept */
+    Test_Start(8);
+    MQTT_Parser_Feed(&Parser, publish, 10);
+    MQTT_Parser_Feed(&Parser, &publish[10], sizeof(publish) - 10);
+    MQTT_Parser_Feed(&Parser, pingresp, sizeof(pingresp));
+    TEST_CHECK(Log.Frame_Count == 2);
+    TEST_CHECK(Log.Frame[0].Truncated && Log.Frame[0].Data_Len == 3);
+    TEST_CHECK(strcmp(Log.Frame[0].Topic, "a/b") == 0 && memcmp(Log.Frame[0].Data, "012", 3) == 0);
+    TEST_CHECK(Log.Frame[1].Type == MQTT_PINGRESP);
+
+    /** topic does not fit, packet is an error, next one still parses */
+    Test_Start(4);
+    MQTT_Parser_Feed(&Parser, publish, 10);
+    MQTT_Parser_Feed(&Parser, &publish[10], sizeof(publish) - 10);
+    MQTT_Parser_Feed(&Parser, pingresp, sizeof(pingresp));
+    TEST_CHECK(Log.Frame_Count == 1 && Log.Frame[0].Type == MQTT_PINGRESP);
+    TEST_CHECK(Parser.Error_Count == 1);
+
+    /** link dropped mid packet */
+    for (uint32_t cut = 1; cut < sizeof(publish); cut++)
+    {
+        Test_Start(sizeof(Buffer));
+        MQTT_Parser_Feed(&Parser, publish, cut);
+        TEST_CHECK(Log.Frame_Count == 0);
+        MQTT_Parser_Reset(&Parser);
+        MQTT_Parser_Feed(&Parser, pingresp, sizeof(pingresp));
+        TEST_CHECK(Log.Frame_Count == 1 && Log.Frame[0].Type == MQTT_PINGRESP);
+    }
+
+    /** remaining length of more than 4 bytes */
+    Test_Start(sizeof(Buffer));
+    MQTT_Parser_Feed(&Parser, (const uint8_t *)"\x30\xFF\xFF\xFF\xFF", 5);
+    TEST_CHECK(Parser.Error_Count >= 1);
+    return 0;
+}
+
+/**
+ * @brief text from modem between packets goes to line callback
+ */
+static int Test_Lines(void)
+{
+    static const uint8_t input[] = "\r\nCLOSED\r\n\r\nOK\r\n";
+
+    Test_Start(sizeof(Buffer));
+    MQTT_Parser_Feed(&Parser, input, sizeof(input) - 1);
+    MQTT_Parser_Feed(&Parser, (const uint8_t *)"\xD0\x00", 2);
+    TEST_CHECK(Log.Line_Count == 2);
+    TEST_CHECK(strcmp(Log.Line[0], "CLOSED") == 0 && strcmp(Log.Line[1], "OK") == 0);
+    TEST_CHECK(Log.Frame_Count == 1 && Log.Frame[0].Type == MQTT_PINGRESP);
+
+    /** PUBREC header is 'P', after a line end it is still a packet */
+    Test_Start(sizeof(Buffer));
+    MQTT_Parser_Feed(&Parser, (const uint8_t *)"\r\n\x50\x02\x00\x07", 6);
+    TEST_CHECK(Log.Frame_Count == 1 && Log.Frame[0].Type == MQTT_PUBREC && Log.Frame[0].Packet_ID == 7);
+
+    Test_Start(sizeof(Buffer));
+    MQTT_Parser_Feed(&Parser, (const uint8_t *)"\r\nCLOSED\r\n\x50\x02\x00\x08", 14);
+    TEST_CHECK(Log.Line_Count == 1 && strcmp(Log.Line[0], "CLOSED") == 0);
+    TEST_CHECK(Log.Frame_Count == 1 && Log.Frame[0].Type == MQTT_PUBREC && Log.Frame[0].Packet_ID == 8);
+    return 0;
+}
+
+/**
+ * @brief random input and mutated packets must not read out of bounds, sanitizers catch it,
+ *        parser works again after reset
+ */
+static int Test_Fuzz(void)
+{
+    static uint8_t input[4096];
+    uint32_t fed = 0;
+
+    Test_Start(16);
+    srand(1);
+
+    while (fed < TEST_FUZZ_BYTES)
+    {
+        uint32_t len = 1 + rand() % sizeof(input);
+
+        if (rand() & 1)
+        {
+            for (uint32_t i = 0; i < len; i++)
+            {
+                input[i] = (uint8_t)rand();
+            }
+        }
+        else
+        {
+            /** valid packets with some bytes flipped */
+            for (uint32_t i = 0; i < len; i++)
+            {
+                input[i] = Test_Stream[i % sizeof(Test_Stream)];
+                if ((rand() & 31) == 0)
+                {
+                    input[i] = (uint8_t)rand();
+                }
+            }
+        }
+
+        /** fed in random pieces */
+        uint32_t pos = 0;
+        while (pos < len)
+        {
+            uint32_t piece = 1 + rand() % (len - pos);
+            TEST_CHECK(MQTT_Parser_Feed(&Parser, &input[pos], piece) == piece);
+            pos += piece;
+        }
+        fed += len;
+        Log.Frame_Count = 0;
+        Log.Line_Count = 0;
+    }
+
+    MQTT_Parser_Reset(&Parser);
+    Log.Frame_Count = 0;
+    MQTT_Parser_Feed(&Parser, (const uint8_t *)"\xD0\x00", 2);
+    TEST_CHECK(Log.Frame_Count == 1 && Log.Frame[0].Type == MQTT_PINGRESP);
+    return 0;
+}
+
+/**
+ * @brief decode time per byte of @see Test_Stream fed in one chunk and in 7 byte pieces
+ */
+static void Test_Speed(void)
+{
+    struct timespec t0, t1, t2;
+
+    Test_Start(sizeof(Buffer));
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (uint32_t round = 0; round < TEST_SPEED_ROUNDS; round++)
+    {
+        MQTT_Parser_Feed(&Parser, Test_Stream, sizeof(Test_Stream));
+        Log.Frame_Count = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (uint32_t round = 0; round < TEST_SPEED_ROUNDS; round++)
+    {
+        for (uint32_t pos = 0; pos < sizeof(Test_Stream); pos += 7)
+        {
+            uint32_t piece = (sizeof(Test_Stream) - pos < 7) ? sizeof(Test_Stream) - pos : 7;
+            MQTT_Parser_Feed(&Parser, &Test_Stream[pos], piece);
+        }
+        Log.Frame_Count = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    double bytes = (double)TEST_SPEED_ROUNDS * sizeof(Test_Stream);
+    double whole = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    double split = (t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec);
+
+    printf("decode %.1f ns/byte in one chunk, %.1f ns/byte in 7 byte pieces\n", whole / bytes, split / bytes);
+}
+
+int main(void)
+{
+    int fail = 0;
+
+    fail |= Test_Types();
+    fail |= Test_Split();
+    fail |= Test_Truncate();
+    fail |= Test_Lines();
+    fail |= Test_Fuzz();
+
+    if (!fail)
+    {
+        Test_Speed();
+    }
+
+    printf("parser: %s\n", fail ? "FAIL" : "ok");
+    return fail;
+}
@@ -0,0 +1,110 @@
+/**
+ * host test of sim800_rb
+ * checks put and get across the storage end, overrun counting, spans,
+ * and counters wrapping around 2^32
+ *
+ * build and run from repo root:
+ *   gcc -O2 -fsanitize=address,undefined -IApp App/sim800_rb.c test/test_rb.c -o test_rb && ./test_rb
+ */
+
+/** standard includes */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/** app includes */
+#include "sim800_rb.h"
+
+#define TEST_CHECK(cond)                                                   \
+    do                                                                     \
+    {                                                                      \
+        if (!(cond))                                                       \
+        {                                                                  \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                      \
+        }                                                                  \
+    } while (0)
+
+static RB_t RB;
+static uint8_t Storage[8];
+
+/**
+ * @brief size must be power of two, chars come out in order
+ */
+static int Test_Put_Get(void)
+{
+    uint8_t out[16];
+
+    TEST_CHECK(!RB_Init(&RB, Storage, 6));
+    TEST_CHECK(RB_Init(&RB, Storage, sizeof(Storage)));
+
+    TEST_CHECK(RB_Put_Chars(&RB, (const uint8_t *)"abcdef", 6) == 6);
+    TEST_CHECK(RB_Get_Chars(&RB, out, 4) == 4);
+    TEST_CHECK(memcmp(out, "abcd", 4) == 0);
+
+    /** only free room is written, rest counts as overrun */
+    TEST_CHECK(RB_Put_Chars(&RB, (const uint8_t *)"ghijklmn", 8) == 6);
+    TEST_CHECK(RB_Get_Overrun_Count(&RB) == 2);
+    TEST_CHECK(RB_Get_Count(&RB) == 8);
+    TEST_CHECK(RB_Get_Free(&RB) == 0);
+    TEST_CHECK(RB_Get_Chars(&RB, out, sizeof(out)) == 8);
+    TEST_CHECK(memcmp(out, "efghijkl", 8) == 0);
+    TEST_CHECK(RB_Get_Char(&RB) == -1);
+    return 0;
+}
+
+/**
+ * @brief data across storage end comes as two spans
+ */
+static int Test_Spans(void)
+{
+    RB_Span_t spans[2];
+
+    RB_Reset(&RB);
+    RB_Put_Chars(&RB, (const uint8_t *)"123456", 6);
+    RB_Consume(&RB, 6);
+    RB_Put_Chars(&RB, (const uint8_t *)"wxyz", 4);
+
+    TEST_CHECK(RB_Peek_Spans(&RB, spans) == 4);
+    TEST_CHECK(spans[0].Len == 2 && memcmp(spans[0].Data, "wx", 2) == 0);
+    TEST_CHECK(spans[1].Len == 2 && memcmp(spans[1].Data, "yz", 2) == 0);
+    TEST_CHECK(RB_Peek_Char(&RB) == 'w');
+    RB_Consume(&RB, 3);
+    TEST_CHECK(RB_Get_Char(&RB) == 'z');
+    return 0;
+}
+
+/**
+ * @brief producer running over consumer drops oldest chars, counters wrap
+ */
+static int Test_Overrun_Wrap(void)
+{
+    /** overrun count is a total, reset keeps it */
+    uint32_t overrun = RB_Get_Overrun_Count(&RB);
+
+    RB_Reset(&RB);
+    RB_Produce(&RB, 10);
+    TEST_CHECK(RB_Get_Overrun_Count(&RB) == overrun + 2);
+    TEST_CHECK(RB_Get_Count(&RB) == 0);
+
+    RB.Head = 0xFFFFFFFE;
+    RB.Tail = 0xFFFFFFFE;
+    TEST_CHECK(RB_Put_Chars(&RB, (const uint8_t *)"xyz", 3) == 3);
+    TEST_CHECK(RB_Get_Count(&RB) == 3);
+    TEST_CHECK(RB_Get_Char(&RB) == 'x');
+    TEST_CHECK(RB_Get_Char(&RB) == 'y');
+    TEST_CHECK(RB_Get_Char(&RB) == 'z');
+    return 0;
+}
+
+int main(void)
+{
+    int fail = 0;
+
+    fail |= Test_Put_Get();
+    fail |= Test_Spans();
+    fail |= Test_Overrun_Wrap();
+
+    printf("rb: %s\n", fail ? "FAIL" : "ok");
+    return fail;
+}
@@ -0,0 +1,195 @@
+/**
+ * host test of sim800_topic
+ * checks trie and filter matching with wildcards, topics that are not null terminated,
+ * and removal of filters
+ *
+ * build and run from repo root:
+ *   gcc -O2 -fsanitize=address,undefined -IApp App/sim800_topic.c test/test_topic.c -o test_topic && ./test_topic
+ */
+
+/** standard includes */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/** app includes */
+#include "sim800_topic.h"
+
+#define TEST_CHECK(cond)                                                   \
+    do                                                                     \
+    {                                                                      \
+        if (!(cond))                                                       \
+        {                                                                  \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                      \
+        }                                                                  \
+    } while (0)
+
+static const char *Filters[] = {"a/b", "a/+", "a/#", "#", "+/b", "$SYS/#", "x/+/z"};
+#define TEST_FILTER_COUNT (sizeof(Filters) / sizeof(Filters[0]))
+
+static Topic_Trie_t Trie;
+static uint32_t Hits;
+
+/**
+ * @brief trie matches by level hash only, confirm like sim800_mqtt does
+ */
+static void Test_Match_CB(void *ctx, uint8_t sub)
+{
+    const char *topic = ctx;
+
+    if (Topic_Filter_Match(Filters[sub], topic, strlen(topic)))
+    {
+        Hits++;
+    }
+}
+
+static uint32_t Test_Match(const char *topic)
+{
+    Hits = 0;
+    Topic_Trie_Match(&Trie, topic, strlen(topic), Test_Match_CB, (void *)topic);
+    return Hits;
+}
+
+/**
+ * @brief each topic hits every filter matching it
+ */
+static int Test_Trie(void)
+{
+    Topic_Trie_Init(&Trie);
+    for (uint8_t i = 0; i < TEST_FILTER_COUNT; i++)
+    {
+        TEST_CHECK(Topic_Trie_Insert(&Trie, Filters[i], i));
+    }
+
+    TEST_CHECK(Test_Match("a/b") == 5);
+    TEST_CHECK(Test_Match("a") == 2);
+    TEST_CHECK(Test_Match("$SYS/x") == 1);
+    TEST_CHECK(Test_Match("x/y/z") == 2);
+    TEST_CHECK(Test_Match("q/b") == 2);
+    return 0;
+}
+
+/**
+ * @brief topic length is honoured, received topics are not null terminated
+ */
+static int Test_Filter(void)
+{
+    char topic[200];
+
+    TEST_CHECK(Topic_Filter_Match("a/b", "a/bc", 3));
+    TEST_CHECK(!Topic_Filter_Match("a/b", "a/bc", 4));
+    TEST_CHECK(!Topic_Filter_Match("a/b/c", "a/b", 3));
+    TEST_CHECK(Topic_Filter_Match("a/#", "a", 1));
+    TEST_CHECK(!Topic_Filter_Match("#", "$SYS/x", 6));
+
+    memset(topic, 'x', 150);
+    strcpy(topic + 150, "/end");
+    TEST_CHECK(Topic_Filter_Match("+/end", topic, strlen(topic)));
+
+    TEST_CHECK(Topic_Filter_Valid("a/+/#"));
+    TEST_CHECK(!Topic_Filter_Valid("a/#/b"));
+    TEST_CHECK(!Topic_Filter_Valid("a+"));
+    return 0;
+}
+
+/**
+ * @brief removing every filter gives all nodes back
+ */
+static int Test_Remove(void)
+{
+    TEST_CHECK(Topic_Trie_Remove(&Trie, "a/+"));
+    TEST_CHECK(!Topic_Trie_Remove(&Trie, "a/+"));
+    TEST_CHECK(Test_Match("a/c") == 2);
+
+    for (uint8_t i = 0; i < TEST_FILTER_COUNT; i++)
+    {
+        if (i != 1)
+        {
+            TEST_CHECK(Topic_Trie_Remove(&Trie, Filters[i]));
+        }
+    }
+    TEST_CHECK(Trie.Root == TOPIC_NONE);
+    return 0;
+}
+
+/**
+ * @brief count unused nodes
+ */
+static uint32_t Test_Free_Count(void)
+{
+    uint32_t count = 0;
+
+    for (uint8_t node = Trie.Free; node != TOPIC_NONE; node = Trie.Node[node].Sibling)
+    {
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * @brief filters deeper than TOPIC_DEPTH_MAX are refused, failed inserts give their nodes back
+ */
+static int Test_Limits(void)
+{
+    char filter[2 * TOPIC_NODE_MAX + 8];
+    uint32_t pos = 0;
+
+    Topic_Trie_Init(&Trie);
+
+    /** deepest filter that can be removed again */
+    for (uint32_t i = 0; i < TOPIC_DEPTH_MAX; i++)
+    {
+        filter[pos++] = 'a' + i;
+        filter[pos++] = '/';
+    }
+    filter[pos - 1] = '\0';
+    TEST_CHECK(Topic_Trie_Insert(&Trie, filter, 0));
+    TEST_CHECK(Topic_Trie_Remove(&Trie, filter));
+    TEST_CHECK(Test_Free_Count() == TOPIC_NODE_MAX);
+
+    /** one level more */
+    filter[pos - 1] = '/';
+    filter[pos++] = 'z';
+    filter[pos] = '\0';
+    TEST_CHECK(!Topic_Trie_Insert(&Trie, filter, 0));
+    TEST_CHECK(Test_Free_Count() == TOPIC_NODE_MAX);
+
+    /** a shared prefix stays, levels added by the failed insert go */
+    TEST_CHECK(Topic_Trie_Insert(&Trie, "a/b", 1));
+    TEST_CHECK(!Topic_Trie_Insert(&Trie, filter, 0));
+    TEST_CHECK(Test_Free_Count() == TOPIC_NODE_MAX - 2);
+
+    /** full trie, repeated failed inserts with distinct prefixes do not drain it */
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        pos = 0;
+        for (uint32_t level = 0; level < TOPIC_DEPTH_MAX; level++)
+        {
+            filter[pos++] = 'A' + i;
+            filter[pos++] = 'a' + level;
+            filter[pos++] = '/';
+        }
+        filter[pos - 1] = '\0';
+
+        uint32_t free = Test_Free_Count();
+        uint8_t added = Topic_Trie_Insert(&Trie, filter, 2 + i);
+        TEST_CHECK(added ? Test_Free_Count() == free - TOPIC_DEPTH_MAX : Test_Free_Count() == free);
+    }
+    TEST_CHECK(Test_Free_Count() < TOPIC_DEPTH_MAX);
+    return 0;
+}
+
+int main(void)
+{
+    int fail = 0;
+
+    fail |= Test_Trie();
+    fail |= Test_Filter();
+    fail |= Test_Remove();
+    fail |= Test_Limits();
+
+    printf("topic: %s\n", fail ? "FAIL" : "ok");
+    return fail;
+}